@@ -8,7 +8,7 @@
  *                    <barrow_dj@mail.yahoo.com,djbarrow@de.ibm.com>
  * Copyright (c) 2004 Roland McGrath <roland@redhat.com>
  * Copyright (c) 2006 Dmitry V. Levin <ldv@strace.io>
- * Copyright (c) 2006-2024 The strace developers.
+ * Copyright (c) 2006-2026 The strace developers.
  * All rights reserved.
  *
  * SPDX-License-Identifier: LGPL-2.1-or-later
@@ -18,6 +18,25 @@
 
 #include <stdarg.h>
 
+#include "sample.h"
+
+/*
+ * Call durations are accounted in a log-linear histogram: durations
+ * shorter than HIST_SUB_CNT nanoseconds have a bucket each, every longer
+ * power of two range is split into HIST_SUB_CNT buckets, so the relative
+ * error of the reported percentiles does not exceed 1/HIST_SUB_CNT.
+ * Durations of 2^HIST_MAX_BITS nanoseconds (about 4.9 hours) and longer
+ * are accounted in the last bucket.
+ */
+#define HIST_SUB_BITS	5
+#define HIST_SUB_CNT	(1U << HIST_SUB_BITS)
+#define HIST_MAX_BITS	44
+#define HIST_BUCKETS	((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_CNT)
+
+/* Percentiles that can be shown in the summary, in permille. */
+static const unsigned int pct_permille[] = { 500, 900, 990, 999 };
+#define PCT_CNT ARRAY_SIZE(pct_permille)
+
 /* Per-syscall stats structure */
 struct call_counts {
 	/* time may be total latency or system time */
@@ -25,12 +44,22 @@ struct call_counts {
 	struct timespec time_min;
 	struct timespec time_max;
 	struct timespec time_avg;
+	struct timespec time_pct[PCT_CNT];
 	uint64_t calls, errors;
+	/* histogram of call durations, allocated if percentiles are needed */
+	uint64_t *hist;
 };
 
 static struct call_counts *countv[SUPPORTED_PERSONALITIES];
 #define counts (countv[current_personality])
 
+/*
+ * When the summary is printed periodically, countv holds the stats
+ * of the current interval only, and totalv accumulates the stats
+ * of all finished intervals.
+ */
+static struct call_counts *totalv[SUPPORTED_PERSONALITIES];
+
 static const struct timespec zero_ts;
 static const struct timespec max_ts = {
 	(time_t) (long long) (zero_extend_signed_to_ull((time_t) -1ULL) >> 1),
@@ -38,6 +67,21 @@ static const struct timespec max_ts = {
 
 static struct timespec overhead;
 
+/* Whether call duration histograms are to be collected. */
+static bool count_percentiles;
+
+static enum summary_format {
+	SUMMARY_FORMAT_TEXT,
+	SUMMARY_FORMAT_JSON,
+} summary_format;
+
+static struct timespec summary_interval;
+static timer_t summary_timer = (timer_t) -1;
+/* CLOCK_MONOTONIC times of the start of tracing, of the current interval,
+ * and of the next expiration of the summary timer.  */
+static struct timespec summary_start_ts;
+static struct timespec interval_start_ts;
+static struct timespec interval_next_ts;
 
 enum count_summary_columns {
 	CSC_NONE,
@@ -46,6 +90,10 @@ enum count_summary_columns {
 	CSC_TIME_MIN,
 	CSC_TIME_MAX,
 	CSC_TIME_AVG,
+	CSC_TIME_P50,
+	CSC_TIME_P90,
+	CSC_TIME_P99,
+	CSC_TIME_P999,
 	CSC_CALLS,
 	CSC_ERRORS,
 	CSC_SC_NAME,
@@ -53,6 +101,22 @@ enum count_summary_columns {
 	CSC_MAX,
 };
 
+/* Keys of the columns in machine-readable summaries. */
+static const char *const column_keys[CSC_MAX] = {
+	[CSC_TIME_100S]  = "time_percent",
+	[CSC_TIME_TOTAL] = "total_time",
+	[CSC_TIME_MIN]   = "min_time",
+	[CSC_TIME_MAX]   = "max_time",
+	[CSC_TIME_AVG]   = "avg_time",
+	[CSC_TIME_P50]   = "p50_time",
+	[CSC_TIME_P90]   = "p90_time",
+	[CSC_TIME_P99]   = "p99_time",
+	[CSC_TIME_P999]  = "p999_time",
+	[CSC_CALLS]      = "calls",
+	[CSC_ERRORS]     = "errors",
+	[CSC_SC_NAME]    = "name",
+};
+
 static uint8_t columns[CSC_MAX] = {
 	CSC_TIME_100S,
 	CSC_TIME_TOTAL,
@@ -87,6 +151,28 @@ static const struct {
 	{ "avg-time",     CSC_TIME_AVG   },
 	{ "time_avg",     CSC_TIME_AVG   },
 	{ "time-avg",     CSC_TIME_AVG   },
+	{ "median",       CSC_TIME_P50   },
+	{ "p50",          CSC_TIME_P50   },
+	{ "p50_time",     CSC_TIME_P50   },
+	{ "p50-time",     CSC_TIME_P50   },
+	{ "time_p50",     CSC_TIME_P50   },
+	{ "time-p50",     CSC_TIME_P50   },
+	{ "p90",          CSC_TIME_P90   },
+	{ "p90_time",     CSC_TIME_P90   },
+	{ "p90-time",     CSC_TIME_P90   },
+	{ "time_p90",     CSC_TIME_P90   },
+	{ "time-p90",     CSC_TIME_P90   },
+	{ "p99",          CSC_TIME_P99   },
+	{ "p99_time",     CSC_TIME_P99   },
+	{ "p99-time",     CSC_TIME_P99   },
+	{ "time_p99",     CSC_TIME_P99   },
+	{ "time-p99",     CSC_TIME_P99   },
+	{ "p99.9",        CSC_TIME_P999  },
+	{ "p999",         CSC_TIME_P999  },
+	{ "p999_time",    CSC_TIME_P999  },
+	{ "p999-time",    CSC_TIME_P999  },
+	{ "time_p999",    CSC_TIME_P999  },
+	{ "time-p999",    CSC_TIME_P999  },
 	{ "calls",        CSC_CALLS      },
 	{ "count",        CSC_CALLS      },
 	{ "error",        CSC_ERRORS     },
@@ -99,18 +185,148 @@ static const struct {
 	{ "nothing",      CSC_NONE       },
 };
 
+static bool
+is_pct_column(unsigned int column)
+{
+	return column >= CSC_TIME_P50 && column <= CSC_TIME_P999;
+}
+
+static unsigned int
+hist_index(const struct timespec *ts)
+{
+	if ((uint64_t) ts->tv_sec >= (1ULL << HIST_MAX_BITS) / 1000000000)
+		return HIST_BUCKETS - 1;
+
+	const uint64_t ns = ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+	if (ns < HIST_SUB_CNT)
+		return ns;
+
+	const unsigned int shift = ilog2_64(ns) - HIST_SUB_BITS;
+	const unsigned int idx = (shift + 1) * HIST_SUB_CNT
+				 + (ns >> shift) - HIST_SUB_CNT;
+
+	return MIN(idx, HIST_BUCKETS - 1);
+}
+
+/* Return the largest duration accounted in the histogram bucket idx. */
+static uint64_t
+hist_value(unsigned int idx)
+{
+	if (idx < HIST_SUB_CNT)
+		return idx;
+
+	const unsigned int shift = idx / HIST_SUB_CNT - 1;
+	const uint64_t lower = (uint64_t) (HIST_SUB_CNT + idx % HIST_SUB_CNT)
+			       << shift;
+
+	return lower + (1ULL << shift) - 1;
+}
+
+/*
+ * Calculate the given percentile of durations accounted in hist,
+ * clamped to [min, max], as the histogram buckets are coarser than that.
+ */
+static void
+hist_percentile(struct timespec *ts, const uint64_t *hist, uint64_t calls,
+		unsigned int permille, const struct timespec *min,
+		const struct timespec *max)
+{
+	const uint64_t rank = MAX((calls * permille + 999) / 1000, 1);
+	uint64_t seen = 0;
+	unsigned int idx;
+
+	for (idx = 0; idx < HIST_BUCKETS - 1; ++idx) {
+		seen += hist[idx];
+		if (seen >= rank)
+			break;
+	}
+
+	const uint64_t ns = hist_value(idx);
+	struct timespec val = {
+		.tv_sec = ns / 1000000000,
+		.tv_nsec = ns % 1000000000,
+	};
+	*ts = *ts_min(ts_max(&val, min), max);
+}
+
+static void
+merge_counts(struct call_counts *dst, const struct call_counts *src)
+{
+	for (size_t i = 0; i < nsyscalls; ++i) {
+		if (src[i].calls == 0)
+			continue;
+
+		ts_add(&dst[i].time, &dst[i].time, &src[i].time);
+		dst[i].time_min = *ts_min(&dst[i].time_min, &src[i].time_min);
+		dst[i].time_max = *ts_max(&dst[i].time_max, &src[i].time_max);
+		dst[i].calls += src[i].calls;
+		dst[i].errors += src[i].errors;
+
+		if (src[i].hist) {
+			if (!dst[i].hist)
+				dst[i].hist = xcalloc(HIST_BUCKETS,
+						      sizeof(*dst[i].hist));
+			for (size_t j = 0; j < HIST_BUCKETS; ++j)
+				dst[i].hist[j] += src[i].hist[j];
+		}
+	}
+}
+
+static void
+reset_counts(struct call_counts *cv)
+{
+	for (size_t i = 0; i < nsyscalls; ++i) {
+		uint64_t *hist = cv[i].hist;
+
+		memset(&cv[i], 0, sizeof(cv[i]));
+		cv[i].time_min = max_ts;
+		if (hist) {
+			memset(hist, 0, HIST_BUCKETS * sizeof(*hist));
+			cv[i].hist = hist;
+		}
+	}
+}
+
+static struct call_counts *
+alloc_counts(void)
+{
+	struct call_counts *cv = xcalloc(nsyscalls, sizeof(*cv));
+
+	reset_counts(cv);
+
+	return cv;
+}
+
+static void
+free_counts(struct call_counts *cv)
+{
+	if (!cv)
+		return;
+
+	for (size_t i = 0; i < nsyscalls; ++i)
+		free(cv[i].hist);
+	free(cv);
+}
+
+static bool
+has_calls(const struct call_counts *cv)
+{
+	for (size_t i = 0; i < nsyscalls; ++i) {
+		if (cv[i].calls)
+			return true;
+	}
+
+	return false;
+}
+
 void
 count_syscall(struct tcb *tcp, const struct timespec *syscall_exiting_ts)
 {
 	if (!scno_in_range(tcp->scno))
 		return;
 
-	if (!counts) {
-		counts = xcalloc(nsyscalls, sizeof(*counts));
-
-		for (size_t i = 0; i < nsyscalls; i++)
-			counts[i].time_min = max_ts;
-	}
+	if (!counts)
+		counts = alloc_counts();
 	struct call_counts *cc = &counts[tcp->scno];
 
 	cc->calls++;
@@ -133,6 +349,12 @@ count_syscall(struct tcb *tcp, const struct timespec *syscall_exiting_ts)
 	ts_add(&cc->time, &cc->time, wts_nonneg);
 	cc->time_min = *ts_min(&cc->time_min, wts_nonneg);
 	cc->time_max = *ts_max(&cc->time_max, wts_nonneg);
+
+	if (count_percentiles) {
+		if (!cc->hist)
+			cc->hist = xcalloc(HIST_BUCKETS, sizeof(*cc->hist));
+		cc->hist[hist_index(wts_nonneg)]++;
+	}
 }
 
 static int
@@ -164,6 +386,37 @@ avg_time_cmp(const void *a, const void *b)
 		       &counts[*((unsigned int *) b)].time_avg);
 }
 
+static int
+pct_time_cmp(const void *a, const void *b, unsigned int pct)
+{
+	return -ts_cmp(&counts[*((unsigned int *) a)].time_pct[pct],
+		       &counts[*((unsigned int *) b)].time_pct[pct]);
+}
+
+static int
+p50_time_cmp(const void *a, const void *b)
+{
+	return pct_time_cmp(a, b, 0);
+}
+
+static int
+p90_time_cmp(const void *a, const void *b)
+{
+	return pct_time_cmp(a, b, 1);
+}
+
+static int
+p99_time_cmp(const void *a, const void *b)
+{
+	return pct_time_cmp(a, b, 2);
+}
+
+static int
+p999_time_cmp(const void *a, const void *b)
+{
+	return pct_time_cmp(a, b, 3);
+}
+
 static int
 syscall_cmp(const void *a, const void *b)
 {
@@ -208,6 +461,10 @@ set_sortby(const char *sortby)
 		[CSC_TIME_MIN]   = min_time_cmp,
 		[CSC_TIME_MAX]   = max_time_cmp,
 		[CSC_TIME_AVG]   = avg_time_cmp,
+		[CSC_TIME_P50]   = p50_time_cmp,
+		[CSC_TIME_P90]   = p90_time_cmp,
+		[CSC_TIME_P99]   = p99_time_cmp,
+		[CSC_TIME_P999]  = p999_time_cmp,
 		[CSC_CALLS]      = count_cmp,
 		[CSC_ERRORS]     = error_cmp,
 		[CSC_SC_NAME]    = syscall_cmp,
@@ -216,6 +473,8 @@ set_sortby(const char *sortby)
 	for (size_t i = 0; i < ARRAY_SIZE(column_aliases); ++i) {
 		if (!strcmp(column_aliases[i].name, sortby)) {
 			sortfun = sort_fns[column_aliases[i].column];
+			if (is_pct_column(column_aliases[i].column))
+				count_percentiles = true;
 			return;
 		}
 	}
@@ -255,6 +514,8 @@ set_count_summary_columns(const char *s)
 
 			columns[cur++] = column_aliases[i].column;
 			visible[column_aliases[i].column] = 1;
+			if (is_pct_column(column_aliases[i].column))
+				count_percentiles = true;
 			found = true;
 
 			break;
@@ -283,6 +544,77 @@ set_overhead(const char *str)
 	return parse_ts(str, &overhead);
 }
 
+int
+set_summary_interval(const char *str)
+{
+	if (parse_ts(str, &summary_interval) < 0 ||
+	    !ts_nz(&summary_interval))
+		return -1;
+
+	return 0;
+}
+
+int
+set_summary_format(const char *str)
+{
+	if (!strcmp(str, "text"))
+		summary_format = SUMMARY_FORMAT_TEXT;
+	else if (!strcmp(str, "json"))
+		summary_format = SUMMARY_FORMAT_JSON;
+	else
+		return -1;
+
+	return 0;
+}
+
+void
+start_summary_timer(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &summary_start_ts);
+	interval_start_ts = summary_start_ts;
+
+	if (!ts_nz(&summary_interval))
+		return;
+
+	ts_add(&interval_next_ts, &summary_start_ts, &summary_interval);
+
+	const struct itimerspec its = {
+		.it_interval = summary_interval,
+		.it_value = interval_next_ts,
+	};
+
+	if (timer_create(CLOCK_MONOTONIC, NULL, &summary_timer))
+		perror_msg_and_die("timer_create");
+	if (timer_settime(summary_timer, TIMER_ABSTIME, &its, NULL))
+		perror_msg_and_die("timer_settime");
+}
+
+bool
+is_summary_timer_armed(void)
+{
+	return summary_timer != (timer_t) -1;
+}
+
+bool
+summary_timer_expired(void)
+{
+	if (!is_summary_timer_armed())
+		return false;
+
+	struct timespec ts_now;
+	clock_gettime(CLOCK_MONOTONIC, &ts_now);
+	if (ts_cmp(&ts_now, &interval_next_ts) < 0)
+		return false;
+
+	/* Skip the expirations that have been missed, if any.  */
+	do {
+		ts_add(&interval_next_ts, &interval_next_ts,
+		       &summary_interval);
+	} while (ts_cmp(&ts_now, &interval_next_ts) >= 0);
+
+	return true;
+}
+
 static size_t ATTRIBUTE_FORMAT((printf, 1, 2))
 num_chars(const char *fmt, ...)
 {
@@ -295,6 +627,98 @@ num_chars(const char *fmt, ...)
 	return (unsigned int) MAX(ret, 0);
 }
 
+/*
+ * Numbers are printed without printf floating point conversions
+ * as the latter are locale dependent.
+ */
+static void
+print_json_ts(FILE *outf, const struct timespec *ts)
+{
+	fprintf(outf, "%lld.%09ld", (long long) ts->tv_sec, (long) ts->tv_nsec);
+}
+
+/*
+ * With --sample-window, the calls, errors, and total times are reported
+ * as estimated for the whole tracing time.
+ */
+static uint64_t
+scale_count(uint64_t n, double scale)
+{
+	if (!is_sampling_enabled())
+		return n;
+
+	return n * scale + 0.5;
+}
+
+static void
+scale_ts(struct timespec *ts, double scale)
+{
+	if (!is_sampling_enabled())
+		return;
+
+	const double t = ts_float(ts) * scale;
+
+	ts->tv_sec = t;
+	ts->tv_nsec = (t - ts->tv_sec) * 1e9;
+}
+
+static void
+print_json_counts(FILE *outf, const struct call_counts *cc,
+		  const char *name, double percent, double scale)
+{
+	const unsigned int centipercent = percent * 100 + 0.5;
+
+	fputc('{', outf);
+	for (size_t i = 0; i < ARRAY_SIZE(columns) && columns[i]; ++i) {
+		const size_t c = columns[i];
+
+		if (i)
+			fputc(',', outf);
+		fprintf(outf, "\"%s\":", column_keys[c]);
+
+		switch (c) {
+		case CSC_TIME_100S:
+			fprintf(outf, "%u.%02u",
+				centipercent / 100, centipercent % 100);
+			break;
+		case CSC_TIME_TOTAL: {
+			struct timespec ts = cc->time;
+
+			scale_ts(&ts, scale);
+			print_json_ts(outf, &ts);
+			break;
+		}
+		case CSC_TIME_MIN:
+			print_json_ts(outf, &cc->time_min);
+			break;
+		case CSC_TIME_MAX:
+			print_json_ts(outf, &cc->time_max);
+			break;
+		case CSC_TIME_AVG:
+			print_json_ts(outf, &cc->time_avg);
+			break;
+		case CSC_TIME_P50:
+		case CSC_TIME_P90:
+		case CSC_TIME_P99:
+		case CSC_TIME_P999:
+			print_json_ts(outf, &cc->time_pct[c - CSC_TIME_P50]);
+			break;
+		case CSC_CALLS:
+			fprintf(outf, "%" PRIu64,
+				scale_count(cc->calls, scale));
+			break;
+		case CSC_ERRORS:
+			fprintf(outf, "%" PRIu64,
+				scale_count(cc->errors, scale));
+			break;
+		case CSC_SC_NAME:
+			fprintf(outf, "\"%s\"", name);
+			break;
+		}
+	}
+	fputc('}', outf);
+}
+
 static void
 call_summary_pers(FILE *outf)
 {
@@ -308,13 +732,19 @@ call_summary_pers(FILE *outf)
 	const struct timespec *tv_avg_max = &zero_ts;
 	uint64_t call_cum = 0;
 	uint64_t error_cum = 0;
+	uint64_t *hist_cum = NULL;
+	struct timespec tv_pct_cum[PCT_CNT] = { { 0 } };
 
 	double float_tv_cum;
 	double percent;
+	const double scale = sample_scale();
 
 	size_t sc_name_max = 0;
 
 
+	if (count_percentiles)
+		hist_cum = xcalloc(HIST_BUCKETS, sizeof(*hist_cum));
+
 	/* sort, calculate statistics */
 	indices = xcalloc(nsyscalls, sizeof(indices[0]));
 	for (size_t i = 0; i < nsyscalls; ++i) {
@@ -332,13 +762,70 @@ call_summary_pers(FILE *outf)
 		ts_div(&counts[i].time_avg, &counts[i].time, counts[i].calls);
 		tv_avg_max = ts_max(tv_avg_max, &counts[i].time_avg);
 
+		if (counts[i].hist) {
+			for (size_t j = 0; j < PCT_CNT; ++j)
+				hist_percentile(&counts[i].time_pct[j],
+						counts[i].hist, counts[i].calls,
+						pct_permille[j],
+						&counts[i].time_min,
+						&counts[i].time_max);
+			for (size_t j = 0; j < HIST_BUCKETS; ++j)
+				hist_cum[j] += counts[i].hist[j];
+		}
+
 		sc_name_max = MAX(sc_name_max, strlen(sysent[i].sys_name));
 	}
 	float_tv_cum = ts_float(&tv_cum);
 
+	if (hist_cum) {
+		if (call_cum) {
+			for (size_t j = 0; j < PCT_CNT; ++j)
+				hist_percentile(&tv_pct_cum[j], hist_cum,
+						call_cum, pct_permille[j],
+						tv_min, tv_max);
+		}
+		free(hist_cum);
+	}
+
 	if (sortfun)
 		qsort((void *) indices, nsyscalls, sizeof(indices[0]), sortfun);
 
+	if (summary_format == SUMMARY_FORMAT_JSON) {
+		struct call_counts total = {
+			.time = tv_cum,
+			.time_min = *tv_min,
+			.time_max = *tv_max,
+			.calls = call_cum,
+			.errors = error_cum,
+		};
+		memcpy(total.time_pct, tv_pct_cum, sizeof(total.time_pct));
+		if (call_cum)
+			ts_div(&total.time_avg, &tv_cum, call_cum);
+
+		fputs("\"syscalls\":[", outf);
+		for (size_t j = 0, n = 0; j < nsyscalls; ++j) {
+			const unsigned int idx = indices[j];
+			const struct call_counts *cc = &counts[idx];
+
+			if (cc->calls == 0)
+				continue;
+
+			double percent = 100.0 * ts_float(&cc->time);
+			if (percent != 0.0)
+				percent /= float_tv_cum;
+
+			if (n++)
+				fputc(',', outf);
+			print_json_counts(outf, cc, sysent[idx].sys_name,
+					  percent, scale);
+		}
+		fputs("],\"total\":", outf);
+		print_json_counts(outf, &total, "total", 100.0, scale);
+
+		free(indices);
+		return;
+	}
+
 	enum column_flags {
 		CF_L = 1 << 0, /* Left-aligned column */
 	};
@@ -352,6 +839,10 @@ call_summary_pers(FILE *outf)
 		[CSC_TIME_100S]  = { ARRSZ_PAIR("% time") - 1,   "%1$*2$.2f" },
 		[CSC_TIME_MIN]   = { ARRSZ_PAIR("shortest") - 1, "%1$*2$.6f" },
 		[CSC_TIME_MAX]   = { ARRSZ_PAIR("longest") - 1,  "%1$*2$.6f" },
+		[CSC_TIME_P50]   = { ARRSZ_PAIR("p50") - 1,      "%1$*2$.6f" },
+		[CSC_TIME_P90]   = { ARRSZ_PAIR("p90") - 1,      "%1$*2$.6f" },
+		[CSC_TIME_P99]   = { ARRSZ_PAIR("p99") - 1,      "%1$*2$.6f" },
+		[CSC_TIME_P999]  = { ARRSZ_PAIR("p99.9") - 1,    "%1$*2$.6f" },
 		/* Historical field sizes are preserved */
 		[CSC_TIME_TOTAL] = { "seconds",    11, "%1$*2$.6f" },
 		[CSC_TIME_AVG]   = { "usecs/call", 11, "%1$*2$" PRIu64 },
@@ -364,16 +855,26 @@ call_summary_pers(FILE *outf)
 #define W_(c_, v_) [c_] = MAX(cdesc[c_].sz, (v_))
 	unsigned int cwidths[CSC_MAX] = {
 		W_(CSC_TIME_100S,  sizeof("100.00") - 1),
-		W_(CSC_TIME_TOTAL, num_chars("%.6f", float_tv_cum)),
+		W_(CSC_TIME_TOTAL, num_chars("%.6f", float_tv_cum * scale)),
 		W_(CSC_TIME_MIN,   num_chars("%" PRId64 ".000000",
 					     (int64_t) tv_min_max->tv_sec)),
 		W_(CSC_TIME_MAX,   num_chars("%" PRId64 ".000000",
 					     (int64_t) tv_max->tv_sec)),
+		W_(CSC_TIME_P50,   num_chars("%" PRId64 ".000000",
+					     (int64_t) tv_max->tv_sec)),
+		W_(CSC_TIME_P90,   num_chars("%" PRId64 ".000000",
+					     (int64_t) tv_max->tv_sec)),
+		W_(CSC_TIME_P99,   num_chars("%" PRId64 ".000000",
+					     (int64_t) tv_max->tv_sec)),
+		W_(CSC_TIME_P999,  num_chars("%" PRId64 ".000000",
+					     (int64_t) tv_max->tv_sec)),
 		W_(CSC_TIME_AVG,   num_chars("%" PRId64 ,
 					     (uint64_t) (ts_float(tv_avg_max)
 							 * 1e6))),
-		W_(CSC_CALLS,      num_chars("%" PRIu64, call_cum)),
-		W_(CSC_ERRORS,     num_chars("%" PRIu64, error_cum)),
+		W_(CSC_CALLS,      num_chars("%" PRIu64,
+					     scale_count(call_cum, scale))),
+		W_(CSC_ERRORS,     num_chars("%" PRIu64,
+					     scale_count(error_cum, scale))),
 		W_(CSC_SC_NAME,    sc_name_max + 1),
 	};
 #undef W_
@@ -424,6 +925,10 @@ call_summary_pers(FILE *outf)
 		FC_(CSC_TIME_MIN);
 		FC_(CSC_TIME_MAX);
 		FC_(CSC_TIME_AVG);
+		FC_(CSC_TIME_P50);
+		FC_(CSC_TIME_P90);
+		FC_(CSC_TIME_P99);
+		FC_(CSC_TIME_P999);
 		FC_(CSC_CALLS);
 		FC_(CSC_ERRORS);
 		FC_(CSC_SC_NAME);
@@ -452,13 +957,17 @@ call_summary_pers(FILE *outf)
 
 			switch (c) {
 			PC_(CSC_TIME_100S,  percent);
-			PC_(CSC_TIME_TOTAL, float_syscall_time);
+			PC_(CSC_TIME_TOTAL, float_syscall_time * scale);
 			PC_(CSC_TIME_MIN,   ts_float(&cc->time_min));
 			PC_(CSC_TIME_MAX,   ts_float(&cc->time_max));
 			PC_(CSC_TIME_AVG,
 			    (uint64_t) (ts_float(&cc->time_avg) * 1e6));
-			PC_(CSC_CALLS,      cc->calls);
-			PC_(CSC_ERRORS,     cc->errors);
+			PC_(CSC_TIME_P50,   ts_float(&cc->time_pct[0]));
+			PC_(CSC_TIME_P90,   ts_float(&cc->time_pct[1]));
+			PC_(CSC_TIME_P99,   ts_float(&cc->time_pct[2]));
+			PC_(CSC_TIME_P999,  ts_float(&cc->time_pct[3]));
+			PC_(CSC_CALLS,      scale_count(cc->calls, scale));
+			PC_(CSC_ERRORS,     scale_count(cc->errors, scale));
 			PC_(CSC_SC_NAME,    sysent[idx].sys_name);
 			}
 		}
@@ -486,12 +995,16 @@ call_summary_pers(FILE *outf)
 
 		switch (c) {
 		PC_(CSC_TIME_100S, 100.0);
-		PC_(CSC_TIME_TOTAL, float_tv_cum);
+		PC_(CSC_TIME_TOTAL, float_tv_cum * scale);
 		PC_(CSC_TIME_MIN, ts_float(tv_min));
 		PC_(CSC_TIME_MAX, ts_float(tv_max));
 		PC_(CSC_TIME_AVG, (uint64_t) (float_tv_cum / call_cum * 1e6));
-		PC_(CSC_CALLS, call_cum);
-		PC_(CSC_ERRORS, error_cum);
+		PC_(CSC_TIME_P50, ts_float(&tv_pct_cum[0]));
+		PC_(CSC_TIME_P90, ts_float(&tv_pct_cum[1]));
+		PC_(CSC_TIME_P99, ts_float(&tv_pct_cum[2]));
+		PC_(CSC_TIME_P999, ts_float(&tv_pct_cum[3]));
+		PC_(CSC_CALLS, scale_count(call_cum, scale));
+		PC_(CSC_ERRORS, scale_count(error_cum, scale));
 		PC_(CSC_SC_NAME, "total");
 		}
 	}
@@ -501,17 +1014,46 @@ call_summary_pers(FILE *outf)
 #undef FC_
 }
 
-void
-call_summary(FILE *outf)
+static void
+print_summaries(FILE *outf, const struct timespec *begin,
+		const struct timespec *end)
 {
 	const unsigned int old_pers = current_personality;
+	struct timespec ts_begin, ts_end;
+	bool header_printed = false;
+
+	ts_sub(&ts_begin, begin, &summary_start_ts);
+	ts_sub(&ts_end, end, &summary_start_ts);
 
 	for (unsigned int i = 0; i < SUPPORTED_PERSONALITIES; ++i) {
-		if (!countv[i])
+		if (!countv[i] || !has_calls(countv[i]))
 			continue;
 
 		if (current_personality != i)
 			set_personality(i);
+
+		if (summary_format == SUMMARY_FORMAT_JSON) {
+			fputs("{\"begin\":", outf);
+			print_json_ts(outf, &ts_begin);
+			fputs(",\"end\":", outf);
+			print_json_ts(outf, &ts_end);
+			fprintf(outf, ",\"personality\":\"%s\",",
+				personality_names[i]);
+			call_summary_pers(outf);
+			fputs("}\n", outf);
+			continue;
+		}
+
+		if (ts_nz(&summary_interval) && !header_printed) {
+			fprintf(outf,
+				"System call usage summary for %lld.%06ld"
+				"-%lld.%06ld seconds:\n",
+				(long long) ts_begin.tv_sec,
+				(long) ts_begin.tv_nsec / 1000,
+				(long long) ts_end.tv_sec,
+				(long) ts_end.tv_nsec / 1000);
+			header_printed = true;
+		}
 		if (i)
 			fprintf(outf,
 				"System call usage summary for %s mode:\n",
@@ -522,3 +1064,57 @@ call_summary(FILE *outf)
 	if (old_pers != current_personality)
 		set_personality(old_pers);
 }
+
+void
+interval_summary(FILE *outf)
+{
+	struct timespec ts_now;
+	clock_gettime(CLOCK_MONOTONIC, &ts_now);
+
+	print_summaries(outf, &interval_start_ts, &ts_now);
+	fflush(outf);
+
+	for (unsigned int i = 0; i < SUPPORTED_PERSONALITIES; ++i) {
+		if (!countv[i])
+			continue;
+
+		if (!totalv[i])
+			totalv[i] = alloc_counts();
+		merge_counts(totalv[i], countv[i]);
+		reset_counts(countv[i]);
+	}
+
+	interval_start_ts = ts_now;
+}
+
+void
+call_summary(FILE *outf)
+{
+	struct timespec ts_now;
+	clock_gettime(CLOCK_MONOTONIC, &ts_now);
+
+	if (!is_summary_timer_armed()) {
+		print_summaries(outf, &summary_start_ts, &ts_now);
+		return;
+	}
+
+	/*
+	 * Report the last interval, so that every call is reported
+	 * in exactly one interval, and then report the totals.
+	 */
+	print_summaries(outf, &interval_start_ts, &ts_now);
+
+	for (unsigned int i = 0; i < SUPPORTED_PERSONALITIES; ++i) {
+		if (!totalv[i])
+			continue;
+
+		if (countv[i]) {
+			merge_counts(totalv[i], countv[i]);
+			free_counts(countv[i]);
+		}
+		countv[i] = totalv[i];
+		totalv[i] = NULL;
+	}
+
+	print_summaries(outf, &summary_start_ts, &ts_now);
+}
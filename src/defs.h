@@ -72,6 +72,12 @@ extern char *stpcpy(char *dst, const char *src);
 # ifndef DEFAULT_ACOLUMN
 #  define DEFAULT_ACOLUMN	40	/* default alignment column for results */
 # endif
+# ifndef DEFAULT_UMOVE_CACHE_SIZE
+/* Default number of tracee memory pages cached by umove* functions.  */
+#  define DEFAULT_UMOVE_CACHE_SIZE	64
+# endif
+/* process_vm_readv cannot take more than IOV_MAX (1024) iovecs at once.  */
+# define MAX_UMOVE_CACHE_SIZE	1024
 # ifndef DEFAULT_STACK_TRACE_FRAME_LIMIT
 /* Default limit for the amount of frames obtained during syscall backtrace.  */
 #  define DEFAULT_STACK_TRACE_FRAME_LIMIT 256
@@ -280,6 +286,7 @@ struct tcb {
 	int curcol;		/* Output column for this process */
 	FILE *outf;		/* Output file for this process */
 	struct staged_output_data *staged_output_data;
+	struct flight_recorder_data *flight_recorder_data;
 
 	const char *auxstr;	/* Auxiliary info from syscall (see RVAL_STR) */
 	void *_priv_data;	/* Private data for syscall decoding functions */
@@ -293,7 +300,10 @@ struct tcb {
 	struct timespec ltime;	/* System time usage as of last syscall entry */
 	struct timespec atime;	/* System time right after attach */
 	struct timespec etime;	/* Syscall entry time (CLOCK_MONOTONIC) */
+	/* Syscall entry time (CLOCK_REALTIME) if its decoding is deferred */
+	struct timespec deferred_entry_ts;
 	struct timespec delay_expiration_time; /* When does the delay end */
+	size_t delay_heap_pos;	/* Position in the heap of delayed tcbs */
 
 	/*
 	 * The ID of the PID namespace of this process
@@ -307,6 +317,14 @@ struct tcb {
 # endif
 
 	struct mmap_cache_t *mmap_cache;
+	/* Generation of mmap_cache seen by mmap_cache_rebuild_if_invalid.  */
+	unsigned int mmap_cache_generation;
+
+	/* Paths associated with descriptors, see fd_path_cache.c.  */
+	struct fd_path_cache *fd_path_cache;
+
+	/* Generation of the tracee memory pages cached by umove* functions.  */
+	uint64_t umove_cache_gen;
 
 	/*
 	 * Data that is stored during process wait traversal.
@@ -371,6 +389,12 @@ struct tcb {
 # define TCB_SECCOMP_FILTER		0x40000	/* This process has a seccomp filter
 						 * attached.
 						 */
+# define TCB_DEFERRED_ENTRY		0x80000	/* The syscall entry is to be
+						 * decoded on syscall exit.
+						 */
+# define TCB_UNSAMPLED			0x100000 /* Restarted with PTRACE_CONT
+						  * outside of syscalls.
+						  */
 
 /* qualifier flags */
 # define QUAL_TRACE	0x001	/* this system call should be traced */
@@ -551,6 +575,10 @@ enum xflag_opts {
 extern unsigned xflag;
 extern bool followfork;
 extern bool output_separately;
+/* Whether syscall output is staged until the syscall status is known */
+extern bool stage_syscall_output;
+/* Whether decoding of syscall entries can be deferred until syscall exit */
+extern bool defer_entry_decoding;
 enum stack_trace_modes {
 	STACK_TRACE_OFF,
 	STACK_TRACE_ON,
@@ -563,6 +591,8 @@ extern enum stack_trace_modes stack_trace_mode;
 #  define stack_trace_mode STACK_TRACE_OFF
 # endif
 extern unsigned max_strlen;
+extern unsigned int umove_cache_size;
+extern unsigned int flight_recorder_size;
 extern unsigned os_release;
 # undef KERNEL_VERSION
 # define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
@@ -572,6 +602,11 @@ extern int read_int_from_file(const char *, int *);
 extern void set_sortby(const char *);
 extern int set_overhead(const char *);
 extern void set_count_summary_columns(const char *columns);
+extern int set_summary_interval(const char *);
+extern int set_summary_format(const char *);
+extern void start_summary_timer(void);
+extern bool is_summary_timer_armed(void);
+extern bool summary_timer_expired(void);
 
 extern bool get_instruction_pointer(struct tcb *, kernel_ulong_t *);
 extern bool get_stack_pointer(struct tcb *, kernel_ulong_t *);
@@ -590,6 +625,7 @@ extern int syscall_exiting_trace(struct tcb *, struct timespec *, int);
 extern void syscall_exiting_finish(struct tcb *);
 
 extern void count_syscall(struct tcb *, const struct timespec *);
+extern void interval_summary(FILE *);
 extern void call_summary(FILE *);
 
 extern void clear_regs(struct tcb *tcp);
@@ -804,8 +840,38 @@ umoven_or_printaddr_ignore_syserror(struct tcb *tcp, const kernel_ulong_t addr,
 extern int
 umovestr(struct tcb *, kernel_ulong_t addr, unsigned int len, char *laddr);
 
-/* Invalidate the cache used by umove* functions.  */
-extern void invalidate_umove_cache(void);
+/** A tracee memory range to be fetched by umovev.  */
+struct umove_iov {
+	kernel_ulong_t addr;
+	unsigned int len;
+	void *laddr;
+};
+
+/**
+ * Fetch several tracee memory ranges at once.
+ *
+ * @return the number of leading entries of vec that were fetched in full;
+ *         the caller is expected to fall back to umoven for the rest.
+ */
+extern unsigned int
+umovev(struct tcb *, const struct umove_iov *vec, unsigned int cnt);
+
+/**
+ * Populate the cache used by umove* functions with the given range
+ * in advance, so that subsequent fetches from it do not need
+ * to access the tracee memory one page at a time.  Errors are ignored.
+ */
+extern void
+umove_prefetch(struct tcb *, kernel_ulong_t addr, unsigned int len);
+
+/* Invalidate the cache used by umove* functions for the given tcb.  */
+extern void invalidate_umove_cache(struct tcb *);
+/**
+ * @return true if the cache used by umove* functions could be kept
+ *         at the exit of the current syscall of the given tcb.
+ */
+extern bool syscall_keeps_umove_cache(const struct tcb *);
+extern void print_umove_cache_stats(void);
 
 extern int upeek(struct tcb *tcp, unsigned long, kernel_ulong_t *);
 extern int upoke(struct tcb *tcp, unsigned long, kernel_ulong_t);
@@ -820,6 +886,7 @@ extern const char *sprintsigname(const int);
 extern void pathtrace_select_set(const char *, struct path_set *);
 extern bool pathtrace_match_set(struct tcb *, struct path_set *,
 				struct number_set *);
+extern int pathtrace_fd_args(const struct_sysent *);
 
 static inline void
 pathtrace_select(const char *path)
@@ -848,6 +915,7 @@ pathtrace_match(struct tcb *tcp)
 extern int get_proc_pid_fd_path(int proc_pid, int fd, char *buf,
 				unsigned bufsize, bool *deleted);
 
+extern struct tcb *pid2tcb(int pid);
 extern int getfdpath_pid(pid_t pid, int fd, char *buf, unsigned bufsize,
 			 bool *deleted);
 
@@ -857,6 +925,7 @@ getfdpath(struct tcb *tcp, int fd, char *buf, unsigned bufsize)
 	return getfdpath_pid(tcp->pid, fd, buf, bufsize, NULL);
 }
 
+extern unsigned long get_inode_of_socket_path(const char *);
 extern unsigned long getfdinode(struct tcb *, int);
 extern enum sock_proto getfdproto(struct tcb *, int);
 
@@ -1175,6 +1244,12 @@ fetch_indirect_syscall_args(struct tcb *, kernel_ulong_t addr, unsigned int n_ar
 
 extern void pidns_init(void);
 
+/**
+ * Notes a new tracee, so that it is indexed by its PIDs in all PID namespaces
+ * before /proc is scanned for a PID translation.
+ */
+extern void pidns_note_tracee(int pid);
+
 /**
  * Returns PID as present in /proc of the tracer (can be different from tracee
  * PID if /proc and the tracer process are in different PID namespaces).
@@ -1306,6 +1381,38 @@ extern size_t proc_status_get_id_list(int proc_pid,
 				      int *id_buf, size_t id_buf_size,
 				      const char *str, size_t str_size);
 
+/**
+ * Look up the data associated with the address space of a tracee.
+ *
+ * @param tcp     Tracee.
+ * @param proc_pid PID of the tracee in the PID namespace of /proc.
+ * @param find_fn Function that returns the data associated with a thread
+ *                group id, or NULL.
+ * @param tgid    Where the thread group id of the tracee is stored,
+ *                0 if it cannot be obtained.
+ * @return        The data associated with the thread group of the tracee,
+ *                or, if there is none and the tracee shares the address
+ *                space of its parent (e.g. after vfork), the data associated
+ *                with the parent; NULL otherwise.
+ */
+extern void *find_by_address_space(struct tcb *tcp, int proc_pid,
+				   void *(*find_fn)(int id), int *tgid);
+
+/**
+ * Look up the data associated with the descriptor table of a tracee,
+ * like find_by_address_space.
+ *
+ * @return        The data associated with the thread group of the tracee
+ *                if the tracee shares the descriptor table of the thread
+ *                group leader, or, if there is none and the tracee shares
+ *                the descriptor table of its parent (CLONE_FILES),
+ *                the data associated with the parent; NULL otherwise.
+ *                If the tracee does not share the descriptor table
+ *                of the thread group leader, 0 is stored in tgid.
+ */
+extern void *find_by_descriptor_table(struct tcb *tcp, int proc_pid,
+				      void *(*find_fn)(int id), int *tgid);
+
 /**
  * Print file descriptor fd owned by process with ID pid (from the PID NS
  * of the tracee).
@@ -1329,6 +1436,8 @@ decode_inet_addr(struct tcb *, kernel_ulong_t addr,
 extern void print_ax25_addr(const void /* ax25_address */ *addr);
 extern void print_x25_addr(const void /* struct x25_address */ *addr);
 extern const char *get_sockaddr_by_inode(struct tcb *, int fd, unsigned long inode);
+extern void socket_cache_syscall_enter(struct tcb *);
+extern void socket_cache_syscall_exit(struct tcb *);
 
 /**
  * Prints dirfd file descriptor and saves it in tcp->last_dirfd,
@@ -1441,6 +1550,8 @@ extern void qualify_fault(const char *);
 extern void qualify_inject(const char *);
 extern void qualify_kvm(const char *);
 extern void qualify_namespace(const char *);
+extern void qualify_trigger(const char *);
+extern unsigned int qual_flags_pers(const unsigned int, const unsigned int);
 extern unsigned int qual_flags(const unsigned int);
 
 # define DECL_IOCTL(name)						\
@@ -1585,10 +1696,11 @@ extern void print_ticks_d(int64_t val, long freq, unsigned int precision);
 extern void print_clock_t(uint64_t val);
 
 # ifdef ENABLE_STACKTRACE
-extern void unwind_init(bool, int);
+extern void unwind_init(bool, int, bool, const char *);
 extern void unwind_tcb_init(struct tcb *);
 extern void unwind_tcb_fin(struct tcb *);
 extern void unwind_tcb_print(struct tcb *);
+extern void unwind_tcb_print_deferred(struct tcb *);
 extern void unwind_tcb_capture(struct tcb *);
 # endif
 
@@ -1750,6 +1862,7 @@ extern void print_user_desc(struct tcb *, kernel_ulong_t addr,
  * strace -oLOG -f[f] -p "`pidof web_browser`"
  */
 extern struct tcb *printing_tcp;
+extern void get_event_real_time(struct timespec *);
 extern void printleader(struct tcb *);
 extern void line_ended(void);
 extern void tabto(void);
@@ -1764,6 +1877,21 @@ extern void tprints_comment(const char *str);
 extern FILE *strace_open_memstream(struct tcb *tcp);
 extern void strace_close_memstream(struct tcb *tcp, bool publish);
 
+/*
+ * Flight recorder: the output is kept in memory and written
+ * only when a trigger fires.
+ */
+extern void flight_recorder_open(struct tcb *tcp);
+extern FILE *flight_recorder_close(struct tcb *tcp);
+/* Release the flight recorder shared by the tcbs, if any.  */
+extern void flight_recorder_close_shared(void);
+extern void flight_recorder_commit(const struct tcb *tcp);
+extern void flight_recorder_flush(const struct tcb *tcp);
+extern void flight_recorder_flush_all(void);
+extern bool has_flight_recorder_triggers(void);
+extern const char *get_untraced_flight_recorder_trigger(void);
+extern bool is_flight_recorder_trigger(struct tcb *tcp);
+
 static inline void
 printaddr_comment(const kernel_ulong_t addr)
 {
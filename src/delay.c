@@ -20,6 +20,14 @@ static size_t delay_data_vec_size;     /* size of the used arena */
 static timer_t delay_timer = (timer_t) -1;
 static bool delay_timer_is_armed;
 
+/*
+ * Binary min-heap of delayed tcbs ordered by delay_expiration_time,
+ * the delay timer is armed for the expiration time of its head.
+ */
+static struct tcb **delay_heap;
+static size_t delay_heap_capacity;
+static size_t delay_heap_size;
+
 static void
 expand_delay_data_vec(void)
 {
@@ -97,6 +105,103 @@ arm_delay_timer(const struct tcb *const tcp)
 		       tcp->pid);
 }
 
+static bool
+delay_heap_less(const size_t a, const size_t b)
+{
+	return ts_cmp(&delay_heap[a]->delay_expiration_time,
+		      &delay_heap[b]->delay_expiration_time) < 0;
+}
+
+static void
+delay_heap_set(const size_t pos, struct tcb *const tcp)
+{
+	delay_heap[pos] = tcp;
+	tcp->delay_heap_pos = pos;
+}
+
+static void
+delay_heap_swap(const size_t a, const size_t b)
+{
+	struct tcb *const tcp = delay_heap[a];
+
+	delay_heap_set(a, delay_heap[b]);
+	delay_heap_set(b, tcp);
+}
+
+static void
+delay_heap_sift_up(size_t pos)
+{
+	while (pos > 0) {
+		const size_t parent = (pos - 1) / 2;
+
+		if (!delay_heap_less(pos, parent))
+			break;
+		delay_heap_swap(pos, parent);
+		pos = parent;
+	}
+}
+
+static void
+delay_heap_sift_down(size_t pos)
+{
+	for (;;) {
+		const size_t left = 2 * pos + 1;
+		const size_t right = left + 1;
+		size_t min = pos;
+
+		if (left < delay_heap_size && delay_heap_less(left, min))
+			min = left;
+		if (right < delay_heap_size && delay_heap_less(right, min))
+			min = right;
+		if (min == pos)
+			break;
+		delay_heap_swap(pos, min);
+		pos = min;
+	}
+}
+
+static void
+delay_heap_push(struct tcb *const tcp)
+{
+	if (delay_heap_size == delay_heap_capacity)
+		delay_heap = xgrowarray(delay_heap, &delay_heap_capacity,
+					sizeof(*delay_heap));
+
+	delay_heap_set(delay_heap_size, tcp);
+	delay_heap_sift_up(delay_heap_size++);
+}
+
+static void
+delay_heap_remove(struct tcb *const tcp)
+{
+	const size_t pos = tcp->delay_heap_pos;
+
+	if (pos >= delay_heap_size || delay_heap[pos] != tcp)
+		error_func_msg_and_die("pid %d is not in the heap", tcp->pid);
+
+	if (pos != --delay_heap_size) {
+		delay_heap_set(pos, delay_heap[delay_heap_size]);
+		delay_heap_sift_up(pos);
+		delay_heap_sift_down(delay_heap[pos]->delay_heap_pos);
+	}
+}
+
+struct tcb *
+next_delayed_tcb(void)
+{
+	return delay_heap_size ? delay_heap[0] : NULL;
+}
+
+void
+undelay_tcb(struct tcb *tcp)
+{
+	if (!syscall_delayed(tcp))
+		return;
+
+	delay_heap_remove(tcp);
+	tcp->flags &= ~TCB_DELAYED;
+}
+
 void
 delay_tcb(struct tcb *tcp, uint16_t delay_idx, bool isenter)
 {
@@ -105,6 +210,7 @@ delay_tcb(struct tcb *tcp, uint16_t delay_idx, bool isenter)
 
 	debug_func_msg("delaying pid %d on %s",
 		       tcp->pid, isenter ? "enter" : "exit");
+	undelay_tcb(tcp);
 	tcp->flags |= TCB_DELAYED;
 	tcp->flags |= TCB_TAMPERED_DELAYED;
 
@@ -118,18 +224,14 @@ delay_tcb(struct tcb *tcp, uint16_t delay_idx, bool isenter)
 	clock_gettime(CLOCK_MONOTONIC, &ts_now);
 	ts_add(&tcp->delay_expiration_time, &ts_now, ts_diff);
 
-	if (is_delay_timer_created()) {
-		struct itimerspec its;
-		if (timer_gettime(delay_timer, &its))
-			perror_msg_and_die("timer_gettime");
-
-		const struct timespec *const ts_old = &its.it_value;
-		if (ts_nz(ts_old) && ts_cmp(ts_diff, ts_old) > 0)
-			return;
-	} else {
+	if (!is_delay_timer_created()) {
 		if (timer_create(CLOCK_MONOTONIC, NULL, &delay_timer))
 			perror_msg_and_die("timer_create");
 	}
 
-	arm_delay_timer(tcp);
+	delay_heap_push(tcp);
+
+	/* Re-arm the timer only if this tcb is the first to expire now.  */
+	if (next_delayed_tcb() == tcp)
+		arm_delay_timer(tcp);
 }
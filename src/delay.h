@@ -14,5 +14,7 @@ bool is_delay_timer_armed(void);
 void delay_timer_expired(void);
 void arm_delay_timer(const struct tcb *);
 void delay_tcb(struct tcb *, uint16_t delay_idx, bool isenter);
+void undelay_tcb(struct tcb *);
+struct tcb *next_delayed_tcb(void);
 
 #endif /* !STRACE_DELAY_H */
@@ -0,0 +1,332 @@
+/*
+ * Cache of paths associated with tracee descriptors.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "defs.h"
+#include "fd_path_cache.h"
+#include "filter_seccomp.h"
+#include "sample.h"
+#include "sen.h"
+#include <linux/sched.h>
+
+/*
+ * Descriptor tables can be shared between tracees, so instead of
+ * invalidating the cache entries of every tracee when a descriptor
+ * is closed, the generation of the descriptor number is incremented,
+ * which invalidates the cache entries of that descriptor number
+ * in all tracees at once.
+ */
+static uint32_t *fd_gens;
+static size_t fd_gens_size;
+
+/* Descriptors with greater numbers are not cached.  */
+#define FD_PATH_CACHE_MAX_FD	65535
+
+struct fd_path_entry {
+	/* fd_gens[fd] + 1 at the time of caching, 0 if the entry is empty */
+	uint32_t gen;
+	char path[28];
+};
+
+/*
+ * The cache is shared by the tracees that have the same descriptor table:
+ * threads of a process and children created with CLONE_FILES.
+ */
+struct fd_path_cache {
+	struct fd_path_cache *next;
+	unsigned int refcount;
+	/* Thread group id in the PID namespace of /proc, 0 if not findable */
+	int tgid;
+	struct fd_path_entry *entries;
+	size_t size;
+};
+
+static struct fd_path_cache *fd_path_caches;
+
+/*
+ * The cache can be used only if every change of the descriptor tables
+ * is seen: all threads and children of tracees are traced, and neither
+ * seccomp filter nor --sample-window hide syscalls that close descriptors.
+ */
+static bool
+fd_path_cache_enabled(void)
+{
+	return followfork && !seccomp_filtering && !is_sampling_enabled();
+}
+
+static uint32_t
+fd_gen(int fd)
+{
+	return (size_t) fd < fd_gens_size ? fd_gens[fd] : 0;
+}
+
+static void *
+find_fd_path_cache(int tgid)
+{
+	for (struct fd_path_cache *cache = fd_path_caches; cache;
+	     cache = cache->next) {
+		if (cache->tgid == tgid)
+			return cache;
+	}
+
+	return NULL;
+}
+
+/*
+ * Returns the cache of the descriptor table of the tracee, creating it
+ * if the descriptor table has none.
+ */
+static struct fd_path_cache *
+get_fd_path_cache(struct tcb *tcp)
+{
+	if (tcp->fd_path_cache)
+		return tcp->fd_path_cache;
+
+	int proc_pid = get_proc_pid(tcp->pid);
+	int tgid = 0;
+	struct fd_path_cache *cache = proc_pid ?
+		find_by_descriptor_table(tcp, proc_pid,
+					 find_fd_path_cache, &tgid) : NULL;
+
+	if (!cache) {
+		cache = xzalloc(sizeof(*cache));
+		cache->tgid = tgid;
+		cache->next = fd_path_caches;
+		fd_path_caches = cache;
+	}
+
+	cache->refcount++;
+	return tcp->fd_path_cache = cache;
+}
+
+int
+fd_path_cache_lookup(pid_t pid, int fd, char *buf, unsigned int bufsize)
+{
+	if (!fd_path_cache_enabled())
+		return -1;
+
+	struct tcb *tcp = pid2tcb(pid);
+	if (!tcp)
+		return -1;
+
+	const struct fd_path_cache *cache = get_fd_path_cache(tcp);
+	if ((size_t) fd >= cache->size)
+		return -1;
+
+	const struct fd_path_entry *e = &cache->entries[fd];
+	if (e->gen != fd_gen(fd) + 1)
+		return -1;
+
+	size_t len = strnlen(e->path, sizeof(e->path));
+	if (len >= bufsize)
+		return -1;
+
+	memcpy(buf, e->path, len + 1);
+	return len;
+}
+
+void
+fd_path_cache_store(pid_t pid, int fd, const char *path, int len)
+{
+	if (!fd_path_cache_enabled())
+		return;
+
+	if (fd < 0 || fd > FD_PATH_CACHE_MAX_FD ||
+	    len <= 0 || (size_t) len >= sizeof_field(struct fd_path_entry, path) ||
+	    path[0] == '/')
+		return;
+
+	struct tcb *tcp = pid2tcb(pid);
+	if (!tcp)
+		return;
+
+	struct fd_path_cache *cache = get_fd_path_cache(tcp);
+	if ((size_t) fd >= cache->size) {
+		const size_t old_size = cache->size;
+
+		while ((size_t) fd >= cache->size)
+			cache->entries = xgrowarray(cache->entries,
+						    &cache->size,
+						    sizeof(*cache->entries));
+		memset(cache->entries + old_size, 0,
+		       (cache->size - old_size) * sizeof(*cache->entries));
+	}
+
+	/* Every cached descriptor number has its generation.  */
+	if ((size_t) fd >= fd_gens_size) {
+		const size_t old_size = fd_gens_size;
+
+		while ((size_t) fd >= fd_gens_size)
+			fd_gens = xgrowarray(fd_gens, &fd_gens_size,
+					     sizeof(*fd_gens));
+		memset(fd_gens + old_size, 0,
+		       (fd_gens_size - old_size) * sizeof(*fd_gens));
+	}
+
+	struct fd_path_entry *e = &cache->entries[fd];
+	e->gen = fd_gen(fd) + 1;
+	memcpy(e->path, path, len);
+	e->path[len] = '\0';
+}
+
+static void
+invalidate_fd_range(kernel_ulong_t first, kernel_ulong_t last)
+{
+	for (kernel_ulong_t fd = first; fd <= last && fd < fd_gens_size; ++fd)
+		++fd_gens[fd];
+}
+
+static void
+invalidate_fd(kernel_ulong_t fd)
+{
+	invalidate_fd_range(fd, fd);
+}
+
+static void
+invalidate_syscall_fds(struct tcb *tcp)
+{
+	switch (tcp_sysent(tcp)->sen) {
+	case SEN_close:
+		invalidate_fd(tcp->u_arg[0]);
+		break;
+	case SEN_dup2:
+	case SEN_dup3:
+		invalidate_fd(tcp->u_arg[1]);
+		break;
+	case SEN_close_range:
+		invalidate_fd_range(tcp->u_arg[0], tcp->u_arg[1]);
+		break;
+	case SEN_execve:
+	case SEN_execveat:
+		/*
+		 * Descriptors with FD_CLOEXEC flag are closed, and it is
+		 * not known which tracees share the descriptor table.
+		 */
+		invalidate_fd_range(0, fd_gens_size - 1);
+		break;
+	}
+}
+
+/*
+ * After execve and unshare(CLONE_FILES) the tracee has a descriptor table
+ * of its own, the cache of the old one stays with the other tracees.
+ */
+static void
+detach_fd_path_cache(struct tcb *tcp)
+{
+	struct fd_path_cache *cache = tcp->fd_path_cache;
+	if (!cache)
+		return;
+
+	if (cache->tgid == get_proc_pid(tcp->pid))
+		cache->tgid = 0;
+	fd_path_cache_free(tcp);
+}
+
+static void
+fill_fd(struct tcb *tcp, int fd)
+{
+	char path[sizeof_field(struct fd_path_entry, path)];
+
+	/* The path is stored in the cache by getfdpath.  */
+	getfdpath(tcp, fd, path, sizeof(path));
+}
+
+static void
+fill_fd_pair(struct tcb *tcp, kernel_ulong_t addr)
+{
+	int fds[2];
+
+	if (!umove(tcp, addr, &fds)) {
+		fill_fd(tcp, fds[0]);
+		fill_fd(tcp, fds[1]);
+	}
+}
+
+void
+fd_path_cache_syscall_enter(struct tcb *tcp)
+{
+	invalidate_syscall_fds(tcp);
+}
+
+void
+fd_path_cache_syscall_exit(struct tcb *tcp)
+{
+	invalidate_syscall_fds(tcp);
+
+	/*
+	 * This is done before the syscall result is fetched and even
+	 * if the syscall is filtered out; a failed syscall only costs
+	 * the tracee its share of the cache.
+	 */
+	switch (tcp_sysent(tcp)->sen) {
+	case SEN_execve:
+	case SEN_execveat:
+		detach_fd_path_cache(tcp);
+		break;
+	case SEN_unshare:
+		if (tcp->u_arg[0] & CLONE_FILES)
+			detach_fd_path_cache(tcp);
+		break;
+	}
+}
+
+void
+fd_path_cache_syscall_result(struct tcb *tcp)
+{
+	if (!fd_path_cache_enabled() || syserror(tcp))
+		return;
+
+	/* The paths are looked up only to be printed or matched.  */
+	if (number_set_array_is_empty(decode_fd_set, 0) && !tracing_paths)
+		return;
+
+	switch (tcp_sysent(tcp)->sen) {
+	case SEN_accept:
+	case SEN_accept4:
+	case SEN_socket:
+		fill_fd(tcp, tcp->u_rval);
+		break;
+	case SEN_pipe:
+#if HAVE_ARCH_GETRVAL2
+		fill_fd(tcp, tcp->u_rval);
+		fill_fd(tcp, getrval2(tcp));
+#else
+		fill_fd_pair(tcp, tcp->u_arg[0]);
+#endif
+		break;
+	case SEN_pipe2:
+		fill_fd_pair(tcp, tcp->u_arg[0]);
+		break;
+	case SEN_socketpair:
+		fill_fd_pair(tcp, tcp->u_arg[3]);
+		break;
+	}
+}
+
+void
+fd_path_cache_free(struct tcb *tcp)
+{
+	struct fd_path_cache *cache = tcp->fd_path_cache;
+	if (!cache)
+		return;
+
+	tcp->fd_path_cache = NULL;
+	if (--cache->refcount)
+		return;
+
+	for (struct fd_path_cache **p = &fd_path_caches; *p; p = &(*p)->next) {
+		if (*p == cache) {
+			*p = cache->next;
+			break;
+		}
+	}
+
+	free(cache->entries);
+	free(cache);
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef STRACE_FD_PATH_CACHE_H
+# define STRACE_FD_PATH_CACHE_H
+
+# include "defs.h"
+
+/*
+ * Look up the path associated with the descriptor fd of the tracee pid
+ * in the cache, copy it to buf and return its length.
+ * Return -1 if there is no such cache entry.
+ */
+extern int
+fd_path_cache_lookup(pid_t pid, int fd, char *buf, unsigned int bufsize);
+
+/*
+ * Store the path of length len obtained from /proc/pid/fd/fd in the cache.
+ * Only paths that cannot change during the lifetime of the descriptor
+ * (sockets, pipes, anonymous inodes) are stored.
+ */
+extern void
+fd_path_cache_store(pid_t pid, int fd, const char *path, int len);
+
+/*
+ * Invalidate the cache entries of descriptors closed by the syscall,
+ * and detach the tracee from the cache when it gets a descriptor table
+ * of its own.
+ * This is done on both syscall entry and exiting because another tracee
+ * sharing the descriptor table might reuse the descriptor number before
+ * the syscall exiting is seen.
+ */
+extern void
+fd_path_cache_syscall_enter(struct tcb *);
+extern void
+fd_path_cache_syscall_exit(struct tcb *);
+
+/*
+ * Fill the cache with the descriptors returned by the syscall
+ * (accept, pipe, socket, etc.) before they are printed.
+ */
+extern void
+fd_path_cache_syscall_result(struct tcb *);
+
+/* Drop the reference of the tracee to the cache of its descriptor table.  */
+extern void
+fd_path_cache_free(struct tcb *);
+
+#endif /* !STRACE_FD_PATH_CACHE_H */
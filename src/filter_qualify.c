@@ -12,6 +12,7 @@
 #include "filter.h"
 #include "delay.h"
 #include "poke.h"
+#include "record.h"
 #include "retval.h"
 #include "static_assert.h"
 #include "secontext.h"
@@ -34,6 +35,16 @@ static struct number_set *inject_set;
 static struct number_set *raw_set;
 static struct number_set *verbose_set;
 
+/* Failures of the syscalls that flush the flight recorder.  */
+struct flight_recorder_trigger {
+	struct number_set *syscall_set;
+	unsigned int error;	/* 0 means any error */
+};
+
+static struct flight_recorder_trigger *triggers;
+static size_t triggers_cnt;
+static size_t triggers_size;
+
 /* Only syscall numbers are personality-specific so far.  */
 struct inject_personality_data {
 	uint16_t scno;
@@ -671,6 +682,89 @@ qualify_secontext(const char *const str)
 #endif
 }
 
+void
+qualify_trigger(const char *const str)
+{
+	struct flight_recorder_trigger trigger = { .error = 0 };
+	char *copy = xstrdup(str);
+	char *saveptr = NULL;
+	const char *name = str[0] == ':' ? NULL
+			   : strtok_r(copy, ":", &saveptr);
+
+	if (!name)
+		error_msg_and_die("invalid %s '%s'", "trigger", str);
+
+	char *token;
+	while ((token = strtok_r(NULL, ":", &saveptr))) {
+		const char *val = STR_STRIP_PREFIX(token, "error=");
+		int intval;
+
+		if (val == token || trigger.error)
+			error_msg_and_die("invalid %s '%s'", "trigger", str);
+		intval = string_to_uint_upto(val, MAX_ERRNO_VALUE);
+		if (intval < 0)
+			intval = find_errno_by_name(val);
+		if (intval < 1)
+			error_msg_and_die("invalid %s '%s'", "trigger", str);
+		trigger.error = intval;
+	}
+
+	trigger.syscall_set = alloc_number_set_array(SUPPORTED_PERSONALITIES);
+	qualify_syscall_tokens(name, trigger.syscall_set);
+
+	free(copy);
+
+	if (triggers_cnt >= triggers_size)
+		triggers = xgrowarray(triggers, &triggers_size,
+				      sizeof(*triggers));
+	triggers[triggers_cnt++] = trigger;
+}
+
+bool
+has_flight_recorder_triggers(void)
+{
+	return triggers_cnt > 0;
+}
+
+/*
+ * Returns the name of a trigger syscall that is not traced, if any:
+ * the failures of such syscalls are not seen.
+ */
+const char *
+get_untraced_flight_recorder_trigger(void)
+{
+	for (size_t i = 0; i < triggers_cnt; ++i) {
+		for (unsigned int p = 0; p < SUPPORTED_PERSONALITIES; ++p) {
+			for (unsigned int scno = 0; scno < nsyscall_vec[p];
+			     ++scno) {
+				if (is_number_in_set_array(scno,
+						triggers[i].syscall_set, p) &&
+				    !is_number_in_set_array(scno, trace_set, p))
+					return sysent_vec[p][scno].sys_name;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+bool
+is_flight_recorder_trigger(struct tcb *tcp)
+{
+	if (!syserror(tcp))
+		return false;
+
+	for (size_t i = 0; i < triggers_cnt; ++i) {
+		if ((!triggers[i].error || triggers[i].error == tcp->u_error)
+		    && is_number_in_set_array(tcp->scno,
+					      triggers[i].syscall_set,
+					      current_personality))
+			return true;
+	}
+
+	return false;
+}
+
 static const struct qual_options {
 	const char *name;
 	void (*qualify)(const char *);
@@ -710,6 +804,7 @@ static const struct qual_options {
 	{ "decode-pids", qualify_decode_pid },
 	{ "secontext",  qualify_secontext },
 	{ "namespace",  qualify_namespace },
+	{ "trigger",	qualify_trigger },
 };
 
 void
@@ -733,16 +828,25 @@ qualify(const char *str)
 }
 
 unsigned int
-qual_flags(const unsigned int scno)
+qual_flags_pers(const unsigned int scno, const unsigned int pers)
 {
-	return	(is_number_in_set_array(scno, trace_set, current_personality)
+	return	(is_number_in_set_array(scno, trace_set, pers)
 		   ? QUAL_TRACE : 0)
-		| (is_number_in_set_array(scno, abbrev_set, current_personality)
+		| (is_number_in_set_array(scno, abbrev_set, pers)
 		   ? QUAL_ABBREV : 0)
-		| (is_number_in_set_array(scno, verbose_set, current_personality)
+		| (is_number_in_set_array(scno, verbose_set, pers)
 		   ? QUAL_VERBOSE : 0)
-		| (is_number_in_set_array(scno, raw_set, current_personality)
+		| (is_number_in_set_array(scno, raw_set, pers)
 		   ? QUAL_RAW : 0)
-		| (is_number_in_set_array(scno, inject_set, current_personality)
+		| (is_number_in_set_array(scno, inject_set, pers)
 		   ? QUAL_INJECT : 0);
 }
+
+unsigned int
+qual_flags(const unsigned int scno)
+{
+	const unsigned int flags = qual_flags_pers(scno, current_personality);
+
+	return replaying
+	       ? replay_qual_flags(scno, current_personality, flags) : flags;
+}
@@ -1,7 +1,7 @@
 /*
  * Copyright (c) 2018 Chen Jingpiao <chenjingpiao@gmail.com>
  * Copyright (c) 2019 Paul Chaignon <paul.chaignon@gmail.com>
- * Copyright (c) 2018-2023 The strace developers.
+ * Copyright (c) 2018-2026 The strace developers.
  * All rights reserved.
  *
  * SPDX-License-Identifier: LGPL-2.1-or-later
@@ -16,11 +16,14 @@
 #include <linux/filter.h>
 
 #include "filter_seccomp.h"
+#include "largefile_wrappers.h"
 #include "number_set.h"
 #include "scno.h"
+#include "string_to_uint.h"
 
 bool seccomp_filtering;
 bool seccomp_before_sysentry;
+const char *seccomp_bpf_profile;
 
 #include <linux/seccomp.h>
 
@@ -31,6 +34,7 @@ bool seccomp_before_sysentry;
 #define JMP_PLACEHOLDER_NEXT  ((unsigned char) -1)
 #define JMP_PLACEHOLDER_TRACE ((unsigned char) -2)
 #define JMP_PLACEHOLDER_ALLOW ((unsigned char) -3)
+#define JMP_PLACEHOLDER_CHECK(i) ((unsigned char) (-4 - (i)))
 
 #define SET_BPF(filter, code, jt, jf, k) \
 	(*(filter) = (struct sock_filter) { code, jt, jf, k })
@@ -47,9 +51,12 @@ static unsigned short linear_filter_generator(struct sock_filter *,
 					      bool *overflow);
 static unsigned short binary_match_filter_generator(struct sock_filter *,
 						    bool *overflow);
+static unsigned short weighted_tree_filter_generator(struct sock_filter *,
+						     bool *overflow);
 static filter_generator_t filter_generators[] = {
 	linear_filter_generator,
 	binary_match_filter_generator,
+	weighted_tree_filter_generator,
 };
 
 /*
@@ -62,6 +69,35 @@ static struct sock_fprog bpf_prog = {
 	.len = USHRT_MAX,
 	.filter = NULL,
 };
+/* Expected number of BPF instructions executed per syscall.  */
+static double bpf_prog_cost;
+
+/*
+ * Expected frequencies of syscalls, loaded from seccomp_bpf_profile.
+ * When no profile is given, all syscalls are considered equally frequent.
+ */
+static uint64_t *syscall_weights[SUPPORTED_PERSONALITIES];
+
+/*
+ * When file descriptors are traced and paths are not, syscalls that
+ * take descriptors as arguments are matched by the filter itself
+ * against the traced descriptors, see init_fd_checks.
+ */
+#define MAX_FD_CHECKS 8
+static unsigned int fd_checks[MAX_FD_CHECKS];
+static unsigned int fd_checks_cnt;
+static bool fd_checks_enabled;
+
+/* Masks of syscall arguments checked, as returned by pathtrace_fd_args. */
+#define MAX_FD_ARG_MASKS 8
+static int fd_arg_masks[MAX_FD_ARG_MASKS];
+static unsigned int fd_arg_masks_cnt;
+
+enum {
+	VERDICT_ALLOW,
+	VERDICT_TRACE,
+	VERDICT_CHECK_FDS,	/* + index in fd_arg_masks */
+};
 
 #ifdef HAVE_FORK
 
@@ -253,17 +289,91 @@ check_seccomp_order(void)
 }
 
 static bool
-traced_by_seccomp(unsigned int scno, unsigned int p)
+always_traced_by_seccomp(unsigned int scno, unsigned int p)
 {
 	unsigned int always_trace_flags =
 		TRACE_INDIRECT_SUBCALL | TRACE_SECCOMP_DEFAULT |
 		(stack_trace_mode ? MEMORY_MAPPING_CHANGE : 0) |
 		(is_number_in_set(DECODE_PID_COMM, decode_pid_set) ?
 		 COMM_CHANGE : 0);
-	return sysent_vec[p][scno].sys_flags & always_trace_flags ||
+	return sysent_vec[p][scno].sys_flags & always_trace_flags;
+}
+
+static bool
+traced_by_seccomp(unsigned int scno, unsigned int p)
+{
+	return always_traced_by_seccomp(scno, p) ||
 		is_number_in_set_array(scno, trace_set, p);
 }
 
+static void
+init_fd_checks(void)
+{
+	if (!tracing_fds || tracing_paths)
+		return;
+
+	const unsigned int bound = number_set_upper_bound(trace_fd_set);
+	if (bound == UINT_MAX)
+		return;
+
+	for (unsigned int fd = 0; fd < bound; ++fd) {
+		if (!is_number_in_set(fd, trace_fd_set))
+			continue;
+		if (fd_checks_cnt >= MAX_FD_CHECKS) {
+			debug_msg("seccomp filter does not check descriptors: "
+				  "too many descriptors are traced");
+			return;
+		}
+		fd_checks[fd_checks_cnt++] = fd;
+	}
+
+	fd_checks_enabled = true;
+}
+
+/*
+ * Return the action of the filter for the syscall: either
+ * VERDICT_ALLOW, VERDICT_TRACE, or VERDICT_CHECK_FDS + i
+ * if the syscall is traced iff any of its arguments specified
+ * by fd_arg_masks[i] is a traced descriptor.
+ */
+static unsigned int
+seccomp_verdict(unsigned int scno, unsigned int p)
+{
+	if (!traced_by_seccomp(scno, p))
+		return VERDICT_ALLOW;
+	if (!fd_checks_enabled || always_traced_by_seccomp(scno, p))
+		return VERDICT_TRACE;
+
+	const int mask = pathtrace_fd_args(&sysent_vec[p][scno]);
+	if (mask < 0)
+		return VERDICT_TRACE;
+	if (!mask)
+		return VERDICT_ALLOW;
+
+	unsigned int i;
+	for (i = 0; i < fd_arg_masks_cnt; ++i) {
+		if (fd_arg_masks[i] == mask)
+			return VERDICT_CHECK_FDS + i;
+	}
+	if (i >= MAX_FD_ARG_MASKS)
+		return VERDICT_TRACE;
+	fd_arg_masks[fd_arg_masks_cnt++] = mask;
+	return VERDICT_CHECK_FDS + i;
+}
+
+static unsigned char
+verdict_jmp_placeholder(unsigned int verdict)
+{
+	switch (verdict) {
+	case VERDICT_ALLOW:
+		return JMP_PLACEHOLDER_ALLOW;
+	case VERDICT_TRACE:
+		return JMP_PLACEHOLDER_TRACE;
+	default:
+		return JMP_PLACEHOLDER_CHECK(verdict - VERDICT_CHECK_FDS);
+	}
+}
+
 static void
 replace_jmp_placeholders(unsigned char *jmp_offset, unsigned char jmp_next,
 			 unsigned char jmp_trace, unsigned char jmp_allow)
@@ -568,6 +678,431 @@ binary_match_filter_generator(struct sock_filter *filter, bool *overflow)
 	return pos;
 }
 
+static uint64_t
+syscall_weight(unsigned int scno, unsigned int p)
+{
+	return 1 + (syscall_weights[p] ? syscall_weights[p][scno] : 0);
+}
+
+/*
+ * Emit the subtree of the decision tree covering the syscall ranges
+ * from first to last, and return the number of emitted instructions.
+ * All syscalls in the range number i are in [lower[i], lower[i + 1])
+ * and share the same verdict[i], see seccomp_verdict.
+ */
+static unsigned short
+bpf_syscalls_tree(struct sock_filter *filter, const unsigned int *lower,
+		  const unsigned int *verdict, const unsigned int *root,
+		  size_t n, size_t first, size_t last)
+{
+	const size_t m = root[first * n + last];
+	unsigned short len = 1;
+	unsigned char jt, jf;
+
+	/* if (nr >= lower[m + 1]) goto right; else goto left; */
+	if (first == m) {
+		jf = verdict_jmp_placeholder(verdict[m]);
+	} else {
+		jf = 0;
+		len += bpf_syscalls_tree(filter + len, lower, verdict, root, n,
+					 first, m);
+	}
+	if (m + 1 == last) {
+		jt = verdict_jmp_placeholder(verdict[last]);
+	} else {
+		jt = len - 1;
+		len += bpf_syscalls_tree(filter + len, lower, verdict, root, n,
+					 m + 1, last);
+	}
+	SET_BPF_JUMP(filter, BPF_JGE | BPF_K, lower[m + 1], jt, jf);
+
+	return len;
+}
+
+static unsigned short
+weighted_tree_filter_generator(struct sock_filter *filter, bool *overflow)
+{
+	/*
+	 * Generated program looks like:
+	 * if (arch == AUDIT_ARCH_A && nr >= flag) {
+	 *	if (nr >= 231) {
+	 *		if (nr >= 321)
+	 *			return nr >= 324 ? RET_ALLOW : RET_TRACE;
+	 *		...
+	 *	} else {
+	 *		...
+	 *	}
+	 * }
+	 * ...
+	 * return SECCOMP_RET_TRACE;
+	 *
+	 * The comparisons form an optimal alphabetic tree over the ranges
+	 * of syscalls that are all traced or all not traced, so that
+	 * the expected number of comparisons executed for a syscall is
+	 * minimal given the expected syscall frequencies.
+	 */
+	unsigned short pos = 0;
+
+#if SUPPORTED_PERSONALITIES > 1
+	SET_BPF_STMT(&filter[pos++], BPF_LD | BPF_W | BPF_ABS,
+		     offsetof(struct seccomp_data, arch));
+#endif
+
+	/* See linear_filter_generator for the order of personalities.  */
+	for (int p = SUPPORTED_PERSONALITIES - 1; p >= 0; --p) {
+		const unsigned int flag = audit_arch_vec[p].flag;
+		unsigned short start = pos, end;
+
+#if SUPPORTED_PERSONALITIES > 1
+		/* if (arch != audit_arch_vec[p].arch) goto next; */
+		SET_BPF_JUMP(&filter[pos++], BPF_JEQ | BPF_K,
+			     audit_arch_vec[p].arch, 0, JMP_PLACEHOLDER_NEXT);
+#endif
+		SET_BPF_STMT(&filter[pos++], BPF_LD | BPF_W | BPF_ABS,
+			     offsetof(struct seccomp_data, nr));
+
+#if SUPPORTED_PERSONALITIES > 1
+		if (flag) {
+			/* if (nr < audit_arch_vec[p].flag) goto next; */
+			SET_BPF_JUMP(&filter[pos++], BPF_JGE | BPF_K,
+				     flag, 2, 0);
+			SET_BPF_STMT(&filter[pos++], BPF_LD | BPF_W | BPF_ABS,
+				     offsetof(struct seccomp_data, arch));
+			SET_BPF_JUMP(&filter[pos++], BPF_JA,
+				     JMP_PLACEHOLDER_NEXT, 0, 0);
+		}
+#endif
+
+		/*
+		 * Split syscalls into ranges, the last range covers
+		 * all syscall numbers above nsyscall_vec[p], those are traced.
+		 */
+		const size_t max_n = nsyscall_vec[p] + 1;
+		unsigned int *lower = xcalloc(max_n + 1, sizeof(*lower));
+		unsigned int *verdict = xcalloc(max_n, sizeof(*verdict));
+		uint64_t *weight = xcalloc(max_n, sizeof(*weight));
+		unsigned int fd_arg_masks_used = 0;
+		size_t n = 0;
+
+		for (unsigned int i = 0; i < nsyscall_vec[p]; ++i) {
+			const unsigned int v = seccomp_verdict(i, p);
+
+			if (v >= VERDICT_CHECK_FDS)
+				fd_arg_masks_used |= 1U << (v - VERDICT_CHECK_FDS);
+			if (!n || verdict[n - 1] != v) {
+				lower[n] = i | flag;
+				verdict[n] = v;
+				++n;
+			}
+			weight[n - 1] += syscall_weight(i, p);
+		}
+		if (!n || verdict[n - 1] != VERDICT_TRACE) {
+			lower[n] = nsyscall_vec[p] | flag;
+			verdict[n] = VERDICT_TRACE;
+			++n;
+		}
+
+		if (n == 1) {
+			SET_BPF_STMT(&filter[pos++], BPF_RET | BPF_K,
+				     SECCOMP_RET_TRACE);
+		} else {
+			/*
+			 * cost[i * n + j] is the expected cost of the optimal
+			 * subtree covering ranges from i to j, and
+			 * root[i * n + j] is the last range of its left
+			 * subtree.  Knuth's optimization applies here,
+			 * making the construction O(n^2).
+			 */
+			uint64_t *cost = xcalloc(n * n, sizeof(*cost));
+			unsigned int *root = xcalloc(n * n, sizeof(*root));
+			uint64_t *prefix = xcalloc(n + 1, sizeof(*prefix));
+
+			for (size_t i = 0; i < n; ++i) {
+				prefix[i + 1] = prefix[i] + weight[i];
+				root[i * n + i] = i;
+			}
+			for (size_t len = 2; len <= n; ++len) {
+				for (size_t i = 0; i + len <= n; ++i) {
+					const size_t j = i + len - 1;
+					const size_t lo = len == 2
+						? i : root[i * n + j - 1];
+					const size_t hi = len == 2
+						? i : MIN(root[(i + 1) * n + j],
+							  j - 1);
+					uint64_t best = UINT64_MAX;
+
+					for (size_t m = lo; m <= hi; ++m) {
+						uint64_t c = cost[i * n + m] +
+							cost[(m + 1) * n + j];
+						if (c < best) {
+							best = c;
+							root[i * n + j] = m;
+						}
+					}
+					cost[i * n + j] = best +
+						prefix[j + 1] - prefix[i];
+				}
+			}
+
+			pos += bpf_syscalls_tree(filter + pos, lower, verdict,
+						 root, n, 0, n - 1);
+
+			free(prefix);
+			free(root);
+			free(cost);
+		}
+
+		free(weight);
+		free(verdict);
+		free(lower);
+
+		end = pos;
+
+		/*
+		 * Emit the checks of descriptor arguments:
+		 * if (args[k] == fd1 || args[k] == fd2 || ...) return RET_TRACE;
+		 * ...
+		 * return RET_ALLOW;
+		 */
+		unsigned short check_pos[MAX_FD_ARG_MASKS];
+		unsigned short allow_pos = pos;
+		for (unsigned int g = 0; g < fd_arg_masks_cnt; ++g) {
+			if (!(fd_arg_masks_used & (1U << g)))
+				continue;
+			for (unsigned int k = 0; k < MAX_ARGS; ++k) {
+				if (fd_arg_masks[g] & (1 << k))
+					allow_pos += 1 + fd_checks_cnt;
+			}
+			allow_pos += 1;
+		}
+		for (unsigned int g = 0; g < fd_arg_masks_cnt; ++g) {
+			if (!(fd_arg_masks_used & (1U << g)))
+				continue;
+			check_pos[g] = pos;
+			for (unsigned int k = 0; k < MAX_ARGS; ++k) {
+				if (!(fd_arg_masks[g] & (1 << k)))
+					continue;
+				/* A = (int) args[k]; */
+				SET_BPF_STMT(&filter[pos++],
+					     BPF_LD | BPF_W | BPF_ABS,
+					     offsetof(struct seccomp_data,
+						      args[k])
+#ifdef WORDS_BIGENDIAN
+					     + sizeof(uint32_t)
+#endif
+					     );
+				for (unsigned int j = 0; j < fd_checks_cnt;
+				     ++j, ++pos) {
+					SET_BPF_JUMP(&filter[pos],
+						     BPF_JEQ | BPF_K,
+						     fd_checks[j],
+						     allow_pos - pos,
+						     0);
+				}
+			}
+			SET_BPF_JUMP(&filter[pos], BPF_JA,
+				     allow_pos - pos - 1, 0, 0);
+			++pos;
+		}
+
+		SET_BPF_STMT(&filter[pos++], BPF_RET | BPF_K,
+			     SECCOMP_RET_ALLOW);
+		SET_BPF_STMT(&filter[pos++], BPF_RET | BPF_K,
+			     SECCOMP_RET_TRACE);
+
+		/*
+		 * Jump offsets within the tree must not be mistaken
+		 * for placeholders, hence the stricter limit.
+		 */
+		if (pos - start >= JMP_PLACEHOLDER_CHECK(MAX_FD_ARG_MASKS)) {
+			*overflow = true;
+			return pos;
+		}
+
+		for (unsigned int i = start; i < end; ++i) {
+			if (BPF_CLASS(filter[i].code) != BPF_JMP)
+				continue;
+			for (unsigned int g = 0; g < fd_arg_masks_cnt; ++g) {
+				if (!(fd_arg_masks_used & (1U << g)))
+					continue;
+				if (filter[i].jt == JMP_PLACEHOLDER_CHECK(g))
+					filter[i].jt = check_pos[g] - i - 1;
+				if (filter[i].jf == JMP_PLACEHOLDER_CHECK(g))
+					filter[i].jf = check_pos[g] - i - 1;
+			}
+			unsigned char jmp_next = pos - i - 1;
+			unsigned char jmp_trace = pos - i - 2;
+			unsigned char jmp_allow = pos - i - 3;
+			replace_jmp_placeholders(&filter[i].jt, jmp_next,
+						 jmp_trace, jmp_allow);
+			replace_jmp_placeholders(&filter[i].jf, jmp_next,
+						 jmp_trace, jmp_allow);
+			if (BPF_OP(filter[i].code) == BPF_JA)
+				filter[i].k = (unsigned int) jmp_next;
+		}
+	}
+
+#if SUPPORTED_PERSONALITIES > 1
+	/* Jumps conditioned on .arch default to this RET_TRACE. */
+	SET_BPF_STMT(&filter[pos++], BPF_RET | BPF_K, SECCOMP_RET_TRACE);
+#endif
+
+	return pos;
+}
+
+/*
+ * Run the filter for the given syscall and return the number
+ * of executed instructions.  Only the instructions emitted
+ * by the generators are supported.
+ */
+static unsigned int
+bpf_prog_count_insns(const struct sock_filter *filter, unsigned short len,
+		     unsigned int arch, unsigned int nr)
+{
+	unsigned int a = 0, x = 0, cnt = 0;
+
+	for (unsigned int i = 0; i < len; ++i) {
+		const struct sock_filter *insn = &filter[i];
+
+		++cnt;
+		switch (insn->code) {
+		case BPF_LD | BPF_W | BPF_ABS:
+			/*
+			 * Syscall arguments are assumed not to match
+			 * the traced descriptors.
+			 */
+			a = insn->k == offsetof(struct seccomp_data, arch)
+			    ? arch
+			    : insn->k == offsetof(struct seccomp_data, nr)
+			    ? nr : -1U;
+			break;
+		case BPF_LD | BPF_W | BPF_IMM:
+			a = insn->k;
+			break;
+		case BPF_ALU | BPF_AND | BPF_K:
+			a &= insn->k;
+			break;
+		case BPF_ALU | BPF_RSH | BPF_K:
+			a >>= insn->k;
+			break;
+		case BPF_ALU | BPF_LSH | BPF_X:
+			a <<= x;
+			break;
+		case BPF_MISC | BPF_TAX:
+			x = a;
+			break;
+		case BPF_MISC | BPF_TXA:
+			a = x;
+			break;
+		case BPF_JMP | BPF_JA:
+			i += insn->k;
+			break;
+		case BPF_JMP | BPF_JEQ | BPF_K:
+			i += a == insn->k ? insn->jt : insn->jf;
+			break;
+		case BPF_JMP | BPF_JGE | BPF_K:
+			i += a >= insn->k ? insn->jt : insn->jf;
+			break;
+		case BPF_JMP | BPF_JSET | BPF_K:
+			i += a & insn->k ? insn->jt : insn->jf;
+			break;
+		default:
+			/* BPF_RET */
+			return cnt;
+		}
+	}
+
+	return cnt;
+}
+
+/* Check whether the filter examines syscall arguments.  */
+static bool
+bpf_prog_checks_args(const struct sock_filter *filter, unsigned short len)
+{
+	for (unsigned int i = 0; i < len; ++i) {
+		if (filter[i].code == (BPF_LD | BPF_W | BPF_ABS) &&
+		    filter[i].k >= offsetof(struct seccomp_data, args))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Return the expected number of instructions executed per syscall
+ * weighted by syscall frequencies.
+ */
+static double
+bpf_prog_expected_insns(const struct sock_filter *filter, unsigned short len)
+{
+	uint64_t total_weight = 0;
+	double total = 0;
+
+	for (unsigned int p = 0; p < SUPPORTED_PERSONALITIES; ++p) {
+		for (unsigned int i = 0; i < nsyscall_vec[p]; ++i) {
+			const uint64_t w = syscall_weight(i, p);
+
+			total += (double) w *
+				 bpf_prog_count_insns(filter, len,
+						      audit_arch_vec[p].arch,
+						      i | audit_arch_vec[p].flag);
+			total_weight += w;
+		}
+	}
+
+	return total_weight ? total / total_weight : 0;
+}
+
+/*
+ * Load syscall frequencies from a syscall summary produced by -c option.
+ * The number of calls is taken from the 4th column (the default -U layout)
+ * or from the 1st column of lines that consist of two columns, and the name
+ * of syscall is taken from the last column.
+ */
+static void
+load_seccomp_bpf_profile(void)
+{
+	FILE *fp = fopen_stream(seccomp_bpf_profile, "r");
+	if (!fp)
+		perror_msg_and_die("Can't fopen '%s'", seccomp_bpf_profile);
+
+	for (unsigned int p = 0; p < SUPPORTED_PERSONALITIES; ++p)
+		syscall_weights[p] = xcalloc(nsyscall_vec[p],
+					     sizeof(*syscall_weights[p]));
+
+	char buf[BUFSIZ];
+	while (fgets(buf, sizeof(buf), fp)) {
+		const char *name = NULL, *calls_str = NULL, *first = NULL;
+		unsigned int cnt = 0;
+
+		for (char *tok = strtok(buf, " \t\n"); tok;
+		     tok = strtok(NULL, " \t\n")) {
+			if (++cnt == 1)
+				first = tok;
+			else if (cnt == 4)
+				calls_str = tok;
+			name = tok;
+		}
+		if (cnt == 2)
+			calls_str = first;
+		else if (cnt < 5)
+			continue;
+
+		const long long calls = string_to_ulonglong(calls_str);
+		if (calls < 0)
+			continue;
+
+		for (unsigned int p = 0; p < SUPPORTED_PERSONALITIES; ++p) {
+			for (kernel_long_t scno = 0;
+			     (scno = scno_by_name(name, p, scno)) >= 0;
+			     ++scno)
+				syscall_weights[p][scno] += calls;
+		}
+	}
+
+	fclose(fp);
+}
+
 static void
 check_seccomp_filter_properties(void)
 {
@@ -578,22 +1113,50 @@ check_seccomp_filter_properties(void)
 		return;
 	}
 
+	if (seccomp_bpf_profile)
+		load_seccomp_bpf_profile();
+
+	/*
+	 * Prefer the program that checks descriptor arguments as it saves
+	 * ptrace stops, then choose the program that executes the fewest
+	 * instructions on average, or the shortest one if they are equally
+	 * fast.
+	 */
+	bool checks_args = false;
+	unsigned short min_len = USHRT_MAX;
 	for (unsigned int i = 0; i < ARRAY_SIZE(filter_generators); ++i) {
 		bool overflow = false;
 		unsigned short len = filter_generators[i](filters[i],
 							  &overflow);
-		if (len < bpf_prog.len && !overflow) {
+		if (overflow)
+			continue;
+		if (len < min_len)
+			min_len = len;
+		if (len > BPF_MAXINSNS)
+			continue;
+
+		double cost = bpf_prog_expected_insns(filters[i], len);
+		bool checks = bpf_prog_checks_args(filters[i], len);
+		debug_msg("seccomp filter generator #%u: %u instructions, "
+			  "%.2f expected per syscall%s", i, len, cost,
+			  checks ? ", checks descriptors" : "");
+		if (!bpf_prog.filter || checks > checks_args ||
+		    (checks == checks_args &&
+		     (cost < bpf_prog_cost ||
+		      (cost == bpf_prog_cost && len < bpf_prog.len)))) {
 			bpf_prog.len = len;
 			bpf_prog.filter = filters[i];
+			bpf_prog_cost = cost;
+			checks_args = checks;
 		}
 	}
-	if (bpf_prog.len == USHRT_MAX) {
+	if (min_len == USHRT_MAX) {
 		debug_msg("seccomp filter disabled due to jump offset "
 			  "overflow");
 		seccomp_filtering = false;
-	} else if (bpf_prog.len > BPF_MAXINSNS) {
+	} else if (!bpf_prog.filter) {
 		debug_msg("seccomp filter disabled due to BPF program "
-			  "being oversized (%u > %d)", bpf_prog.len,
+			  "being oversized (%u > %d)", min_len,
 			  BPF_MAXINSNS);
 		seccomp_filtering = false;
 	}
@@ -674,6 +1237,8 @@ dump_seccomp_bpf(void)
 				  filter[i].jt, filter[i].jf, filter[i].k);
 		}
 	}
+	error_msg("expected BPF instructions per syscall: %.2f",
+		  bpf_prog_cost);
 }
 
 void
@@ -707,8 +1272,14 @@ seccomp_filter_restart_operator(const struct tcb *tcp)
 void
 check_seccomp_filter(void)
 {
-	/* Let's avoid enabling seccomp if all syscalls are traced. */
-	seccomp_filtering = !is_complete_set_array(trace_set, nsyscall_vec,
+	init_fd_checks();
+
+	/*
+	 * Let's avoid enabling seccomp if all syscalls are traced
+	 * and the filter cannot check descriptors either.
+	 */
+	seccomp_filtering = fd_checks_enabled ||
+			    !is_complete_set_array(trace_set, nsyscall_vec,
 						   SUPPORTED_PERSONALITIES);
 	if (!seccomp_filtering) {
 		error_msg("Seccomp filter is requested "
@@ -1,7 +1,7 @@
 /*
  * Copyright (c) 2018 Chen Jingpiao <chenjingpiao@gmail.com>
  * Copyright (c) 2019 Paul Chaignon <paul.chaignon@gmail.com>
- * Copyright (c) 2018-2021 The strace developers.
+ * Copyright (c) 2018-2026 The strace developers.
  * All rights reserved.
  *
  * SPDX-License-Identifier: LGPL-2.1-or-later
@@ -14,6 +14,7 @@
 
 extern bool seccomp_filtering;
 extern bool seccomp_before_sysentry;
+extern const char *seccomp_bpf_profile;
 
 extern void check_seccomp_filter(void);
 extern void init_seccomp_filter(void);
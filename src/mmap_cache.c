@@ -7,22 +7,217 @@
 
 #include "defs.h"
 #include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 
 #include "largefile_wrappers.h"
 #include "mmap_cache.h"
 #include "mmap_notify.h"
+#include "sample.h"
+#include "sen.h"
 #include "xstring.h"
 
-static unsigned int mmap_cache_generation;
+/* List of the caches in use, one per address space.  */
+static struct mmap_cache_t *mmap_caches;
 
 static void
-mmap_cache_invalidate(struct tcb *tcp, void *unused)
+mmap_cache_invalidate(struct mmap_cache_t *cache)
 {
-	mmap_cache_generation++;
-	debug_func_msg("tgen=%u, ggen=%u, tcp=%p, cache=%p",
-		       tcp->mmap_cache ? tcp->mmap_cache->generation : 0,
-		       mmap_cache_generation, tcp,
-		       tcp->mmap_cache ? tcp->mmap_cache->entry : 0);
+	cache->size = 0;
+	cache->valid = false;
+	cache->generation++;
+}
+
+/*
+ * Returns the index of the first entry that ends after addr.
+ */
+static unsigned int
+mmap_cache_lower_bound(const struct mmap_cache_t *cache, unsigned long addr)
+{
+	unsigned int lower = 0;
+	unsigned int upper = cache->size;
+
+	while (lower < upper) {
+		unsigned int mid = lower + (upper - lower) / 2;
+
+		if (cache->entry[mid].end_addr <= addr)
+			lower = mid + 1;
+		else
+			upper = mid;
+	}
+
+	return lower;
+}
+
+/*
+ * Splits the entry that contains addr, if any, into two entries,
+ * one ending at addr and one starting at addr.
+ */
+static void
+mmap_cache_split(struct mmap_cache_t *cache, unsigned long addr)
+{
+	unsigned int i = mmap_cache_lower_bound(cache, addr);
+
+	if (i >= cache->size || cache->entry[i].start_addr >= addr)
+		return;
+
+	if (cache->size >= cache->allocated)
+		cache->entry = xgrowarray(cache->entry, &cache->allocated,
+					  sizeof(*cache->entry));
+
+	struct mmap_cache_entry_t *entry = &cache->entry[i];
+	memmove(entry + 1, entry, (cache->size - i) * sizeof(*entry));
+	cache->size++;
+
+	entry[0].end_addr = addr;
+	entry[1].mmap_offset += addr - entry[1].start_addr;
+	entry[1].start_addr = addr;
+}
+
+/*
+ * Returns the range [*first, *last) of indices of the entries
+ * that lie within [start, end) after splitting the entries that cross
+ * the boundaries.
+ */
+static void
+mmap_cache_isolate(struct mmap_cache_t *cache,
+		   unsigned long start, unsigned long end,
+		   unsigned int *first, unsigned int *last)
+{
+	mmap_cache_split(cache, start);
+	mmap_cache_split(cache, end);
+
+	*first = mmap_cache_lower_bound(cache, start);
+	*last = mmap_cache_lower_bound(cache, end);
+}
+
+static void
+mmap_cache_remove_range(struct mmap_cache_t *cache,
+			unsigned long start, unsigned long end)
+{
+	unsigned int first, last;
+
+	mmap_cache_isolate(cache, start, end, &first, &last);
+	if (first == last)
+		return;
+
+	memmove(&cache->entry[first], &cache->entry[last],
+		(cache->size - last) * sizeof(*cache->entry));
+	cache->size -= last - first;
+	cache->generation++;
+}
+
+static void
+mmap_cache_protect_range(struct mmap_cache_t *cache,
+			 unsigned long start, unsigned long end,
+			 unsigned long prot)
+{
+	unsigned int first, last;
+
+	mmap_cache_isolate(cache, start, end, &first, &last);
+	if (first == last)
+		return;
+
+	for (unsigned int i = first; i < last; ++i) {
+		struct mmap_cache_entry_t *entry = &cache->entry[i];
+
+		entry->protections =
+			(entry->protections & MMAP_CACHE_PROT_SHARED)
+			| ((prot & PROT_READ) ? MMAP_CACHE_PROT_READABLE : 0)
+			| ((prot & PROT_WRITE) ? MMAP_CACHE_PROT_WRITABLE : 0)
+			| ((prot & PROT_EXEC) ? MMAP_CACHE_PROT_EXECUTABLE : 0);
+	}
+	cache->generation++;
+}
+
+static unsigned long
+page_align(unsigned long len)
+{
+	const unsigned long page_mask = get_pagesize() - 1;
+
+	return (len + page_mask) & ~page_mask;
+}
+
+/*
+ * Only the mappings that have names are cached, so private anonymous mappings
+ * affect the cache only by replacing other mappings.  Hugetlb mappings
+ * are named even if they are anonymous.
+ */
+static bool
+is_unnamed_mapping(unsigned long flags)
+{
+	return (flags & MAP_ANONYMOUS) && !(flags & MAP_HUGETLB) &&
+	       (flags & MAP_TYPE) == MAP_PRIVATE;
+}
+
+/*
+ * Applies the result of a syscall that changes memory mappings to the cache
+ * of the tracee.  The changes that cannot be applied invalidate the cache.
+ */
+static void
+mmap_cache_update(struct tcb *tcp, void *unused)
+{
+	struct mmap_cache_t *cache = tcp->mmap_cache;
+
+	if (!cache)
+		return;
+
+	switch (tcp_sysent(tcp)->sen) {
+	case SEN_execv:
+	case SEN_execve:
+	case SEN_execveat:
+		/* The tracee gets a new address space.  */
+		if (!syserror(tcp)) {
+			if (cache->tgid == get_proc_pid(tcp->pid))
+				cache->tgid = 0;
+			cache->free_fn(tcp, __func__);
+		}
+		return;
+	}
+
+	if (!cache->valid)
+		return;
+
+	/* A failed mprotect or MAP_FIXED mmap may have been partially applied.  */
+	if (syserror(tcp)) {
+		mmap_cache_invalidate(cache);
+		return;
+	}
+
+	const unsigned long addr = tcp->u_arg[0];
+	const unsigned long len = page_align(tcp->u_arg[1]);
+	const unsigned long rval = current_klongsize < sizeof(tcp->u_rval)
+				   ? (unsigned int) tcp->u_rval : tcp->u_rval;
+
+	switch (tcp_sysent(tcp)->sen) {
+	case SEN_mmap:
+	case SEN_mmap_4koff:
+	case SEN_mmap_pgoff:
+		if (is_unnamed_mapping(tcp->u_arg[3])) {
+			mmap_cache_remove_range(cache, rval, rval + len);
+			break;
+		}
+		mmap_cache_invalidate(cache);
+		break;
+	case SEN_munmap:
+		mmap_cache_remove_range(cache, addr, addr + len);
+		break;
+	case SEN_mprotect:
+	case SEN_pkey_mprotect:
+		if (tcp->u_arg[2] & (PROT_GROWSDOWN | PROT_GROWSUP)) {
+			mmap_cache_invalidate(cache);
+			break;
+		}
+		mmap_cache_protect_range(cache, addr, addr + len,
+					 tcp->u_arg[2]);
+		break;
+	default:
+		mmap_cache_invalidate(cache);
+	}
+
+	debug_func_msg("gen=%u, size=%u, valid=%d, tcp=%p, cache=%p",
+		       cache->generation, cache->size, cache->valid,
+		       tcp, cache->entry);
 }
 
 void
@@ -31,98 +226,226 @@ mmap_cache_enable(void)
 	static bool use_mmap_cache;
 
 	if (!use_mmap_cache) {
-		mmap_notify_register_client(mmap_cache_invalidate, NULL);
+		mmap_notify_register_client(mmap_cache_update, NULL);
 		use_mmap_cache = true;
 	}
 }
 
+/*
+ * Called when the sample window opens: the mappings might have been
+ * changed by the syscalls that were not seen while it was closed.
+ */
+void
+mmap_cache_invalidate_all(void)
+{
+	for (struct mmap_cache_t *cache = mmap_caches; cache;
+	     cache = cache->next)
+		mmap_cache_invalidate(cache);
+}
+
 /* deleting the cache */
 static void
 delete_mmap_cache(struct tcb *tcp, const char *caller)
 {
-	debug_func_msg("tgen=%u, ggen=%u, tcp=%p, cache=%p, caller=%s",
-		       tcp->mmap_cache ? tcp->mmap_cache->generation : 0,
-		       mmap_cache_generation, tcp,
-		       tcp->mmap_cache ? tcp->mmap_cache->entry : 0, caller);
+	struct mmap_cache_t *cache = tcp->mmap_cache;
 
-	if (!tcp->mmap_cache)
+	debug_func_msg("gen=%u, refcount=%u, tcp=%p, cache=%p, caller=%s",
+		       cache ? cache->generation : 0,
+		       cache ? cache->refcount : 0, tcp,
+		       cache ? cache->entry : 0, caller);
+
+	if (!cache)
 		return;
 
-	while (tcp->mmap_cache->size) {
-		unsigned int i = --tcp->mmap_cache->size;
-		free(tcp->mmap_cache->entry[i].binary_filename);
-		tcp->mmap_cache->entry[i].binary_filename = NULL;
+	tcp->mmap_cache = NULL;
+	if (--cache->refcount)
+		return;
+
+	for (struct mmap_cache_t **p = &mmap_caches; *p; p = &(*p)->next) {
+		if (*p == cache) {
+			*p = cache->next;
+			break;
+		}
 	}
 
-	free(tcp->mmap_cache->entry);
-	tcp->mmap_cache->entry = NULL;
+	free(cache->entry);
+	free(cache->buf);
+	free(cache);
+}
 
-	free(tcp->mmap_cache);
-	tcp->mmap_cache = NULL;
+static void *
+find_mmap_cache(int tgid)
+{
+	for (struct mmap_cache_t *cache = mmap_caches; cache;
+	     cache = cache->next) {
+		if (cache->tgid == tgid)
+			return cache;
+	}
+
+	return NULL;
 }
 
 /*
- * caching of /proc/ID/maps for each process to speed up stack tracing
- *
- * The cache must be refreshed after syscalls that affect memory mappings,
- * e.g. mmap, mprotect, munmap, execve.
+ * Returns the cache of the address space of the tracee, creating it
+ * if the address space has none.
  */
-extern enum mmap_cache_rebuild_result
-mmap_cache_rebuild_if_invalid(struct tcb *tcp, const char *caller)
+static struct mmap_cache_t *
+get_mmap_cache(struct tcb *tcp, int proc_pid)
 {
-	if (tcp->mmap_cache
-	    && tcp->mmap_cache->generation != mmap_cache_generation)
-		delete_mmap_cache(tcp, caller);
+	int tgid;
+	struct mmap_cache_t *cache =
+		find_by_address_space(tcp, proc_pid, find_mmap_cache, &tgid);
+
+	if (!cache) {
+		cache = xzalloc(sizeof(*cache));
+		cache->free_fn = delete_mmap_cache;
+		cache->tgid = tgid;
+		cache->next = mmap_caches;
+		mmap_caches = cache;
+	}
 
-	if (tcp->mmap_cache)
-		return MMAP_CACHE_REBUILD_READY;
+	cache->refcount++;
+	return cache;
+}
 
-	char filename[sizeof("/proc/4294967296/maps")];
-	xsprintf(filename, "/proc/%u/maps", get_proc_pid(tcp->pid));
+/*
+ * Reads the whole file into the buffer of the cache, returns the number
+ * of bytes read, or -1 on error.
+ */
+static ssize_t
+read_maps(struct mmap_cache_t *cache, const char *filename)
+{
+	int fd = open_file(filename, O_RDONLY);
+	if (fd < 0)
+		return -1;
 
-	FILE *fp = fopen_stream(filename, "r");
-	if (!fp) {
-		perror_msg("fopen: %s", filename);
-		return MMAP_CACHE_REBUILD_NOCACHE;
+	size_t len = 0;
+
+	for (;;) {
+		/* Keep room for the terminating '\0' */
+		if (len + 1 >= cache->buf_size)
+			cache->buf = xgrowarray(cache->buf, &cache->buf_size, 1);
+
+		ssize_t n = read(fd, cache->buf + len,
+				 cache->buf_size - len - 1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			close(fd);
+			return -1;
+		}
+		if (!n)
+			break;
+		len += n;
 	}
 
-	struct mmap_cache_t cache = {
-		.free_fn = delete_mmap_cache,
-		.generation = mmap_cache_generation
-	};
-
-	/* start with a small dynamically-allocated array and then expand it */
-	size_t allocated = 0;
-	char buffer[PATH_MAX + 80];
-
-	while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-		unsigned long start_addr, end_addr, mmap_offset;
-		char read_bit;
-		char write_bit;
-		char exec_bit;
-		char shared_bit;
-		unsigned long major, minor;
-		char binary_path[sizeof(buffer)];
-
-		if (sscanf(buffer, "%lx-%lx %c%c%c%c %lx %lx:%lx %*d %[^\n]",
-			   &start_addr, &end_addr,
-			   &read_bit, &write_bit, &exec_bit, &shared_bit,
-			   &mmap_offset,
-			   &major, &minor,
-			   binary_path) != 10)
-			continue;
+	close(fd);
+	cache->buf[len] = '\0';
+	return len;
+}
 
-		/* skip mappings that have unknown protection */
-		if (!(read_bit == '-' || read_bit == 'r'))
-			continue;
-		if (!(write_bit == '-' || write_bit == 'w'))
-			continue;
-		if (!(exec_bit == '-' || exec_bit == 'x'))
-			continue;
-		if (!(shared_bit == 'p' || shared_bit == 's'))
-			continue;
+static const char *
+parse_hex(const char *p, unsigned long *val)
+{
+	const char *start = p;
+	unsigned long v = 0;
+
+	for (;; ++p) {
+		unsigned int digit;
 
-		if (end_addr < start_addr) {
+		if (*p >= '0' && *p <= '9')
+			digit = *p - '0';
+		else if (*p >= 'a' && *p <= 'f')
+			digit = *p - 'a' + 10;
+		else
+			break;
+		v = (v << 4) | digit;
+	}
+
+	*val = v;
+	return p != start ? p : NULL;
+}
+
+/*
+ * Parses a line of /proc/ID/maps in place, the path is terminated with '\0'.
+ * Returns the pointer to the next line, *skip is set if the line is malformed
+ * or describes a mapping that is not cached.
+ *
+ * example line:
+ * 7fabbb09b000-7fabbb09f000 r-xp 00179000 fc:00 1180246    /lib/libc.so.6
+ */
+static char *
+parse_maps_line(char *p, struct mmap_cache_entry_t *entry, bool *skip)
+{
+	char *eol = strchr(p, '\n');
+	if (!eol)
+		eol = p + strlen(p);
+	char *next = *eol ? eol + 1 : eol;
+	*eol = '\0';
+
+	*skip = true;
+
+	if (!(p = (char *) parse_hex(p, &entry->start_addr)) || *p++ != '-' ||
+	    !(p = (char *) parse_hex(p, &entry->end_addr)) || *p++ != ' ')
+		return next;
+
+	if (eol - p < 5 || p[4] != ' ')
+		return next;
+
+	/* skip mappings that have unknown protection */
+	if ((p[0] != '-' && p[0] != 'r') ||
+	    (p[1] != '-' && p[1] != 'w') ||
+	    (p[2] != '-' && p[2] != 'x') ||
+	    (p[3] != 'p' && p[3] != 's'))
+		return next;
+	entry->protections =
+		((p[0] == 'r') ? MMAP_CACHE_PROT_READABLE : 0) |
+		((p[1] == 'w') ? MMAP_CACHE_PROT_WRITABLE : 0) |
+		((p[2] == 'x') ? MMAP_CACHE_PROT_EXECUTABLE : 0) |
+		((p[3] == 's') ? MMAP_CACHE_PROT_SHARED : 0);
+	p += 5;
+
+	if (!(p = (char *) parse_hex(p, &entry->mmap_offset)) || *p++ != ' ' ||
+	    !(p = (char *) parse_hex(p, &entry->major)) || *p++ != ':' ||
+	    !(p = (char *) parse_hex(p, &entry->minor)) || *p++ != ' ')
+		return next;
+
+	/* inode */
+	if (*p < '0' || *p > '9')
+		return next;
+	while (*p >= '0' && *p <= '9')
+		++p;
+	while (*p == ' ' || *p == '\t')
+		++p;
+
+	/* skip mappings that have no name */
+	if (!*p)
+		return next;
+
+	entry->binary_filename = p;
+	*skip = false;
+	return next;
+}
+
+static bool
+mmap_cache_read(struct mmap_cache_t *cache, const char *filename)
+{
+	cache->size = 0;
+
+	ssize_t len = read_maps(cache, filename);
+	if (len < 0) {
+		perror_msg("read: %s", filename);
+		return false;
+	}
+
+	for (char *p = cache->buf; *p; ) {
+		struct mmap_cache_entry_t line;
+		bool skip;
+
+		p = parse_maps_line(p, &line, &skip);
+		if (skip)
+			continue;
+		if (line.end_addr < line.start_addr) {
 			error_msg("%s: unrecognized file format", filename);
 			break;
 		}
@@ -132,56 +455,85 @@ mmap_cache_rebuild_if_invalid(struct tcb *tcp, const char *caller)
 		 * sanity check to make sure that we're storing
 		 * non-overlapping regions in ascending order
 		 */
-		if (cache.size > 0) {
-			entry = &cache.entry[cache.size - 1];
-			if (entry->start_addr == start_addr &&
-			    entry->end_addr == end_addr) {
+		if (cache->size > 0) {
+			entry = &cache->entry[cache->size - 1];
+			if (entry->start_addr == line.start_addr &&
+			    entry->end_addr == line.end_addr) {
 				/* duplicate entry, e.g. [vsyscall] */
 				continue;
 			}
-			if (start_addr <= entry->start_addr ||
-			    start_addr < entry->end_addr) {
+			if (line.start_addr <= entry->start_addr ||
+			    line.start_addr < entry->end_addr) {
 				debug_msg("%s: overlapping memory region: "
 					  "\"%s\" [%08lx-%08lx] overlaps with "
 					  "\"%s\" [%08lx-%08lx]",
-					  filename, binary_path, start_addr,
-					  end_addr, entry->binary_filename,
+					  filename, line.binary_filename,
+					  line.start_addr, line.end_addr,
+					  entry->binary_filename,
 					  entry->start_addr, entry->end_addr);
 				continue;
 			}
 		}
 
-		if (cache.size >= allocated)
-			cache.entry = xgrowarray(cache.entry, &allocated,
-						 sizeof(*cache.entry));
-
-		entry = &cache.entry[cache.size];
-		entry->start_addr = start_addr;
-		entry->end_addr = end_addr;
-		entry->mmap_offset = mmap_offset;
-		entry->protections = (
-			0
-			| ((read_bit   == 'r')? MMAP_CACHE_PROT_READABLE  : 0)
-			| ((write_bit  == 'w')? MMAP_CACHE_PROT_WRITABLE  : 0)
-			| ((exec_bit   == 'x')? MMAP_CACHE_PROT_EXECUTABLE: 0)
-			| ((shared_bit == 's')? MMAP_CACHE_PROT_SHARED    : 0)
-			);
-		entry->major = major;
-		entry->minor = minor;
-		entry->binary_filename = xstrdup(binary_path);
-		cache.size++;
-	}
-	fclose(fp);
-
-	if (!cache.size)
-		return MMAP_CACHE_REBUILD_NOCACHE;
+		if (cache->size >= cache->allocated)
+			cache->entry = xgrowarray(cache->entry,
+						  &cache->allocated,
+						  sizeof(*cache->entry));
+
+		cache->entry[cache->size++] = line;
+	}
+
+	cache->generation++;
+	cache->valid = true;
+	return true;
+}
 
-	tcp->mmap_cache = xobjdup(&cache);
+/*
+ * caching of /proc/ID/maps for each address space to speed up stack tracing
+ *
+ * The cache is updated after syscalls that affect memory mappings,
+ * e.g. mmap, mprotect, munmap, and is read again after the syscalls
+ * whose effect is not known, e.g. mremap, execve.
+ */
+extern enum mmap_cache_rebuild_result
+mmap_cache_rebuild_if_invalid(struct tcb *tcp, const char *caller)
+{
+	int proc_pid = get_proc_pid(tcp->pid);
+	bool joined = false;
+
+	if (!tcp->mmap_cache) {
+		tcp->mmap_cache = get_mmap_cache(tcp, proc_pid);
+		joined = true;
+	}
+
+	struct mmap_cache_t *cache = tcp->mmap_cache;
+
+	/*
+	 * While the sample window is closed, the tracees run without
+	 * stopping on syscalls, so the mappings cannot be trusted.
+	 */
+	if (!is_sample_window_open())
+		mmap_cache_invalidate(cache);
 
-	debug_func_msg("tgen=%u, ggen=%u, tcp=%p, cache=%p, caller=%s",
-		       tcp->mmap_cache->generation, mmap_cache_generation,
-		       tcp, tcp->mmap_cache->entry, caller);
+	if (!cache->valid) {
+		char filename[sizeof("/proc/4294967296/maps")];
+		xsprintf(filename, "/proc/%u/maps", proc_pid);
 
+		if (!mmap_cache_read(cache, filename))
+			return MMAP_CACHE_REBUILD_NOCACHE;
+
+		debug_func_msg("gen=%u, size=%u, tcp=%p, cache=%p, caller=%s",
+			       cache->generation, cache->size,
+			       tcp, cache->entry, caller);
+	}
+
+	if (!cache->size)
+		return MMAP_CACHE_REBUILD_NOCACHE;
+
+	if (!joined && tcp->mmap_cache_generation == cache->generation)
+		return MMAP_CACHE_REBUILD_READY;
+
+	tcp->mmap_cache_generation = cache->generation;
 	return MMAP_CACHE_REBUILD_RENEWED;
 }
 
@@ -191,21 +543,12 @@ mmap_cache_search(struct tcb *tcp, unsigned long ip)
 	if (!tcp->mmap_cache)
 		return NULL;
 
-	int lower = 0;
-	int upper = (int) tcp->mmap_cache->size - 1;
+	struct mmap_cache_t *cache = tcp->mmap_cache;
+	unsigned int i = mmap_cache_lower_bound(cache, ip);
 
-	while (lower <= upper) {
-		int mid = (upper + lower) / 2;
-		struct mmap_cache_entry_t *entry = &tcp->mmap_cache->entry[mid];
+	if (i < cache->size && ip >= cache->entry[i].start_addr)
+		return &cache->entry[i];
 
-		if (ip >= entry->start_addr &&
-		    ip < entry->end_addr)
-			return entry;
-		else if (ip < entry->start_addr)
-			upper = mid - 1;
-		else
-			lower = mid + 1;
-	}
 	return NULL;
 }
 
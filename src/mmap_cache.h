@@ -16,7 +16,23 @@ struct mmap_cache_t {
 	struct mmap_cache_entry_t *entry;
 	void (*free_fn)(struct tcb *, const char *caller);
 	unsigned int size;
+	/* Incremented on every change of the cached memory mappings.  */
 	unsigned int generation;
+
+	/*
+	 * The cache is shared by all tracees that share the address space.
+	 * It is kept up to date by applying the results of syscalls
+	 * that change memory mappings, and is read again from /proc/ID/maps
+	 * only when the change cannot be applied.
+	 */
+	struct mmap_cache_t *next;
+	size_t allocated;
+	/* Contents of /proc/ID/maps, binary_filename fields point here.  */
+	char *buf;
+	size_t buf_size;
+	unsigned int refcount;
+	int tgid;
+	bool valid;
 };
 
 struct mmap_cache_entry_t {
@@ -58,6 +74,9 @@ typedef bool (*mmap_cache_search_fn)(struct mmap_cache_entry_t *, void *);
 extern void
 mmap_cache_enable(void);
 
+extern void
+mmap_cache_invalidate_all(void);
+
 extern enum mmap_cache_rebuild_result
 mmap_cache_rebuild_if_invalid(struct tcb *, const char *caller);
 
@@ -133,6 +133,8 @@ dumpiov_in_mmsghdr(struct tcb *const tcp, kernel_ulong_t addr)
 	unsigned int len = tcp->u_rval;
 	unsigned int fetched;
 
+	umove_prefetch(tcp, addr, len * sizeof_struct_mmsghdr());
+
 	for (unsigned int i = 0; i < len; ++i, addr += fetched) {
 		struct mmsghdr mmsg;
 		fetched = fetch_struct_mmsghdr(tcp, addr, &mmsg);
@@ -80,6 +80,14 @@ is_number_in_set_array(const unsigned int number, const struct number_set *const
 		&& number_isset(number, set[idx].vec)) ^ set[idx].not;
 }
 
+unsigned int
+number_set_upper_bound(const struct number_set *const set)
+{
+	if (!set)
+		return 0;
+	return set->not ? UINT_MAX : set->nslots * BITS_PER_SLOT;
+}
+
 bool
 is_complete_set(const struct number_set *const set, const unsigned int max_numbers)
 {
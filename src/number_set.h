@@ -22,6 +22,13 @@ is_number_in_set(unsigned int number, const struct number_set *);
 extern bool
 is_number_in_set_array(unsigned int number, const struct number_set *, unsigned int idx);
 
+/*
+ * Return a number such that all numbers in the set are below it,
+ * or UINT_MAX if the set is inverted.
+ */
+extern unsigned int
+number_set_upper_bound(const struct number_set *);
+
 extern bool
 is_complete_set(const struct number_set *, unsigned int max_numbers);
 
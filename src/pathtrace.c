@@ -1,6 +1,6 @@
 /*
  * Copyright (c) 2011 Comtrol Corp.
- * Copyright (c) 2011-2025 The strace developers.
+ * Copyright (c) 2011-2026 The strace developers.
  * All rights reserved.
  *
  * SPDX-License-Identifier: LGPL-2.1-or-later
@@ -14,6 +14,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "fd_path_cache.h"
 #include "largefile_wrappers.h"
 #include "number_set.h"
 #include "sen.h"
@@ -156,11 +157,22 @@ getfdpath_pid(pid_t pid, int fd, char *buf, unsigned bufsize, bool *deleted)
 	if (fd < 0)
 		return -1;
 
+	int n = fd_path_cache_lookup(pid, fd, buf, bufsize);
+	if (n >= 0) {
+		if (deleted)
+			*deleted = false;
+		return n;
+	}
+
 	int proc_pid = get_proc_pid(pid);
 	if (!proc_pid)
 		return -1;
 
-	return get_proc_pid_fd_path(proc_pid, fd, buf, bufsize, deleted);
+	n = get_proc_pid_fd_path(proc_pid, fd, buf, bufsize, deleted);
+	if (n >= 0 && !(deleted && *deleted))
+		fd_path_cache_store(pid, fd, buf, n);
+
+	return n;
 }
 
 /*
@@ -239,19 +251,19 @@ match_xselect_args(struct tcb *tcp, const kernel_ulong_t *args,
 }
 
 /*
- * Return true if syscall accesses a selected path
- * (or if no paths have been specified for tracing).
+ * Store the masks of syscall arguments that are file descriptors and paths
+ * to be matched against the selected ones.  Return false if the syscall
+ * is matched in some other way, e.g. using the descriptors stored
+ * in the tracee memory.
  */
-bool
-pathtrace_match_set(struct tcb *tcp, struct path_set *set,
-		    struct number_set *fdset)
+static bool
+get_match_args(const struct_sysent *s, unsigned int *fd_args,
+	       unsigned int *path_args)
 {
-	const struct_sysent *s;
-
-	s = tcp_sysent(tcp);
+	*fd_args = *path_args = 0;
 
 	if (!(s->sys_flags & (TRACE_FILE | TRACE_DESC | TRACE_NETWORK)))
-		return false;
+		return true;
 
 	/*
 	 * Check for special cases where we need to do something
@@ -266,8 +278,8 @@ pathtrace_match_set(struct tcb *tcp, struct path_set *set,
 	case SEN_sendfile64:
 	case SEN_tee:
 		/* fd, fd */
-		return fdmatch(tcp, tcp->u_arg[0], set, fdset) ||
-			fdmatch(tcp, tcp->u_arg[1], set, fdset);
+		*fd_args = 1 << 0 | 1 << 1;
+		return true;
 
 	case SEN_execveat:
 	case SEN_faccessat:
@@ -298,66 +310,161 @@ pathtrace_match_set(struct tcb *tcp, struct path_set *set,
 	case SEN_utimensat_time32:
 	case SEN_utimensat_time64:
 		/* fd, path */
-		return fdmatch(tcp, tcp->u_arg[0], set, fdset) ||
-			upathmatch(tcp, tcp->u_arg[1], set);
+		*fd_args = 1 << 0;
+		*path_args = 1 << 1;
+		return true;
 
 	case SEN_link:
 	case SEN_mount:
 	case SEN_pivotroot:
 		/* path, path */
-		return upathmatch(tcp, tcp->u_arg[0], set) ||
-			upathmatch(tcp, tcp->u_arg[1], set);
+		*path_args = 1 << 0 | 1 << 1;
+		return true;
 
 	case SEN_quotactl:
 	case SEN_symlink:
 		/* x, path */
-		return upathmatch(tcp, tcp->u_arg[1], set);
+		*path_args = 1 << 1;
+		return true;
 
 	case SEN_linkat:
 	case SEN_move_mount:
 	case SEN_renameat2:
 	case SEN_renameat:
 		/* fd, path, fd, path */
-		return fdmatch(tcp, tcp->u_arg[0], set, fdset) ||
-			fdmatch(tcp, tcp->u_arg[2], set, fdset) ||
-			upathmatch(tcp, tcp->u_arg[1], set) ||
-			upathmatch(tcp, tcp->u_arg[3], set);
-
-#if HAVE_ARCH_OLD_MMAP
-	case SEN_old_mmap:
-# if HAVE_ARCH_OLD_MMAP_PGOFF
-	case SEN_old_mmap_pgoff:
-# endif
-	{
-		kernel_ulong_t *args =
-			fetch_indirect_syscall_args(tcp, tcp->u_arg[0], 6);
-
-		return args && fdmatch(tcp, args[4], set, fdset);
-	}
-#endif /* HAVE_ARCH_OLD_MMAP */
+		*fd_args = 1 << 0 | 1 << 2;
+		*path_args = 1 << 1 | 1 << 3;
+		return true;
 
 	case SEN_mmap:
 	case SEN_mmap_4koff:
 	case SEN_mmap_pgoff:
 	case SEN_ARCH_mmap:
 		/* x, x, x, x, fd */
-		return fdmatch(tcp, tcp->u_arg[4], set, fdset);
+		*fd_args = 1 << 4;
+		return true;
 
 	case SEN_symlinkat:
 		/* x, fd, path */
-		return fdmatch(tcp, tcp->u_arg[1], set, fdset) ||
-			upathmatch(tcp, tcp->u_arg[2], set);
+		*fd_args = 1 << 1;
+		*path_args = 1 << 2;
+		return true;
 
 	case SEN_copy_file_range:
 	case SEN_splice:
 		/* fd, x, fd, x, x, x */
-		return fdmatch(tcp, tcp->u_arg[0], set, fdset) ||
-			fdmatch(tcp, tcp->u_arg[2], set, fdset);
+		*fd_args = 1 << 0 | 1 << 2;
+		return true;
 
 	case SEN_epoll_ctl:
 		/* x, x, fd, x */
-		return fdmatch(tcp, tcp->u_arg[2], set, fdset);
+		*fd_args = 1 << 2;
+		return true;
+
+	case SEN_bpf:
+	case SEN_epoll_create:
+	case SEN_epoll_create1:
+	case SEN_eventfd2:
+	case SEN_eventfd:
+	case SEN_fanotify_init:
+	case SEN_fsopen:
+	case SEN_inotify_init:
+	case SEN_inotify_init1:
+	case SEN_io_uring_setup:
+	case SEN_landlock_create_ruleset:
+	case SEN_memfd_create:
+	case SEN_memfd_secret:
+	case SEN_mq_open:
+	case SEN_perf_event_open:
+	case SEN_pidfd_open:
+	case SEN_pipe:
+	case SEN_pipe2:
+	case SEN_printargs:
+	case SEN_socket:
+	case SEN_socketpair:
+	case SEN_timerfd_create:
+	case SEN_userfaultfd:
+		/*
+		 * These have TRACE_FILE or TRACE_DESC or TRACE_NETWORK set,
+		 * but they don't have any file descriptor or path args to test.
+		 */
+		return true;
+
+	case SEN_fanotify_mark:
+	case SEN_fsconfig:
+	case SEN_poll_time32:
+	case SEN_poll_time64:
+	case SEN_ppoll_time32:
+	case SEN_ppoll_time64:
+	case SEN_pselect6_time32:
+	case SEN_pselect6_time64:
+	case SEN_select:
+#if HAVE_ARCH_OLD_MMAP
+	case SEN_old_mmap:
+# if HAVE_ARCH_OLD_MMAP_PGOFF
+	case SEN_old_mmap_pgoff:
+# endif
+#endif
+#if HAVE_ARCH_OLD_SELECT
+	case SEN_oldselect:
+#endif
+		/* Handled by pathtrace_match_set.  */
+		return false;
+	}
+
+	/*
+	 * Our fallback position for calls that haven't already
+	 * been handled is to just check arg[0].
+	 */
+
+	if (s->sys_flags & TRACE_FILE)
+		*path_args = 1 << 0;
+	else
+		*fd_args = 1 << 0;
+
+	return true;
+}
 
+/*
+ * Return true if syscall accesses a selected path
+ * (or if no paths have been specified for tracing).
+ */
+bool
+pathtrace_match_set(struct tcb *tcp, struct path_set *set,
+		    struct number_set *fdset)
+{
+	const struct_sysent *s;
+	unsigned int fd_args, path_args;
+
+	s = tcp_sysent(tcp);
+
+	if (get_match_args(s, &fd_args, &path_args)) {
+		for (unsigned int i = 0; fd_args >> i; ++i) {
+			if ((fd_args >> i) & 1 &&
+			    fdmatch(tcp, tcp->u_arg[i], set, fdset))
+				return true;
+		}
+		for (unsigned int i = 0; path_args >> i; ++i) {
+			if ((path_args >> i) & 1 &&
+			    upathmatch(tcp, tcp->u_arg[i], set))
+				return true;
+		}
+		return false;
+	}
+
+	switch (s->sen) {
+#if HAVE_ARCH_OLD_MMAP
+	case SEN_old_mmap:
+# if HAVE_ARCH_OLD_MMAP_PGOFF
+	case SEN_old_mmap_pgoff:
+# endif
+	{
+		kernel_ulong_t *args =
+			fetch_indirect_syscall_args(tcp, tcp->u_arg[0], 6);
+
+		return args && fdmatch(tcp, args[4], set, fdset);
+	}
+#endif /* HAVE_ARCH_OLD_MMAP */
 
 	case SEN_fanotify_mark:
 	{
@@ -420,47 +527,22 @@ pathtrace_match_set(struct tcb *tcp, struct path_set *set,
 
 		return false;
 	}
-
-	case SEN_bpf:
-	case SEN_epoll_create:
-	case SEN_epoll_create1:
-	case SEN_eventfd2:
-	case SEN_eventfd:
-	case SEN_fanotify_init:
-	case SEN_fsopen:
-	case SEN_inotify_init:
-	case SEN_inotify_init1:
-	case SEN_io_uring_setup:
-	case SEN_landlock_create_ruleset:
-	case SEN_memfd_create:
-	case SEN_memfd_secret:
-	case SEN_mq_open:
-	case SEN_perf_event_open:
-	case SEN_pidfd_open:
-	case SEN_pipe:
-	case SEN_pipe2:
-	case SEN_printargs:
-	case SEN_socket:
-	case SEN_socketpair:
-	case SEN_timerfd_create:
-	case SEN_userfaultfd:
-		/*
-		 * These have TRACE_FILE or TRACE_DESC or TRACE_NETWORK set,
-		 * but they don't have any file descriptor or path args to test.
-		 */
-		return false;
 	}
 
-	/*
-	 * Our fallback position for calls that haven't already
-	 * been handled is to just check arg[0].
-	 */
-
-	if (s->sys_flags & TRACE_FILE)
-		return upathmatch(tcp, tcp->u_arg[0], set);
+	return false;
+}
 
-	if (s->sys_flags & (TRACE_DESC | TRACE_NETWORK))
-		return fdmatch(tcp, tcp->u_arg[0], set, fdset);
+/*
+ * Return the mask of syscall arguments that pathtrace_match_set checks
+ * against the set of file descriptors, or -1 if the syscall is matched
+ * in some other way, e.g. using the descriptors stored in the tracee memory.
+ * Paths are not taken into account, that is, the returned mask describes
+ * the matching of a syscall when no paths are traced.
+ */
+int
+pathtrace_fd_args(const struct_sysent *s)
+{
+	unsigned int fd_args, path_args;
 
-	return false;
+	return get_match_args(s, &fd_args, &path_args) ? (int) fd_args : -1;
 }
@@ -44,6 +44,26 @@ static struct trie *proc_data_cache;
 
 static bool ns_get_parent_enotty = false;
 
+/**
+ * Whether a non-trivial translation has been requested, that is,
+ * whether new tracees are worth indexing.
+ */
+static bool translation_used;
+
+/**
+ * New tracees that are not indexed yet: the PID as present in /proc,
+ * and the bit mask of ID types the tracee is not indexed for.
+ */
+struct new_tracee {
+	int proc_pid;
+	unsigned int types;
+};
+
+#define MAX_NEW_TRACEES 4096
+
+static struct new_tracee *new_tracees;
+static size_t new_tracees_count;
+
 static const char tid_str[]  = "NSpid:\t";
 static const char tgid_str[] = "NStgid:\t";
 static const char pgid_str[] = "NSpgid:\t";
@@ -366,8 +386,12 @@ translate_id_proc_pid(struct translate_id_params *tip, int proc_pid)
 		if (ns != tip->from_ns)
 			continue;
 
-		if (ns_id != tip->from_id)
+		if (ns_id != tip->from_id) {
+			/* Fresh data, remember it for the following lookups */
+			if (proc_pid)
+				put_proc_pid(ns, ns_id, tip->type, proc_pid);
 			return;
+		}
 
 		tip->result_id = our_id;
 		tip->pd = pd;
@@ -427,6 +451,157 @@ translate_id_dir(struct translate_id_params *tip, const char *path,
 	closedir(dir);
 }
 
+/**
+ * Returns the PID (as present in /proc) of the topmost ancestor of the process
+ * proc_pid that is in the PID namespace ns, or 0 on failure.  Usually this is
+ * the init process of the namespace, but processes that entered the namespace
+ * using setns have their parents outside of it.
+ */
+static int
+find_ns_root(int proc_pid, unsigned int ns)
+{
+	static const char ppid_str[] = "PPid:\t";
+
+	while (proc_pid > 0) {
+		int ppid;
+		if (proc_status_get_id_list(proc_pid, &ppid, 1, ppid_str,
+					    sizeof(ppid_str) - 1) != 1)
+			return 0;
+		if (ppid <= 0)
+			return proc_pid;
+
+		unsigned int parent_ns;
+		if (!get_ns_hierarchy(ppid, &parent_ns, 1))
+			return 0;
+		if (parent_ns != ns)
+			return proc_pid;
+
+		proc_pid = ppid;
+	}
+
+	return 0;
+}
+
+/**
+ * Translates an id to our namespace by reading the proc entries of the threads
+ * of root_pid process and all its descendants, which are found using
+ * /proc/<pid>/task/<tid>/children files.
+ *
+ * @param tip      The parameters
+ * @param root_pid The proc pid of the process to start from.
+ */
+static void
+translate_id_subtree(struct translate_id_params *tip, int root_pid)
+{
+	int *stack = xmalloc(sizeof(*stack));
+	size_t stack_size = 1;
+	size_t stack_count = 0;
+
+	stack[stack_count++] = root_pid;
+
+	while (stack_count && !tip->result_id) {
+		const int pid = stack[--stack_count];
+		char path[PATH_MAX + 1];
+		xsprintf(path, "/proc/%d/task", pid);
+
+		DIR *dir = opendir(path);
+		if (!dir)
+			continue;
+
+		while (!tip->result_id) {
+			errno = 0;
+			struct_dirent *entry = read_dir(dir);
+			if (!entry)
+				break;
+
+			errno = 0;
+			long tid = strtol(entry->d_name, NULL, 10);
+			if (tid < 1 || tid > INT_MAX || errno)
+				continue;
+
+			translate_id_proc_pid(tip, tid);
+			if (tip->result_id)
+				break;
+
+			xsprintf(path, "/proc/%d/task/%ld/children", pid, tid);
+			FILE *fp = fopen_stream(path, "r");
+			if (!fp)
+				continue;
+
+			int child;
+			while (fscanf(fp, "%d", &child) == 1) {
+				if (stack_count == stack_size)
+					stack = xgrowarray(stack, &stack_size,
+							   sizeof(*stack));
+				stack[stack_count++] = child;
+			}
+			fclose(fp);
+		}
+
+		closedir(dir);
+	}
+
+	free(stack);
+}
+
+/**
+ * Indexes the new tracees by their ids of the specified type
+ * in all their namespaces.
+ */
+static void
+index_new_tracees(enum pid_type type)
+{
+	size_t n = 0;
+
+	for (size_t i = 0; i < new_tracees_count; ++i) {
+		struct new_tracee *t = &new_tracees[i];
+
+		if (t->types & (1U << type)) {
+			t->types &= ~(1U << type);
+
+			struct proc_data *pd = get_or_create_proc_data(t->proc_pid);
+			if (!pd || !update_proc_data(pd, type)) {
+				/* The tracee is gone */
+				continue;
+			}
+
+			const int *ids = pd->id_hierarchy[type];
+			const int id_count = pd->id_count[type];
+
+			for (int j = 0; j < pd->ns_count && j < id_count; ++j)
+				put_proc_pid(pd->ns_hierarchy[j],
+					     ids[id_count - j - 1], type,
+					     pd->proc_pid);
+		}
+
+		if (t->types)
+			new_tracees[n++] = *t;
+	}
+
+	new_tracees_count = n;
+}
+
+void
+pidns_note_tracee(int pid)
+{
+	if (!translation_used || !is_proc_ours())
+		return;
+
+	if (new_tracees_count == MAX_NEW_TRACEES) {
+		/* Forget the older half, they are left for /proc scans */
+		memmove(new_tracees, new_tracees + MAX_NEW_TRACEES / 2,
+			sizeof(*new_tracees) * (MAX_NEW_TRACEES / 2));
+		new_tracees_count = MAX_NEW_TRACEES / 2;
+	}
+	if (!new_tracees)
+		new_tracees = xcalloc(MAX_NEW_TRACEES, sizeof(*new_tracees));
+
+	new_tracees[new_tracees_count++] = (struct new_tracee) {
+		.proc_pid = pid,
+		.types = (1U << PT_COUNT) - 1,
+	};
+}
+
 /**
  * Iterator function of the proc_data_cache for id translation.
  * If the cache contains the id we are looking for, reads the corresponding
@@ -485,6 +660,8 @@ translate_pid(struct tcb *tcp, int from_id, enum pid_type type,
 	if (ns_get_parent_enotty)
 		return 0;
 
+	translation_used = true;
+
 	/* Look for a cached proc_pid for this (from_ns, from_id) pair */
 	int cached_proc_pid = get_cached_proc_pid(tip.from_ns, tip.from_id,
 		tip.type);
@@ -494,6 +671,19 @@ translate_pid(struct tcb *tcp, int from_id, enum pid_type type,
 			goto exit;
 	}
 
+	/* Index the tracees that appeared since the last lookup, and retry */
+	if (new_tracees_count) {
+		index_new_tracees(tip.type);
+
+		int proc_pid = get_cached_proc_pid(tip.from_ns, tip.from_id,
+			tip.type);
+		if (proc_pid && proc_pid != cached_proc_pid) {
+			translate_id_proc_pid(&tip, proc_pid);
+			if (tip.result_id)
+				goto exit;
+		}
+	}
+
 	/* Iterate through the cache, find potential proc_data */
 	trie_iterate_keys(proc_data_cache, 0, pid_max - 1,
 		proc_data_cache_iterator_fn, &tip);
@@ -501,7 +691,25 @@ translate_pid(struct tcb *tcp, int from_id, enum pid_type type,
 	if (tip.result_id)
 		goto exit;
 
-	/* No cache helped, read all entries in /proc */
+	/*
+	 * No cache helped, read the entries in /proc of the processes
+	 * in the namespace of the tracee, most of them are descendants
+	 * of the init process of that namespace.
+	 */
+	if (tcp) {
+		int proc_pid = 0;
+		translate_pid(NULL, tcp->pid, PT_TID, &proc_pid);
+
+		int root_pid = proc_pid ? find_ns_root(proc_pid, tip.from_ns)
+					: 0;
+		if (root_pid) {
+			translate_id_subtree(&tip, root_pid);
+			if (tip.result_id)
+				goto exit;
+		}
+	}
+
+	/* Read all entries in /proc */
 	translate_id_dir(&tip, "/proc", true);
 
 exit:
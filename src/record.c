@@ -0,0 +1,553 @@
+/*
+ * Recording of tracing events to a file and their replay.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "defs.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+
+#include "largefile_wrappers.h"
+#include "ptrace_syscall_info.h"
+#include "record.h"
+
+/*
+ * The record file consists of a header followed by entries.  Every event
+ * is stored as an entry that is followed by the entries of the data
+ * fetched from the tracee while the event was being dispatched:
+ * registers, syscall information, words of the user area, and ranges
+ * of the tracee memory.  Failed fetches are not recorded, a piece of data
+ * that is missing from the entries of an event is reported as not
+ * available when replaying.
+ *
+ * The entries preceding the first event hold the qualification flags
+ * of every system call, the data is fetched only for the system calls
+ * that are traced, verbose, or not abbreviated when recording.  These
+ * flags and the string limit the events are recorded with restrict
+ * the options the events are replayed with.
+ *
+ * The file is written by a build of strace for the same architecture,
+ * so the data is stored in the native format.
+ */
+#define RECORD_MAGIC		"STRACERC"
+#define RECORD_VERSION		2
+#define RECORD_BYTE_ORDER	0x01020304
+
+enum {
+	RECORD_SYSCALL_INFO	= 1 << 0,
+	RECORD_FOLLOWFORK	= 1 << 1,
+};
+
+struct record_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint16_t kernel_long_size;
+	uint16_t personalities;
+	uint32_t flags;
+	uint32_t max_strlen;
+	uint32_t reserved;
+	char machine[64];
+};
+
+enum {
+	RECORD_EVENT = 1,
+	RECORD_REGS,
+	RECORD_SYSCALL_INFO_DATA,
+	RECORD_PEEKUSER,
+	RECORD_MEM,
+	/* The qualification flags of the syscalls of a personality */
+	RECORD_QUAL_FLAGS,
+};
+
+/* The qualification flags that affect the data fetched from the tracee */
+#define RECORD_QUAL_MASK	(QUAL_TRACE | QUAL_ABBREV | QUAL_VERBOSE)
+
+struct record_entry {
+	uint16_t type;
+	uint16_t reserved;
+	/* Length of the data, it is padded to a multiple of 8 */
+	uint32_t len;
+	/* The address of RECORD_MEM, the offset of RECORD_PEEKUSER */
+	uint64_t addr;
+	unsigned char data[];
+};
+
+enum {
+	RECORD_EVENT_STRACE_CHILD = 1 << 0,
+};
+
+struct record_event_data {
+	int32_t pid;
+	int32_t status;
+	uint32_t te;
+	uint32_t tcb_flags;
+	uint64_t msg;
+	int64_t real_sec;
+	int64_t mono_sec;
+	uint32_t real_nsec;
+	uint32_t mono_nsec;
+	uint32_t flags;
+	uint32_t reserved;
+	/* siginfo_t of TE_SIGNAL_DELIVERY_STOP */
+	unsigned char si[];
+};
+
+bool recording;
+bool replaying;
+
+static const char *record_path;
+static FILE *record_fp;
+
+/* The mapped record file being replayed and the current position in it */
+static const char *replay_begin;
+static const char *replay_pos;
+static const char *replay_end;
+
+/* RECORD_QUAL_FLAGS entries of every personality, if any */
+static const struct record_entry *replay_qual_flags_tab[SUPPORTED_PERSONALITIES];
+
+/* The entries of the data of the event being replayed */
+static const char *stop_begin;
+static const char *stop_end;
+static struct timespec stop_ts_mono;
+
+static void
+write_entry(const unsigned int type, const uint64_t addr,
+	    const void *const data, const size_t len)
+{
+	static const char padding[8];
+	const struct record_entry e = {
+		.type = type,
+		.len = len,
+		.addr = addr,
+	};
+	const size_t pad = ROUNDUP(len, 8) - len;
+
+	if (fwrite(&e, sizeof(e), 1, record_fp) != 1 ||
+	    (len && fwrite(data, len, 1, record_fp) != 1) ||
+	    (pad && fwrite(padding, pad, 1, record_fp) != 1))
+		perror_msg_and_die("%s", record_path);
+}
+
+static size_t
+entry_size(const struct record_entry *e)
+{
+	return sizeof(*e) + ROUNDUP((size_t) e->len, 8);
+}
+
+static const struct record_entry *
+next_entry(void)
+{
+	const size_t avail = replay_end - replay_pos;
+
+	if (!avail)
+		return NULL;
+
+	const struct record_entry *e = (const void *) replay_pos;
+
+	if (avail < sizeof(*e) || entry_size(e) > avail) {
+		/* E.g. the recording strace has been killed.  */
+		error_msg("%s: malformed record at offset %zu",
+			  record_path, (size_t) (replay_pos - replay_begin));
+		replay_pos = replay_end;
+		return NULL;
+	}
+
+	replay_pos += entry_size(e);
+	return e;
+}
+
+static void
+fill_header(struct record_header *h)
+{
+	struct utsname u;
+
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, RECORD_MAGIC, sizeof(h->magic));
+	h->version = RECORD_VERSION;
+	h->byte_order = RECORD_BYTE_ORDER;
+	h->kernel_long_size = sizeof(kernel_ulong_t);
+	h->personalities = SUPPORTED_PERSONALITIES;
+	if (!uname(&u))
+		memcpy(h->machine, u.machine,
+		       strnlen(u.machine, sizeof(h->machine) - 1));
+}
+
+void
+record_open(const char *path)
+{
+	struct record_header header;
+
+	fill_header(&header);
+	header.flags = (ptrace_get_syscall_info_supported
+			? RECORD_SYSCALL_INFO : 0) |
+		       (followfork ? RECORD_FOLLOWFORK : 0);
+	header.max_strlen = max_strlen;
+
+	int fd = open_file(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+			   0644);
+	if (fd < 0)
+		perror_msg_and_die("%s", path);
+
+	record_fp = fdopen(fd, "w");
+	if (!record_fp)
+		perror_msg_and_die("fdopen");
+
+	/* Writing an entry is just a copy to the buffer most of the time.  */
+	setvbuf(record_fp, NULL, _IOFBF, 1024 * 1024);
+
+	if (fwrite(&header, sizeof(header), 1, record_fp) != 1)
+		perror_msg_and_die("%s", path);
+
+	record_path = path;
+
+	for (unsigned int pers = 0; pers < SUPPORTED_PERSONALITIES; ++pers) {
+		uint8_t *flags = xmalloc(nsyscall_vec[pers]);
+
+		for (unsigned int scno = 0; scno < nsyscall_vec[pers]; ++scno)
+			flags[scno] = qual_flags_pers(scno, pers)
+				      & RECORD_QUAL_MASK;
+		write_entry(RECORD_QUAL_FLAGS, pers, flags,
+			    nsyscall_vec[pers]);
+		free(flags);
+	}
+
+	recording = true;
+}
+
+void
+replay_open(const char *path)
+{
+	struct record_header header;
+
+	fill_header(&header);
+
+	int fd = open_file(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		perror_msg_and_die("%s", path);
+
+	strace_stat_t st;
+	if (fstat_fd(fd, &st))
+		perror_msg_and_die("fstat: %s", path);
+
+	const struct record_header *h = NULL;
+	if ((size_t) st.st_size >= sizeof(*h)) {
+		void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+				  fd, 0);
+		if (addr == MAP_FAILED)
+			perror_msg_and_die("mmap: %s", path);
+		h = addr;
+	}
+	close(fd);
+
+	if (!h || memcmp(h->magic, header.magic, sizeof(h->magic)) ||
+	    h->version != header.version ||
+	    h->byte_order != header.byte_order)
+		error_msg_and_die("%s: not a record file of this version"
+				  " of strace", path);
+
+	if (h->kernel_long_size != header.kernel_long_size ||
+	    h->personalities != header.personalities ||
+	    memcmp(h->machine, header.machine, sizeof(h->machine)))
+		error_msg_and_die("%s: recorded on %.*s, cannot be replayed"
+				  " by this build of strace",
+				  path, (int) sizeof(h->machine), h->machine);
+
+	ptrace_get_syscall_info_supported = h->flags & RECORD_SYSCALL_INFO;
+	if (h->flags & RECORD_FOLLOWFORK)
+		followfork = true;
+	/* Longer strings have not been fetched.  */
+	if (max_strlen > h->max_strlen)
+		max_strlen = h->max_strlen;
+
+	/* The mapping is used until the program exits.  */
+	replay_begin = (const char *) h;
+	replay_pos = replay_begin + sizeof(*h);
+	replay_end = replay_begin + st.st_size;
+	stop_begin = stop_end = replay_pos;
+
+	record_path = path;
+	replaying = true;
+
+	for (;;) {
+		const char *pos = replay_pos;
+		const struct record_entry *e = next_entry();
+
+		if (!e)
+			break;
+		if (e->type == RECORD_EVENT) {
+			replay_pos = pos;
+			break;
+		}
+		if (e->type == RECORD_QUAL_FLAGS &&
+		    e->addr < SUPPORTED_PERSONALITIES)
+			replay_qual_flags_tab[e->addr] = e;
+	}
+}
+
+void
+record_event(const struct record_event *ev)
+{
+	const struct record_event_data d = {
+		.pid = ev->pid,
+		.status = ev->status,
+		.te = ev->te,
+		.tcb_flags = ev->tcb_flags,
+		.msg = ev->msg,
+		.real_sec = ev->ts_real.tv_sec,
+		.mono_sec = ev->ts_mono.tv_sec,
+		.real_nsec = ev->ts_real.tv_nsec,
+		.mono_nsec = ev->ts_mono.tv_nsec,
+		.flags = ev->strace_child ? RECORD_EVENT_STRACE_CHILD : 0,
+	};
+	char buf[sizeof(d) + sizeof(ev->si)];
+	size_t len = sizeof(d);
+
+	memcpy(buf, &d, sizeof(d));
+	if (ev->te == TE_SIGNAL_DELIVERY_STOP) {
+		memcpy(buf + len, &ev->si, sizeof(ev->si));
+		len += sizeof(ev->si);
+	}
+
+	write_entry(RECORD_EVENT, 0, buf, len);
+}
+
+void
+record_regs(const void *buf, size_t len)
+{
+	write_entry(RECORD_REGS, 0, buf, len);
+}
+
+void
+record_syscall_info(const void *buf, size_t len)
+{
+	write_entry(RECORD_SYSCALL_INFO_DATA, 0, buf, len);
+}
+
+void
+record_peekuser(unsigned long off, kernel_ulong_t val)
+{
+	write_entry(RECORD_PEEKUSER, off, &val, sizeof(val));
+}
+
+void
+record_mem(kernel_ulong_t addr, const void *buf, unsigned int len)
+{
+	write_entry(RECORD_MEM, addr, buf, len);
+}
+
+bool
+replay_next_event(struct record_event *ev)
+{
+	const struct record_entry *e;
+
+	/* The entries preceding the first event are not used.  */
+	do {
+		e = next_entry();
+		if (!e)
+			return false;
+	} while (e->type != RECORD_EVENT);
+
+	const struct record_event_data *d = (const void *) e->data;
+
+	if (e->len < sizeof(*d)) {
+		error_msg("%s: malformed event at offset %zu", record_path,
+			  (size_t) ((const char *) e - replay_begin));
+		return false;
+	}
+
+	memset(ev, 0, sizeof(*ev));
+	ev->pid = d->pid;
+	ev->status = d->status;
+	ev->te = d->te;
+	ev->tcb_flags = d->tcb_flags;
+	ev->strace_child = d->flags & RECORD_EVENT_STRACE_CHILD;
+	ev->msg = d->msg;
+	ev->ts_real.tv_sec = d->real_sec;
+	ev->ts_real.tv_nsec = d->real_nsec;
+	ev->ts_mono.tv_sec = d->mono_sec;
+	ev->ts_mono.tv_nsec = d->mono_nsec;
+	if (e->len >= sizeof(*d) + sizeof(ev->si))
+		memcpy(&ev->si, d->si, sizeof(ev->si));
+
+	/* Collect the entries of the data up to the next event.  */
+	stop_begin = replay_pos;
+	for (;;) {
+		const char *pos = replay_pos;
+
+		e = next_entry();
+		if (!e)
+			break;
+		if (e->type == RECORD_EVENT) {
+			replay_pos = pos;
+			break;
+		}
+	}
+	stop_end = replay_pos;
+	stop_ts_mono = ev->ts_mono;
+
+	return true;
+}
+
+static const struct record_entry *
+find_entry(const unsigned int type, const uint64_t addr)
+{
+	for (const char *p = stop_begin; p < stop_end;) {
+		const struct record_entry *e = (const void *) p;
+
+		if (e->type == type && e->addr == addr)
+			return e;
+		p += entry_size(e);
+	}
+
+	errno = ESRCH;
+	return NULL;
+}
+
+int
+replay_regs(void *buf, size_t *len)
+{
+	const struct record_entry *e = find_entry(RECORD_REGS, 0);
+
+	if (!e)
+		return -1;
+	if (e->len > *len) {
+		errno = ESRCH;
+		return -1;
+	}
+
+	memcpy(buf, e->data, e->len);
+	*len = e->len;
+	return 0;
+}
+
+int
+replay_syscall_info(void *buf, size_t len)
+{
+	const struct record_entry *e =
+		find_entry(RECORD_SYSCALL_INFO_DATA, 0);
+
+	if (!e)
+		return -1;
+
+	memset(buf, 0, len);
+	memcpy(buf, e->data, MIN(len, e->len));
+	return 0;
+}
+
+int
+replay_peekuser(unsigned long off, kernel_ulong_t *val)
+{
+	const struct record_entry *e = find_entry(RECORD_PEEKUSER, off);
+
+	if (!e)
+		return -1;
+	if (e->len != sizeof(*val)) {
+		errno = ESRCH;
+		return -1;
+	}
+
+	memcpy(val, e->data, sizeof(*val));
+	return 0;
+}
+
+/*
+ * Copy as much of the memory starting at addr as the recorded ranges
+ * cover contiguously, return the number of bytes copied.
+ */
+static unsigned int
+replay_mem(kernel_ulong_t addr, unsigned int len, void *laddr)
+{
+	unsigned int done = 0;
+
+	while (done < len) {
+		const kernel_ulong_t cur = addr + done;
+		const struct record_entry *best = NULL;
+		uint64_t best_avail = 0;
+
+		for (const char *p = stop_begin; p < stop_end;) {
+			const struct record_entry *e = (const void *) p;
+
+			p += entry_size(e);
+			if (e->type != RECORD_MEM || cur < e->addr ||
+			    cur - e->addr >= e->len)
+				continue;
+
+			const uint64_t avail = e->len - (cur - e->addr);
+			if (avail > best_avail) {
+				best = e;
+				best_avail = avail;
+			}
+		}
+
+		if (!best)
+			break;
+
+		const unsigned int n = MIN(len - done, best_avail);
+		memcpy(laddr + done, best->data + (cur - best->addr), n);
+		done += n;
+	}
+
+	return done;
+}
+
+unsigned int
+replay_qual_flags(const unsigned int scno, const unsigned int pers,
+		  const unsigned int flags)
+{
+	const struct record_entry *e = replay_qual_flags_tab[pers];
+
+	if (!e || scno >= e->len)
+		return flags;
+
+	const unsigned int recorded = e->data[scno];
+
+	/*
+	 * A syscall that was not traced or not verbose when recording
+	 * cannot be decoded in full, one that was abbreviated cannot
+	 * be printed unabbreviated.
+	 */
+	return (flags & ~((QUAL_TRACE | QUAL_VERBOSE) & ~recorded)) |
+	       (recorded & QUAL_ABBREV);
+}
+
+int
+replay_umoven(kernel_ulong_t addr, unsigned int len, void *laddr)
+{
+	if (replay_mem(addr, len, laddr) == len)
+		return 0;
+
+	errno = ESRCH;
+	return -1;
+}
+
+int
+replay_umovestr(kernel_ulong_t addr, unsigned int len, char *laddr)
+{
+	const unsigned int n = replay_mem(addr, len, laddr);
+	const char *nul = memchr(laddr, '\0', n);
+
+	if (nul)
+		return nul - laddr + 1;
+	if (n == len)
+		return 0;
+
+	errno = ESRCH;
+	return -1;
+}
+
+void
+get_event_time(struct timespec *ts)
+{
+	if (replaying)
+		*ts = stop_ts_mono;
+	else
+		clock_gettime(CLOCK_MONOTONIC, ts);
+}
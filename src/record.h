@@ -0,0 +1,91 @@
+/*
+ * Recording of tracing events to a file and their replay.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef STRACE_RECORD_H
+# define STRACE_RECORD_H
+
+# include "defs.h"
+# include <signal.h>
+# include "trace_event.h"
+
+/* Whether --record or --replay is in effect.  */
+extern bool recording;
+extern bool replaying;
+
+struct record_event {
+	int pid;
+	int status;
+	enum trace_event te;
+	/* The flags of the tcb if it is seen for the first time, 0 otherwise */
+	unsigned int tcb_flags;
+	/* Whether the tcb is the one of the program started by strace */
+	bool strace_child;
+	unsigned long msg;
+	struct timespec ts_real;
+	struct timespec ts_mono;
+	/* Only valid for TE_SIGNAL_DELIVERY_STOP */
+	siginfo_t si;
+};
+
+/*
+ * Create the record file and write its header.
+ * Dies if the file cannot be created.
+ */
+extern void record_open(const char *path);
+
+/*
+ * Map the record file and check its header.
+ * Dies if the file was not recorded by a compatible build of strace.
+ */
+extern void replay_open(const char *path);
+
+/*
+ * Every event is followed by the data fetched from the tracee
+ * while the event was being dispatched.
+ */
+extern void record_event(const struct record_event *);
+
+/*
+ * Read the next recorded event and make the data recorded along with it
+ * available to the replay_* functions below.  Returns false at the end
+ * of the file.
+ */
+extern bool replay_next_event(struct record_event *);
+
+extern void record_regs(const void *buf, size_t len);
+extern void record_syscall_info(const void *buf, size_t len);
+extern void record_peekuser(unsigned long off, kernel_ulong_t val);
+extern void record_mem(kernel_ulong_t addr, const void *buf, unsigned int len);
+
+/*
+ * Restrict the qualification flags of syscall SCNO of personality PERS
+ * to the data fetched when recording.
+ */
+extern unsigned int replay_qual_flags(unsigned int scno, unsigned int pers,
+				      unsigned int flags);
+
+/*
+ * The replay_* functions behave like the tracee had gone if the data
+ * has not been recorded: they return -1 and set errno to ESRCH.
+ */
+extern int replay_regs(void *buf, size_t *len);
+extern int replay_syscall_info(void *buf, size_t len);
+extern int replay_peekuser(unsigned long off, kernel_ulong_t *val);
+/* Same return values as umoven.  */
+extern int replay_umoven(kernel_ulong_t addr, unsigned int len, void *laddr);
+/* Same return values as umovestr.  */
+extern int replay_umovestr(kernel_ulong_t addr, unsigned int len, char *laddr);
+
+/*
+ * Get the CLOCK_MONOTONIC time, or the time of the current event
+ * when replaying.
+ */
+extern void get_event_time(struct timespec *);
+
+#endif /* !STRACE_RECORD_H */
@@ -0,0 +1,143 @@
+/*
+ * Sampling of the traced system calls in periodic time windows.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "defs.h"
+#include "sample.h"
+
+/*
+ * The tracing time is split into alternating windows: while the window
+ * is open, the tracees are stopped on system calls as usual, while it
+ * is closed, they are restarted with PTRACE_CONT instead of
+ * PTRACE_SYSCALL and are not stopped on system calls.
+ */
+static struct timespec sample_on;
+static struct timespec sample_off;
+
+static timer_t sample_timer = (timer_t) -1;
+static bool sample_window_open = true;
+/* CLOCK_MONOTONIC time when the first window was opened.  */
+static struct timespec sample_start_ts;
+/* CLOCK_MONOTONIC time of the next switch between the windows.  */
+static struct timespec sample_next_ts;
+
+int
+set_sample_window(const char *str)
+{
+	const char *const sep = strchr(str, '/');
+
+	if (!sep)
+		return -1;
+
+	char *const on = xstrndup(str, sep - str);
+	const int rc = parse_ts(on, &sample_on);
+	free(on);
+
+	if (rc < 0 || !ts_nz(&sample_on) ||
+	    parse_ts(sep + 1, &sample_off) < 0 || !ts_nz(&sample_off))
+		return -1;
+
+	return 0;
+}
+
+bool
+is_sampling_enabled(void)
+{
+	return ts_nz(&sample_on);
+}
+
+bool
+is_sample_window_open(void)
+{
+	return sample_window_open;
+}
+
+static void
+arm_sample_timer(void)
+{
+	const struct itimerspec its = {
+		.it_value = sample_next_ts,
+	};
+
+	if (timer_settime(sample_timer, TIMER_ABSTIME, &its, NULL))
+		perror_msg_and_die("timer_settime");
+}
+
+void
+start_sample_timer(void)
+{
+	if (!is_sampling_enabled())
+		return;
+
+	struct timespec ts_now;
+	clock_gettime(CLOCK_MONOTONIC, &ts_now);
+	sample_start_ts = ts_now;
+	ts_add(&sample_next_ts, &ts_now, &sample_on);
+
+	if (timer_create(CLOCK_MONOTONIC, NULL, &sample_timer))
+		perror_msg_and_die("timer_create");
+	arm_sample_timer();
+}
+
+bool
+is_sample_timer_armed(void)
+{
+	return sample_timer != (timer_t) -1;
+}
+
+bool
+sample_timer_expired(void)
+{
+	if (!is_sample_timer_armed())
+		return false;
+
+	struct timespec ts_now;
+	clock_gettime(CLOCK_MONOTONIC, &ts_now);
+	if (ts_cmp(&ts_now, &sample_next_ts) < 0)
+		return false;
+
+	const bool was_open = sample_window_open;
+
+	/* Skip the windows that have been missed, if any.  */
+	do {
+		sample_window_open = !sample_window_open;
+		ts_add(&sample_next_ts, &sample_next_ts,
+		       sample_window_open ? &sample_on : &sample_off);
+	} while (ts_cmp(&ts_now, &sample_next_ts) >= 0);
+
+	arm_sample_timer();
+
+	debug_func_msg("sample window %s",
+		       sample_window_open ? "opened" : "closed");
+
+	return !was_open && sample_window_open;
+}
+
+double
+sample_scale(void)
+{
+	if (!is_sample_timer_armed())
+		return 1.0;
+
+	struct timespec ts_now, ts_elapsed;
+	clock_gettime(CLOCK_MONOTONIC, &ts_now);
+	ts_sub(&ts_elapsed, &ts_now, &sample_start_ts);
+
+	/*
+	 * The windows are opened at fixed times since the start,
+	 * so the time they have been open so far follows from
+	 * the time elapsed.
+	 */
+	const double on = ts_float(&sample_on);
+	const double period = on + ts_float(&sample_off);
+	const double elapsed = ts_float(&ts_elapsed);
+	const uint64_t periods = elapsed / period;
+	const double open = periods * on + MIN(elapsed - periods * period, on);
+
+	return open > 0 ? elapsed / open : 1.0;
+}
@@ -0,0 +1,45 @@
+/*
+ * Sampling of the traced system calls in periodic time windows.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef STRACE_SAMPLE_H
+# define STRACE_SAMPLE_H
+
+/*
+ * Parse the ON/OFF argument of --sample-window option.
+ * Returns -1 if it is invalid.
+ */
+extern int set_sample_window(const char *);
+
+/* Whether --sample-window is in effect.  */
+extern bool is_sampling_enabled(void);
+
+/*
+ * Whether the tracees are to be stopped on system calls now.
+ * Always true without --sample-window.
+ */
+extern bool is_sample_window_open(void);
+
+extern void start_sample_timer(void);
+extern bool is_sample_timer_armed(void);
+
+/*
+ * Handle the expiration of the sample timer, if any.
+ * Returns true iff the window has just been opened.
+ */
+extern bool sample_timer_expired(void);
+
+/*
+ * The factor the counts collected in the open windows are to be
+ * multiplied by to estimate the counts of the whole tracing time:
+ * the time elapsed since the start divided by the time the windows
+ * have been open.
+ */
+extern double sample_scale(void);
+
+#endif /* !STRACE_SAMPLE_H */
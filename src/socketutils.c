@@ -24,28 +24,138 @@
 # define UNIX_PATH_MAX sizeof_field(struct sockaddr_un, sun_path)
 #endif
 
+#include "fd_path_cache.h"
+#include "sample.h"
+#include "sen.h"
 #include "xstring.h"
 
 #define XLAT_MACROS_ONLY
 #include "xlat/inet_protocols.h"
 #undef XLAT_MACROS_ONLY
 
+/*
+ * Open addressing hash table of socket details, keyed by inode.
+ * Socket inodes are allocated from a single counter of sockfs, so they
+ * are unique across network namespaces.  Collisions are resolved by
+ * linear probing, and removal is done by backward shifting.
+ * The table size is a power of 2 and is kept at least twice as large
+ * as the number of entries.
+ *
+ * inet_diag and netlink_diag do not support lookups by inode, so the
+ * details of every socket of a dump are cached.  The entries added by
+ * a dump, or by SOCKET_CACHE_GEN_MIN lookups of unix sockets, form
+ * a generation, an entry that is seen again moves to the current one.
+ * When a new generation starts, the entries of the generation that
+ * started SOCKET_CACHE_GENS generations before are evicted, so the cache
+ * holds the sockets seen by the recent dumps, however many there are.
+ */
+#define SOCKET_CACHE_GENS	32
+#define SOCKET_CACHE_GEN_MIN	1024
+
 typedef struct {
 	unsigned long inode;
 	char *details;
+	unsigned int gen;
 } cache_entry;
 
-#define CACHE_SIZE 1024U
-static cache_entry cache[CACHE_SIZE];
-#define CACHE_MASK (CACHE_SIZE - 1)
+static cache_entry *cache;
+static size_t cache_size;
+static size_t cache_count;
+static unsigned int cache_gen;
+/* The number of entries of every generation */
+static size_t cache_gen_count[SOCKET_CACHE_GENS];
+
+static size_t
+cache_hash(const unsigned long inode)
+{
+	return ((uint64_t) inode * 0x9e3779b97f4a7c15ULL >> 32)
+	       & (cache_size - 1);
+}
+
+static cache_entry *
+cache_find(const unsigned long inode)
+{
+	if (!cache_count)
+		return NULL;
+
+	for (size_t i = cache_hash(inode); cache[i].inode;
+	     i = (i + 1) & (cache_size - 1)) {
+		if (cache[i].inode == inode)
+			return &cache[i];
+	}
+
+	return NULL;
+}
+
+static void
+cache_insert(const cache_entry *const e)
+{
+	size_t i = cache_hash(e->inode);
+
+	while (cache[i].inode)
+		i = (i + 1) & (cache_size - 1);
+	cache[i] = *e;
+}
+
+/*
+ * Reallocate the table for COUNT entries, dropping the entries
+ * of generation DROP_GEN modulo SOCKET_CACHE_GENS, if it is not -1.
+ */
+static void
+resize_cache(const size_t count, const int drop_gen)
+{
+	const size_t old_size = cache_size;
+	cache_entry *const old_cache = cache;
+
+	for (cache_size = 256; count * 2 > cache_size; cache_size *= 2)
+		;
+	cache = xcalloc(cache_size, sizeof(*cache));
+
+	for (size_t i = 0; i < old_size; ++i) {
+		if (!old_cache[i].inode)
+			continue;
+		if ((int) (old_cache[i].gen % SOCKET_CACHE_GENS) == drop_gen) {
+			free(old_cache[i].details);
+			continue;
+		}
+		cache_insert(&old_cache[i]);
+	}
+	free(old_cache);
+}
+
+static void
+start_cache_gen(void)
+{
+	const unsigned int idx = ++cache_gen % SOCKET_CACHE_GENS;
+
+	if (cache_gen_count[idx]) {
+		cache_count -= cache_gen_count[idx];
+		cache_gen_count[idx] = 0;
+		resize_cache(cache_count, idx);
+	}
+}
 
 static int
 cache_inode_details(const unsigned long inode, char *const details)
 {
-	cache_entry *e = &cache[inode & CACHE_MASK];
-	free(e->details);
-	e->inode = inode;
-	e->details = details;
+	cache_entry *const e = cache_find(inode);
+
+	if (e) {
+		free(e->details);
+		e->details = details;
+		--cache_gen_count[e->gen % SOCKET_CACHE_GENS];
+		e->gen = cache_gen;
+	} else {
+		if ((cache_count + 1) * 2 > cache_size)
+			resize_cache(cache_count + 1, -1);
+		cache_insert(&(cache_entry) {
+			.inode = inode,
+			.details = details,
+			.gen = cache_gen,
+		});
+		++cache_count;
+	}
+	++cache_gen_count[cache_gen % SOCKET_CACHE_GENS];
 
 	return 1;
 }
@@ -53,8 +163,38 @@ cache_inode_details(const unsigned long inode, char *const details)
 static const char *
 get_sockaddr_by_inode_cached(const unsigned long inode)
 {
-	const cache_entry *const e = &cache[inode & CACHE_MASK];
-	return (e && inode == e->inode) ? e->details : NULL;
+	const cache_entry *const e = cache_find(inode);
+	return e ? e->details : NULL;
+}
+
+static void
+invalidate_inode_details(const unsigned long inode)
+{
+	const size_t mask = cache_size - 1;
+	cache_entry *const e = cache_find(inode);
+
+	if (!e)
+		return;
+
+	free(e->details);
+	--cache_gen_count[e->gen % SOCKET_CACHE_GENS];
+	--cache_count;
+
+	/*
+	 * Move back the entries of the probe sequence that follows
+	 * the removed one unless they are already at their home slots.
+	 */
+	size_t i = e - cache;
+	for (size_t j = (i + 1) & mask; cache[j].inode; j = (j + 1) & mask) {
+		const size_t home = cache_hash(cache[j].inode);
+
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			cache[i] = cache[j];
+			i = j;
+		}
+	}
+	cache[i].inode = 0;
+	cache[i].details = NULL;
 }
 
 static bool
@@ -106,6 +246,10 @@ inet_send_query(struct tcb *tcp, const int fd, const int family,
 	return send_query(tcp, fd, &req, sizeof(req));
 }
 
+/*
+ * inet_diag does not support lookups by inode, so the whole table
+ * of sockets is dumped, and the details of every socket are cached.
+ */
 static int
 inet_parse_response(const void *const data, const int data_len,
 		    const unsigned long inode, void *opaque_data)
@@ -117,7 +261,8 @@ inet_parse_response(const void *const data, const int data_len,
 
 	if (data_len < (int) NLMSG_LENGTH(sizeof(*diag_msg)))
 		return -1;
-	if (diag_msg->idiag_inode != inode)
+	/* Sockets in TIME_WAIT and NEW_SYN_RECV states have no inode.  */
+	if (!diag_msg->idiag_inode)
 		return 0;
 
 	switch (diag_msg->idiag_family) {
@@ -164,7 +309,8 @@ inet_parse_response(const void *const data, const int data_len,
 			return false;
 	}
 
-	return cache_inode_details(inode, details);
+	cache_inode_details(diag_msg->idiag_inode, details);
+	return 0;
 }
 
 static bool
@@ -347,6 +493,7 @@ netlink_send_query(struct tcb *tcp, const int fd, const unsigned long inode)
 	return send_query(tcp, fd, &req, sizeof(req));
 }
 
+/* Like inet_diag, netlink_diag is queried for the whole table.  */
 static int
 netlink_parse_response(const void *data, const int data_len,
 		       const unsigned long inode, void *opaque_data)
@@ -358,7 +505,7 @@ netlink_parse_response(const void *data, const int data_len,
 
 	if (data_len < (int) NLMSG_LENGTH(sizeof(*diag_msg)))
 		return -1;
-	if (diag_msg->ndiag_ino != inode)
+	if (!diag_msg->ndiag_ino)
 		return 0;
 
 	if (diag_msg->ndiag_family != AF_NETLINK)
@@ -378,13 +525,18 @@ netlink_parse_response(const void *data, const int data_len,
 			return -1;
 	}
 
-	return cache_inode_details(inode, details);
+	cache_inode_details(diag_msg->ndiag_ino, details);
+	return 0;
 }
 
 static const char *
 unix_get(struct tcb *tcp, const int fd, const int family, const int proto,
 	 const unsigned long inode, const char *name)
 {
+	if (cache_gen_count[cache_gen % SOCKET_CACHE_GENS]
+	    >= SOCKET_CACHE_GEN_MIN)
+		start_cache_gen();
+
 	return unix_send_query(tcp, fd, inode)
 		&& receive_responses(tcp, fd, inode, SOCK_DIAG_BY_FAMILY,
 				     unix_parse_response, (void *) name)
@@ -395,21 +547,24 @@ static const char *
 inet_get(struct tcb *tcp, const int fd, const int family, const int protocol,
 	 const unsigned long inode, const char *proto_name)
 {
-	return inet_send_query(tcp, fd, family, protocol)
-		&& receive_responses(tcp, fd, inode, SOCK_DIAG_BY_FAMILY,
-				     inet_parse_response, (void *) proto_name)
-		? get_sockaddr_by_inode_cached(inode) : NULL;
+	if (!inet_send_query(tcp, fd, family, protocol))
+		return NULL;
+	start_cache_gen();
+	receive_responses(tcp, fd, inode, SOCK_DIAG_BY_FAMILY,
+			  inet_parse_response, (void *) proto_name);
+	return get_sockaddr_by_inode_cached(inode);
 }
 
 static const char *
 netlink_get(struct tcb *tcp, const int fd, const int family, const int protocol,
 	    const unsigned long inode, const char *proto_name)
 {
-	return netlink_send_query(tcp, fd, inode)
-		&& receive_responses(tcp, fd, inode, SOCK_DIAG_BY_FAMILY,
-				     netlink_parse_response,
-				     (void *) proto_name)
-		? get_sockaddr_by_inode_cached(inode) : NULL;
+	if (!netlink_send_query(tcp, fd, inode))
+		return NULL;
+	start_cache_gen();
+	receive_responses(tcp, fd, inode, SOCK_DIAG_BY_FAMILY,
+			  netlink_parse_response, (void *) proto_name);
+	return get_sockaddr_by_inode_cached(inode);
 }
 
 static const struct {
@@ -544,11 +699,68 @@ const char *
 get_sockaddr_by_inode(struct tcb *const tcp, const int fd,
 		      const unsigned long inode)
 {
+	/*
+	 * With --sample-window, the socket may have been bound or connected
+	 * by syscalls that were not seen.
+	 */
+	if (is_sampling_enabled())
+		invalidate_inode_details(inode);
+
 	const char *details = get_sockaddr_by_inode_cached(inode);
 	return details ? details :
 		get_sockaddr_by_inode_uncached(tcp, inode, getfdproto(tcp, fd));
 }
 
+/*
+ * Cached details are of no use after the socket is closed or shut down.
+ * The inodes of sockets are not reused soon, so the entries of the sockets
+ * that are not known to be cached are left to be evicted with their
+ * generation instead of looking up the inodes of all the descriptors
+ * being closed.
+ */
+void
+socket_cache_syscall_enter(struct tcb *const tcp)
+{
+	char path[sizeof("socket:[]") + sizeof(long) * 3];
+
+	if (!cache_count)
+		return;
+
+	switch (tcp_sysent(tcp)->sen) {
+	case SEN_close:
+	case SEN_shutdown:
+		if (fd_path_cache_lookup(tcp->pid, tcp->u_arg[0],
+					 path, sizeof(path)) >= 0) {
+			const unsigned long inode =
+				get_inode_of_socket_path(path);
+
+			if (inode)
+				invalidate_inode_details(inode);
+		}
+		break;
+	}
+}
+
+/* Addresses of the socket change when it is bound or connected.  */
+void
+socket_cache_syscall_exit(struct tcb *const tcp)
+{
+	if (!cache_count)
+		return;
+
+	switch (tcp_sysent(tcp)->sen) {
+	case SEN_bind:
+	case SEN_connect:
+	case SEN_listen: {
+		const unsigned long inode = getfdinode(tcp, tcp->u_arg[0]);
+
+		if (inode)
+			invalidate_inode_details(inode);
+		break;
+	}
+	}
+}
+
 /*
  * Managing the cache for decoding communications of Netlink GENERIC protocol
  *
@@ -1,7 +1,7 @@
 /*
  * Copyright (c) 2017 Intel Corporation
  * Copyright (c) 2019 Paul Chaignon <paul.chaignon@gmail.com>
- * Copyright (c) 2019-2023 The strace developers.
+ * Copyright (c) 2019-2026 The strace developers.
  * All rights reserved.
  *
  * SPDX-License-Identifier: LGPL-2.1-or-later
@@ -16,22 +16,45 @@
 #include "defs.h"
 
 struct staged_output_data {
+	FILE *memf;
 	char *memfptr;
 	size_t memfloc;
 	FILE *real_outf;	/* Backup for real outf while staging */
+	struct staged_output_data *next;
 };
 
+/*
+ * Staging buffers larger than this are not kept for reuse.
+ */
+#define STAGED_OUTPUT_KEEP_SIZE 65536
+
+/*
+ * Staging buffers that are not in use.  Opening a memstream and closing it
+ * on every syscall costs a few allocations and the stdio stream setup,
+ * so memstreams are not closed after use but rewound and kept here.
+ */
+static struct staged_output_data *free_staged_output_data;
+
 FILE *
 strace_open_memstream(struct tcb *tcp)
 {
 	FILE *fp = NULL;
 
 #ifdef HAVE_OPEN_MEMSTREAM
-	tcp->staged_output_data = xmalloc(sizeof(*tcp->staged_output_data));
-	fp = open_memstream(&tcp->staged_output_data->memfptr,
-			    &tcp->staged_output_data->memfloc);
-	if (!fp)
-		perror_msg_and_die("open_memstream");
+	struct staged_output_data *data = free_staged_output_data;
+
+	if (data) {
+		free_staged_output_data = data->next;
+		fp = data->memf;
+	} else {
+		data = xzalloc(sizeof(*data));
+		fp = open_memstream(&data->memfptr, &data->memfloc);
+		if (!fp)
+			perror_msg_and_die("open_memstream");
+		data->memf = fp;
+	}
+	tcp->staged_output_data = data;
+
 	/*
 	 * Call to fflush required to update tcp->memfptr,
 	 * see open_memstream man page.
@@ -39,7 +62,7 @@ strace_open_memstream(struct tcb *tcp)
 	fflush(fp);
 
 	/* Store the FILE pointer for later restoration. */
-	tcp->staged_output_data->real_outf = tcp->outf;
+	data->real_outf = tcp->outf;
 	tcp->outf = fp;
 #endif
 
@@ -50,27 +73,241 @@ void
 strace_close_memstream(struct tcb *tcp, bool publish)
 {
 #ifdef HAVE_OPEN_MEMSTREAM
-	if (!tcp->staged_output_data) {
+	struct staged_output_data *data = tcp->staged_output_data;
+
+	if (!data) {
 		debug_msg("memstream already closed");
 		return;
 	}
 
-	if (fclose(tcp->outf))
-		perror_msg("fclose(tcp->outf)");
+	/* The buffer and its size are updated by fflush.  */
+	if (fflush(data->memf))
+		perror_msg("fflush(tcp->outf)");
 
-	tcp->outf = tcp->staged_output_data->real_outf;
-	if (tcp->staged_output_data->memfptr) {
+	tcp->outf = data->real_outf;
+	if (data->memfptr && data->memfloc) {
 		if (publish)
-			fputs_unlocked(tcp->staged_output_data->memfptr,
-				       tcp->outf);
+			fwrite(data->memfptr, 1, data->memfloc, tcp->outf);
 		else
-			debug_msg("syscall output dropped: %s",
-				  tcp->staged_output_data->memfptr);
-
-		free(tcp->staged_output_data->memfptr);
-		tcp->staged_output_data->memfptr = NULL;
+			debug_msg("syscall output dropped: %.*s",
+				  (int) MIN(data->memfloc, INT_MAX),
+				  data->memfptr);
 	}
-	free(tcp->staged_output_data);
 	tcp->staged_output_data = NULL;
+
+	if (data->memfloc <= STAGED_OUTPUT_KEEP_SIZE &&
+	    fseeko(data->memf, 0, SEEK_SET) == 0) {
+		data->next = free_staged_output_data;
+		free_staged_output_data = data;
+		return;
+	}
+
+	if (fclose(data->memf))
+		perror_msg("fclose(tcp->outf)");
+	free(data->memfptr);
+	free(data);
 #endif
 }
+
+/*
+ * In flight recorder mode the output of tracees is written to a memstream,
+ * and its contents are moved on every flush to a ring buffer
+ * of flight_recorder_size bytes, overwriting the oldest output.
+ * The ring buffer is written to the real output file only when
+ * a trigger fires.  All tcbs writing to the same output file share
+ * the same flight recorder.
+ */
+struct flight_recorder_data {
+	FILE *memf;
+	char *memfptr;
+	size_t memfloc;
+	FILE *real_outf;
+	char *ring;
+	size_t ring_pos;	/* Where the next byte is stored */
+	size_t ring_len;	/* How many bytes are stored */
+	bool ring_overwritten;	/* Whether some output has been lost */
+	struct flight_recorder_data *prev;
+	struct flight_recorder_data *next;
+};
+
+unsigned int flight_recorder_size;
+
+/* All flight recorders, for flushing them at once.  */
+static struct flight_recorder_data *flight_recorders;
+
+static struct flight_recorder_data *shared_flight_recorder;
+
+void
+flight_recorder_open(struct tcb *tcp)
+{
+#ifdef HAVE_OPEN_MEMSTREAM
+	struct flight_recorder_data *data =
+		output_separately ? NULL : shared_flight_recorder;
+
+	if (!data) {
+		data = xzalloc(sizeof(*data));
+		data->memf = open_memstream(&data->memfptr, &data->memfloc);
+		if (!data->memf)
+			perror_msg_and_die("open_memstream");
+		data->real_outf = tcp->outf;
+		data->ring = xmalloc(flight_recorder_size);
+
+		data->next = flight_recorders;
+		if (flight_recorders)
+			flight_recorders->prev = data;
+		flight_recorders = data;
+
+		if (!output_separately)
+			shared_flight_recorder = data;
+	}
+
+	tcp->flight_recorder_data = data;
+	tcp->outf = data->memf;
+#endif
+}
+
+static void
+ring_append(struct flight_recorder_data *data, const char *buf, size_t len)
+{
+	const size_t size = flight_recorder_size;
+
+	if (data->ring_len + len > size)
+		data->ring_overwritten = true;
+
+	if (len >= size) {
+		memcpy(data->ring, buf + len - size, size);
+		data->ring_pos = 0;
+		data->ring_len = size;
+		return;
+	}
+
+	const size_t tail = size - data->ring_pos;
+
+	if (len < tail) {
+		memcpy(data->ring + data->ring_pos, buf, len);
+		data->ring_pos += len;
+	} else {
+		memcpy(data->ring + data->ring_pos, buf, tail);
+		memcpy(data->ring, buf + tail, len - tail);
+		data->ring_pos = len - tail;
+	}
+	data->ring_len = MIN(data->ring_len + len, size);
+}
+
+/* Move the contents of the memstream to the ring buffer.  */
+static void
+commit(struct flight_recorder_data *data)
+{
+	if (fflush(data->memf))
+		perror_msg("fflush(tcp->outf)");
+	if (!data->memfloc)
+		return;
+
+	ring_append(data, data->memfptr, data->memfloc);
+
+	if (fseeko(data->memf, 0, SEEK_SET))
+		perror_msg("fseeko(tcp->outf)");
+}
+
+void
+flight_recorder_commit(const struct tcb *tcp)
+{
+	if (tcp->flight_recorder_data)
+		commit(tcp->flight_recorder_data);
+}
+
+static void
+flush(struct flight_recorder_data *data)
+{
+	commit(data);
+
+	/* The oldest output is right after the newest one if the ring is full. */
+	const bool full = data->ring_len == flight_recorder_size;
+	const char *part[2] = {
+		data->ring + (full ? data->ring_pos : 0),
+		data->ring
+	};
+	size_t part_len[2] = {
+		full ? flight_recorder_size - data->ring_pos : data->ring_len,
+		full ? data->ring_pos : 0
+	};
+
+	/* Skip the partially overwritten oldest line.  */
+	for (unsigned int i = 0; data->ring_overwritten && i < 2; ++i) {
+		const char *nl = memchr(part[i], '\n', part_len[i]);
+
+		if (nl) {
+			part_len[i] -= nl + 1 - part[i];
+			part[i] = nl + 1;
+			break;
+		}
+		part_len[i] = 0;
+	}
+
+	for (unsigned int i = 0; i < 2; ++i)
+		fwrite(part[i], 1, part_len[i], data->real_outf);
+
+	if (fflush(data->real_outf))
+		perror_msg("fflush");
+
+	data->ring_pos = 0;
+	data->ring_len = 0;
+	data->ring_overwritten = false;
+}
+
+void
+flight_recorder_flush(const struct tcb *tcp)
+{
+	if (tcp->flight_recorder_data)
+		flush(tcp->flight_recorder_data);
+}
+
+void
+flight_recorder_flush_all(void)
+{
+	for (struct flight_recorder_data *data = flight_recorders; data;
+	     data = data->next)
+		flush(data);
+}
+
+static void
+free_flight_recorder(struct flight_recorder_data *data)
+{
+	if (data->prev)
+		data->prev->next = data->next;
+	else
+		flight_recorders = data->next;
+	if (data->next)
+		data->next->prev = data->prev;
+
+	if (fclose(data->memf))
+		perror_msg("fclose(tcp->outf)");
+	free(data->memfptr);
+	free(data->ring);
+	free(data);
+}
+
+FILE *
+flight_recorder_close(struct tcb *tcp)
+{
+	struct flight_recorder_data *data = tcp->flight_recorder_data;
+	FILE *real_outf = data->real_outf;
+
+	tcp->flight_recorder_data = NULL;
+	tcp->outf = real_outf;
+
+	if (data != shared_flight_recorder)
+		free_flight_recorder(data);
+
+	return real_outf;
+}
+
+void
+flight_recorder_close_shared(void)
+{
+	if (!shared_flight_recorder)
+		return;
+
+	free_flight_recorder(shared_flight_recorder);
+	shared_flight_recorder = NULL;
+}
@@ -30,11 +30,14 @@
 
 #include "kill_save_errno.h"
 #include "exitkill.h"
+#include "fd_path_cache.h"
 #include "filter_seccomp.h"
 #include "largefile_wrappers.h"
 #include "mmap_cache.h"
 #include "number_set.h"
 #include "ptrace_syscall_info.h"
+#include "record.h"
+#include "sample.h"
 #include "scno.h"
 #include "printsiginfo.h"
 #include "strauss.h"
@@ -70,6 +73,8 @@ static const unsigned int syscall_trap_sig = SIGTRAP | 0x80;
 cflag_t cflag = CFLAG_NONE;
 bool followfork;
 bool output_separately;
+bool stage_syscall_output;
+bool defer_entry_decoding;
 static unsigned int ptrace_setoptions =
 	PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEEXEC | PTRACE_O_TRACEEXIT;
 static const struct xlat_data xflag_str[] = {
@@ -174,15 +179,39 @@ struct tcb_wait_data {
 	int status;          /**< status, returned by wait4() */
 	unsigned long msg;   /**< Value returned by PTRACE_GETEVENTMSG */
 	siginfo_t si;        /**< siginfo, returned by PTRACE_GETSIGINFO */
+	struct timespec ts_real; /**< CLOCK_REALTIME of the event, for -t */
+	struct timespec ts_mono; /**< CLOCK_MONOTONIC of the event, for -r */
 };
 
 static struct tcb **tcbtab;
 static unsigned int nprocs;
 static size_t tcbtabsize;
 
+/*
+ * Stack of unused TCBs, so that alloctcb does not have to scan tcbtab.
+ * It has room for all tcbtabsize entries.
+ */
+static struct tcb **free_tcbs;
+static size_t free_tcbs_cnt;
+
+/*
+ * Open addressing hash table of TCBs in use, keyed by pid.
+ * Collisions are resolved by linear probing, and removal is done
+ * by backward shifting, so no tombstones are needed.  The table size
+ * is a power of 2 and is kept at least twice as large as tcbtabsize.
+ */
+static struct tcb **pid2tcb_tab;
+static size_t pid2tcb_tab_size;
+
 static struct tcb_wait_data *tcb_wait_tab;
 static size_t tcb_wait_tab_size;
 
+/*
+ * Wait data of the event being dispatched, its timestamps taken
+ * when the event was harvested are printed by printleader.
+ */
+static const struct tcb_wait_data *current_wait_data;
+
 
 #ifndef HAVE_PROGRAM_INVOCATION_NAME
 char *program_invocation_name;
@@ -195,11 +224,14 @@ unsigned os_release; /* generated from uname()'s u.release */
 static void detach(struct tcb *tcp);
 static void cleanup(int sig);
 static void interrupt(int sig);
+static void request_flight_recorder_flush(int sig);
 
 #ifdef HAVE_SIG_ATOMIC_T
 static volatile sig_atomic_t interrupted, restart_failed;
+static volatile sig_atomic_t flight_recorder_flush_requested;
 #else
 static volatile int interrupted, restart_failed;
+static volatile int flight_recorder_flush_requested;
 #endif
 
 static sigset_t timer_set;
@@ -300,7 +332,7 @@ Usage: strace [-ACdffhi" K_OPT "qqrtttTvVwxxyyzZ] [-I N] [-b execve] [-e EXPR]..
 General:\n\
   -e EXPR        a qualifying expression: OPTION=[!]all or OPTION=[!]VAL1[,VAL2]...\n\
      options:    trace, abbrev, verbose, raw, signal, read, write, fault,\n\
-                 inject, status, quiet, kvm, decode-fds" SECONTEXT_E_QUAL "\n\
+                 inject, status, trigger, quiet, kvm, decode-fds" SECONTEXT_E_QUAL "\n\
 \n\
 Startup:\n\
   -E VAR=VAL, --env=VAR=VAL\n\
@@ -336,6 +368,10 @@ Tracing:\n\
      4, never_tstp: fatal signals and SIGTSTP (^Z) are always blocked\n\
                     (useful to make 'strace -o FILE PROG' not stop on ^Z)\n\
   --kill-on-exit kill all tracees if strace is killed\n\
+  --record=FILE  write the tracing events and the data fetched from tracees\n\
+                 to FILE for a later --replay\n\
+  --replay=FILE  decode the tracing events recorded to FILE instead of\n\
+                 tracing processes\n\
 \n\
 Filtering:\n\
   -e trace=[!][?]{{SYSCALL|GROUP|all|/REGEX}[@64|@32|@x32]|none},\n\
@@ -358,6 +394,8 @@ Filtering:\n\
                  print only syscalls that returned without an error code\n\
   -Z, --failed-only\n\
                  print only syscalls that returned with an error code\n\
+  --sample-window=ON/OFF\n\
+                 stop on syscalls only for ON out of every ON+OFF time\n\
 \n\
 Output format:\n\
   -a COLUMN, --columns=COLUMN\n\
@@ -419,6 +457,16 @@ Output format:\n\
                  obtain no more than this amount of frames\n\
                  when backtracing a syscall (default %d)\n\
 "
+# ifdef USE_LIBDW
+"\
+  --stack-trace-deferred\n\
+                 resolve symbols of stack traces after the tracee\n\
+                 is resumed\n\
+  --stack-trace-symbol-cache=file\n\
+                 keep the symbols resolved by -k in file and reuse them\n\
+                 in subsequent runs\n\
+"
+# endif
 #endif
 "\
   -n, --syscall-number\n\
@@ -429,6 +477,12 @@ Output format:\n\
                  open the file provided in the -o option in append mode\n\
   --output-separately\n\
                  output into separate files (by appending pid to file names)\n\
+  --flight-recorder=SIZE\n\
+                 keep the last SIZE bytes of output in memory and write them\n\
+                 only on a signal, process exit, trigger, or SIGUSR1\n\
+  -e trigger=SET[:error=ERRNO], --trigger=SET[:error=ERRNO]\n\
+                 write the --flight-recorder output when a syscall in SET\n\
+                 fails (with ERRNO)\n\
   -q, --quiet=attach,personality\n\
                  suppress messages about attaching, detaching, etc.\n\
   -qq, --quiet=attach,personality,exit\n\
@@ -486,12 +540,18 @@ Statistics:\n\
      units:      one of s, ms, us, ns; default is microseconds\n\
   -S SORTBY, --summary-sort-by=SORTBY\n\
                  sort syscall counts by: time, min-time, max-time, avg-time,\n\
-                 calls, errors, name, nothing (default %s)\n\
+                 p50-time, p90-time, p99-time, p999-time, calls, errors,\n\
+                 name, nothing (default %s)\n\
   -U COLUMNS, --summary-columns=COLUMNS\n\
                  show specific columns in the summary report: comma-separated\n\
                  list of time-percent, total-time, min-time, max-time, \n\
-                 avg-time, calls, errors, name\n\
+                 avg-time, p50-time, p90-time, p99-time, p999-time, calls,\n\
+                 errors, name\n\
                  (default time-percent,total-time,avg-time,calls,errors,name)\n\
+  --summary-interval=INTERVAL\n\
+                 print the summary for every INTERVAL of time\n\
+  --summary-format=FORMAT\n\
+                 summary format: text (default), json\n\
   -w, --summary-wall-clock\n\
                  summarise syscall latency (default is system time)\n\
 \n\
@@ -520,10 +580,15 @@ Miscellaneous:\n\
   -d, --debug    enable debug output to stderr\n\
   -h, --help     print help message\n\
   --seccomp-bpf  enable seccomp-bpf filtering\n\
+  --seccomp-bpf-profile=FILE\n\
+                 optimize seccomp-bpf filter for syscall counts\n\
+                 reported by -c in FILE\n\
   --tips[=[[id:]ID][,[format:]FORMAT]]\n\
                  show strace tips, tricks, and tweaks on exit\n\
      id:         non-negative integer or random; default is random\n\
      format:     none, compact, full; default is compact\n\
+  --tracee-memory-cache=PAGES\n\
+                 cache up to PAGES pages of tracee memory (default %u)\n\
   -V, --version  print version\n\
 "
 /* ancient, no one should use it
@@ -533,7 +598,7 @@ Miscellaneous:\n\
 #ifdef ENABLE_STACKTRACE
  DEFAULT_STACK_TRACE_FRAME_LIMIT,
 #endif
- DEFAULT_STRLEN, DEFAULT_SORTBY);
+ DEFAULT_STRLEN, DEFAULT_SORTBY, DEFAULT_UMOVE_CACHE_SIZE);
 	exit(0);
 
 #undef K_OPT
@@ -599,6 +664,10 @@ ptrace_restart(const unsigned int op, struct tcb *const tcp, unsigned int sig)
 {
 	int err;
 
+	/* There is no tracee to restart.  */
+	if (replaying)
+		return 0;
+
 	errno = 0;
 	ptrace(op, tcp->pid, 0L, (unsigned long) sig);
 	err = errno;
@@ -811,6 +880,7 @@ flush_tcp_output(const struct tcb *const tcp)
 {
 	if (fflush(tcp->outf))
 		outf_perror(tcp);
+	flight_recorder_commit(tcp);
 }
 
 void
@@ -847,6 +917,40 @@ print_comm_str(const char *str, const size_t len)
 	tprint_associated_info_end();
 }
 
+/*
+ * Print `val' in decimal, padded with `pad' characters to `width',
+ * into `buf', returns the end of the output.
+ */
+static char *
+sprint_padded_ulong(char *buf, unsigned long val, unsigned int width,
+		    const char pad)
+{
+	char digits[sizeof(val) * 3];
+	unsigned int n = 0;
+
+	do {
+		digits[n++] = '0' + val % 10;
+		val /= 10;
+	} while (val);
+
+	for (; width > n; --width)
+		*buf++ = pad;
+	while (n)
+		*buf++ = digits[--n];
+
+	return buf;
+}
+
+/* Get the CLOCK_REALTIME time of the event being dispatched.  */
+void
+get_event_real_time(struct timespec *ts)
+{
+	if (current_wait_data)
+		*ts = current_wait_data->ts_real;
+	else
+		clock_gettime(CLOCK_REALTIME, ts);
+}
+
 void
 printleader(struct tcb *tcp)
 {
@@ -904,42 +1008,79 @@ printleader(struct tcb *tcp)
 
 	if (tflag_format) {
 		struct timespec ts;
-		clock_gettime(CLOCK_REALTIME, &ts);
 
-		time_t local = ts.tv_sec;
-		char str[MAX(sizeof("HH:MM:SS"), sizeof(local) * 3)];
-		struct tm *tm = localtime(&local);
-
-		if (tm)
-			strftime(str, sizeof(str), tflag_format, tm);
-		else
-			xsprintf(str, "%lld", (long long) local);
-		if (tflag_width)
-			tprintf_string("%s.%0*ld ", str, tflag_width,
-				       (long) ts.tv_nsec / tflag_scale);
+		if (tcp->flags & TCB_DEFERRED_ENTRY)
+			ts = tcp->deferred_entry_ts;
 		else
-			tprintf_string("%s ", str);
+			get_event_real_time(&ts);
+
+		/*
+		 * The formatted time changes once a second at most,
+		 * format it again only when the second changes.
+		 */
+		static char str[MAX(sizeof("HH:MM:SS"), sizeof(time_t) * 3)];
+		static time_t str_sec;
+		static bool str_valid;
+
+		if (!str_valid || str_sec != ts.tv_sec) {
+			time_t local = ts.tv_sec;
+			struct tm *tm = localtime(&local);
+
+			if (tm)
+				strftime(str, sizeof(str), tflag_format, tm);
+			else
+				xsprintf(str, "%lld", (long long) local);
+			str_sec = ts.tv_sec;
+			str_valid = true;
+		}
+
+		char buf[sizeof(str) + sizeof(".nnnnnnnnn ")];
+		char *p = stpcpy(buf, str);
+
+		if (tflag_width) {
+			*p++ = '.';
+			p = sprint_padded_ulong(p, ts.tv_nsec / tflag_scale,
+						tflag_width, '0');
+		}
+		strcpy(p, " ");
+		tprints_string(buf);
 	}
 
 	if (rflag) {
 		struct timespec ts;
-		clock_gettime(CLOCK_MONOTONIC, &ts);
+
+		if (current_wait_data)
+			ts = current_wait_data->ts_mono;
+		else
+			clock_gettime(CLOCK_MONOTONIC, &ts);
 
 		static struct timespec ots;
 		if (ots.tv_sec == 0 && ots.tv_nsec == 0)
 			ots = ts;
 
+		/*
+		 * Events are not always dispatched in the order
+		 * they were harvested in, do not go back in time.
+		 */
+		if (ts_cmp(&ts, &ots) < 0)
+			ts = ots;
+
 		struct timespec dts;
 		ts_sub(&dts, &ts, &ots);
 		ots = ts;
 
-		tprintf_string("%s%6ld",
-			       tflag_format ? "(+" : "", (long) dts.tv_sec);
+		char buf[sizeof("(+") + sizeof(long) * 3 +
+			 sizeof(".nnnnnnnnn) ")];
+		char *p = stpcpy(buf, tflag_format ? "(+" : "");
+
+		p = sprint_padded_ulong(p, dts.tv_sec, 6, ' ');
 		if (rflag_width) {
-			tprintf_string(".%0*ld", rflag_width,
-				       (long) dts.tv_nsec / rflag_scale);
+			*p++ = '.';
+			p = sprint_padded_ulong(p, dts.tv_nsec / rflag_scale,
+						rflag_width, '0');
 		}
-		tprints_string(tflag_format ? ") " : " ");
+		strcpy(p, tflag_format ? ") " : " ");
+		tprints_string(buf);
 	}
 
 	if (nflag)
@@ -970,6 +1111,8 @@ after_successful_attach(struct tcb *tcp, const unsigned int flags)
 		xsprintf(name, "%s.%u", outfname, tcp->pid);
 		tcp->outf = strace_fopen(name);
 	}
+	if (flight_recorder_size)
+		flight_recorder_open(tcp);
 
 #ifdef ENABLE_STACKTRACE
 	if (stack_trace_mode)
@@ -977,6 +1120,69 @@ after_successful_attach(struct tcb *tcp, const unsigned int flags)
 #endif
 }
 
+static size_t
+pid2tcb_hash(const int pid)
+{
+	return ((unsigned int) pid * 2654435761U) & (pid2tcb_tab_size - 1);
+}
+
+static void
+pid2tcb_insert(struct tcb *const tcp)
+{
+	size_t i = pid2tcb_hash(tcp->pid);
+
+	while (pid2tcb_tab[i])
+		i = (i + 1) & (pid2tcb_tab_size - 1);
+	pid2tcb_tab[i] = tcp;
+}
+
+static void
+pid2tcb_remove(const struct tcb *const tcp)
+{
+	const size_t mask = pid2tcb_tab_size - 1;
+	size_t i = pid2tcb_hash(tcp->pid);
+
+	while (pid2tcb_tab[i] != tcp) {
+		if (!pid2tcb_tab[i])
+			error_func_msg_and_die("pid %d is not in the table",
+					       tcp->pid);
+		i = (i + 1) & mask;
+	}
+
+	/*
+	 * Move back the entries of the probe sequence that follows
+	 * the removed one unless they are already at their home slots.
+	 */
+	for (size_t j = (i + 1) & mask; pid2tcb_tab[j]; j = (j + 1) & mask) {
+		const size_t home = pid2tcb_hash(pid2tcb_tab[j]->pid);
+
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			pid2tcb_tab[i] = pid2tcb_tab[j];
+			i = j;
+		}
+	}
+	pid2tcb_tab[i] = NULL;
+}
+
+static void
+expand_pid2tcb_tab(void)
+{
+	size_t old_size = pid2tcb_tab_size;
+	struct tcb **old_tab = pid2tcb_tab;
+
+	while (pid2tcb_tab_size < tcbtabsize * 2)
+		pid2tcb_tab_size = pid2tcb_tab_size ? pid2tcb_tab_size * 2 : 64;
+	if (pid2tcb_tab_size == old_size)
+		return;
+
+	pid2tcb_tab = xcalloc(pid2tcb_tab_size, sizeof(pid2tcb_tab[0]));
+	for (size_t i = 0; i < old_size; ++i) {
+		if (old_tab[i])
+			pid2tcb_insert(old_tab[i]);
+	}
+	free(old_tab);
+}
+
 static void
 expand_tcbtab(void)
 {
@@ -992,11 +1198,18 @@ expand_tcbtab(void)
 
 	tcbtab = xgrowarray(tcbtab, &tcbtabsize, sizeof(tcbtab[0]));
 	newtcbs = xcalloc(tcbtabsize - old_tcbtabsize, sizeof(newtcbs[0]));
+	free_tcbs = xreallocarray(free_tcbs, tcbtabsize, sizeof(free_tcbs[0]));
 
 	for (struct tcb **tcb_ptr = tcbtab + old_tcbtabsize;
 	     tcb_ptr < tcbtab + tcbtabsize;
 	     ++tcb_ptr, ++newtcbs)
 		*tcb_ptr = newtcbs;
+
+	/* Push the new TCBs so that the lowest one is reused first. */
+	for (size_t i = tcbtabsize; i > old_tcbtabsize; --i)
+		free_tcbs[free_tcbs_cnt++] = tcbtab[i - 1];
+
+	expand_pid2tcb_tab();
 }
 
 static char *
@@ -1051,26 +1264,23 @@ alloctcb(int pid)
 	if (nprocs == tcbtabsize)
 		expand_tcbtab();
 
-	for (size_t i = 0; i < tcbtabsize; ++i) {
-		struct tcb *tcp = tcbtab[i];
-		if (!tcp->pid) {
-			memset(tcp, 0, sizeof(*tcp));
-			list_init(&tcp->wait_list);
-			tcp->pid = pid;
-			maybe_load_task_comm(tcp);
+	struct tcb *tcp = free_tcbs[--free_tcbs_cnt];
+
+	memset(tcp, 0, sizeof(*tcp));
+	list_init(&tcp->wait_list);
+	tcp->pid = pid;
+	pid2tcb_insert(tcp);
+	pidns_note_tracee(pid);
+	maybe_load_task_comm(tcp);
 #if SUPPORTED_PERSONALITIES > 1
-			tcp->currpers = current_personality;
+	tcp->currpers = current_personality;
 #endif
 #ifdef ENABLE_SECONTEXT
-			tcp->last_dirfd = AT_FDCWD;
+	tcp->last_dirfd = AT_FDCWD;
 #endif
-			nprocs++;
-			debug_msg("new tcb for pid %d, active tcbs:%d",
-				  tcp->pid, nprocs);
-			return tcp;
-		}
-	}
-	error_msg_and_die("bug in alloctcb");
+	nprocs++;
+	debug_msg("new tcb for pid %d, active tcbs:%d", tcp->pid, nprocs);
+	return tcp;
 }
 
 void *
@@ -1135,12 +1345,16 @@ droptcb(struct tcb *tcp)
 	if (tcp->mmap_cache)
 		tcp->mmap_cache->free_fn(tcp, __func__);
 
+	fd_path_cache_free(tcp);
+
+	undelay_tcb(tcp);
+
 	nprocs--;
 	debug_msg("dropped tcb for pid %d, %d remain", tcp->pid, nprocs);
 
 	if (tcp->outf) {
 		bool publish = true;
-		if (!is_complete_set(status_set, NUMBER_OF_STATUSES)) {
+		if (stage_syscall_output) {
 			publish = is_number_in_set(STATUS_DETACHED, status_set);
 			strace_close_memstream(tcp, publish);
 		}
@@ -1148,6 +1362,8 @@ droptcb(struct tcb *tcp)
 		if (output_separately) {
 			if (tcp->curcol != 0 && publish)
 				fprintf(tcp->outf, " <detached ...>\n");
+			if (tcp->flight_recorder_data)
+				tcp->outf = flight_recorder_close(tcp);
 			fclose(tcp->outf);
 		} else {
 			if (printing_tcp == tcp && tcp->curcol != 0 && publish)
@@ -1162,8 +1378,10 @@ droptcb(struct tcb *tcp)
 		printing_tcp = NULL;
 
 	list_remove(&tcp->wait_list);
+	pid2tcb_remove(tcp);
 
 	memset(tcp, 0, sizeof(*tcp));
+	free_tcbs[free_tcbs_cnt++] = tcp;
 }
 
 static void
@@ -2272,9 +2490,15 @@ init(int argc, char *argv[])
 	int tflag_short = 0;
 	bool columns_set = false;
 	bool sortby_set = false;
+	bool summary_interval_set = false;
+	bool summary_format_set = false;
 	bool opt_kill_on_exit = false;
+	const char *record_file = NULL;
+	const char *replay_file = NULL;
 #ifdef ENABLE_STACKTRACE
 	int stack_trace_frame_limit = 0;
+	bool stack_trace_deferred = false;
+	const char *stack_trace_symbol_cache = NULL;
 #endif
 
 	/*
@@ -2345,7 +2569,17 @@ init(int argc, char *argv[])
 		GETOPT_TIPS,
 		GETOPT_ARGV0,
 		GETOPT_STACK_TRACE_FRAME_LIMIT,
+		GETOPT_STACK_TRACE_DEFERRED,
+		GETOPT_STACK_TRACE_SYMBOL_CACHE,
 		GETOPT_ALWAYS_SHOW_PID,
+		GETOPT_UMOVE_CACHE_SIZE,
+		GETOPT_SECCOMP_PROFILE,
+		GETOPT_SUMMARY_INTERVAL,
+		GETOPT_SUMMARY_FORMAT,
+		GETOPT_RECORD,
+		GETOPT_REPLAY,
+		GETOPT_FLIGHT_RECORDER,
+		GETOPT_SAMPLE_WINDOW,
 
 		GETOPT_QUAL_TRACE,
 		GETOPT_QUAL_TRACE_FD,
@@ -2364,6 +2598,7 @@ init(int argc, char *argv[])
 		GETOPT_QUAL_DECODE_FD,
 		GETOPT_QUAL_DECODE_PID,
 		GETOPT_QUAL_SECONTEXT,
+		GETOPT_QUAL_TRIGGER,
 	};
 	static const struct option longopts[] = {
 		{ "columns",		required_argument, 0, 'a' },
@@ -2386,6 +2621,8 @@ init(int argc, char *argv[])
 		{ "stack-trace" ,	optional_argument, 0, GETOPT_STACK },
 		{ "stack-traces" ,	optional_argument, 0, GETOPT_STACK },
 		{ "stack-trace-frame-limit", required_argument, 0, GETOPT_STACK_TRACE_FRAME_LIMIT },
+		{ "stack-trace-deferred", no_argument, 0, GETOPT_STACK_TRACE_DEFERRED },
+		{ "stack-trace-symbol-cache", required_argument, 0, GETOPT_STACK_TRACE_SYMBOL_CACHE },
 		{ "syscall-limit",	required_argument, 0, GETOPT_SYSCALL_LIMIT },
 		{ "syscall-number",	no_argument,	   0, 'n' },
 		{ "output",		required_argument, 0, 'o' },
@@ -2400,6 +2637,8 @@ init(int argc, char *argv[])
 		{ "syscall-times",	optional_argument, 0, 'T' },
 		{ "user",		required_argument, 0, 'u' },
 		{ "summary-columns",	required_argument, 0, 'U' },
+		{ "summary-interval",	required_argument, 0, GETOPT_SUMMARY_INTERVAL },
+		{ "summary-format",	required_argument, 0, GETOPT_SUMMARY_FORMAT },
 		{ "no-abbrev",		no_argument,	   0, 'v' },
 		{ "version",		no_argument,	   0, 'V' },
 		{ "summary-wall-clock", no_argument,	   0, 'w' },
@@ -2410,9 +2649,15 @@ init(int argc, char *argv[])
 		{ "failed-only",	no_argument,	   0, 'Z' },
 		{ "failing-only",	no_argument,	   0, 'Z' },
 		{ "seccomp-bpf",	no_argument,	   0, GETOPT_SECCOMP },
+		{ "seccomp-bpf-profile", required_argument, 0, GETOPT_SECCOMP_PROFILE },
 		{ "tips",		optional_argument, 0, GETOPT_TIPS },
 		{ "argv0",		required_argument, 0, GETOPT_ARGV0 },
 		{ "always-show-pid",	no_argument,	   0, GETOPT_ALWAYS_SHOW_PID },
+		{ "tracee-memory-cache", required_argument, 0, GETOPT_UMOVE_CACHE_SIZE },
+		{ "record",		required_argument, 0, GETOPT_RECORD },
+		{ "replay",		required_argument, 0, GETOPT_REPLAY },
+		{ "flight-recorder",	required_argument, 0, GETOPT_FLIGHT_RECORDER },
+		{ "sample-window",	required_argument, 0, GETOPT_SAMPLE_WINDOW },
 
 		{ "trace",	required_argument, 0, GETOPT_QUAL_TRACE },
 		{ "trace-fds",	required_argument, 0, GETOPT_QUAL_TRACE_FD },
@@ -2433,6 +2678,7 @@ init(int argc, char *argv[])
 		{ "decode-fds",	optional_argument, 0, GETOPT_QUAL_DECODE_FD },
 		{ "decode-pids",required_argument, 0, GETOPT_QUAL_DECODE_PID },
 		{ "secontext",	optional_argument, 0, GETOPT_QUAL_SECONTEXT },
+		{ "trigger",	required_argument, 0, GETOPT_QUAL_TRIGGER },
 
 		{ 0, 0, 0, 0 }
 	};
@@ -2582,6 +2828,26 @@ init(int argc, char *argv[])
 					  "(--stack-trace-frame-limit "
 					  "option) are not supported "
 					  "by this build of strace");
+#endif
+			break;
+		case GETOPT_STACK_TRACE_DEFERRED:
+#ifdef USE_LIBDW
+			stack_trace_deferred = true;
+#else
+			error_msg_and_die("Deferred stack traces "
+					  "(--stack-trace-deferred option) "
+					  "are not supported by this build "
+					  "of strace");
+#endif
+			break;
+		case GETOPT_STACK_TRACE_SYMBOL_CACHE:
+#ifdef USE_LIBDW
+			stack_trace_symbol_cache = optarg;
+#else
+			error_msg_and_die("Stack trace symbol cache "
+					  "(--stack-trace-symbol-cache option) "
+					  "is not supported by this build "
+					  "of strace");
 #endif
 			break;
 		case GETOPT_KILL_ON_EXIT:
@@ -2647,6 +2913,16 @@ init(int argc, char *argv[])
 			columns_set = true;
 			set_count_summary_columns(optarg);
 			break;
+		case GETOPT_SUMMARY_INTERVAL:
+			if (set_summary_interval(optarg) < 0)
+				error_opt_arg(c, lopt, optarg);
+			summary_interval_set = true;
+			break;
+		case GETOPT_SUMMARY_FORMAT:
+			if (set_summary_format(optarg) < 0)
+				error_opt_arg(c, lopt, optarg);
+			summary_format_set = true;
+			break;
 		case 'v':
 			qualify_abbrev("none");
 			break;
@@ -2697,6 +2973,9 @@ init(int argc, char *argv[])
 		case GETOPT_SECCOMP:
 			seccomp_filtering = true;
 			break;
+		case GETOPT_SECCOMP_PROFILE:
+			seccomp_bpf_profile = optarg;
+			break;
 		case GETOPT_SYSCALL_LIMIT:
 			syscall_limit = string_to_ulonglong(optarg);
 			if (syscall_limit <= 0)
@@ -2712,6 +2991,28 @@ init(int argc, char *argv[])
 		case GETOPT_ALWAYS_SHOW_PID:
 			always_show_pid = true;
 			break;
+		case GETOPT_UMOVE_CACHE_SIZE:
+			i = string_to_uint(optarg);
+			if (i < 0 || i > MAX_UMOVE_CACHE_SIZE)
+				error_opt_arg(c, lopt, optarg);
+			umove_cache_size = i;
+			break;
+		case GETOPT_RECORD:
+			record_file = optarg;
+			break;
+		case GETOPT_REPLAY:
+			replay_file = optarg;
+			break;
+		case GETOPT_FLIGHT_RECORDER:
+			i = string_to_uint(optarg);
+			if (i <= 0)
+				error_opt_arg(c, lopt, optarg);
+			flight_recorder_size = i;
+			break;
+		case GETOPT_SAMPLE_WINDOW:
+			if (set_sample_window(optarg) < 0)
+				error_opt_arg(c, lopt, optarg);
+			break;
 		case GETOPT_QUAL_SECONTEXT:
 			qualify_secontext(optarg ? optarg : secontext_qual);
 			break;
@@ -2763,6 +3064,9 @@ init(int argc, char *argv[])
 		case GETOPT_QUAL_DECODE_PID:
 			qualify_decode_pid(optarg);
 			break;
+		case GETOPT_QUAL_TRIGGER:
+			qualify_trigger(optarg);
+			break;
 		default:
 			error_msg_and_help(NULL);
 			break;
@@ -2777,7 +3081,7 @@ init(int argc, char *argv[])
 	argv += optind;
 	argc -= optind;
 
-	if (argc < 0 || (!nprocs && !argc)) {
+	if (argc < 0 || (!nprocs && !argc && !replay_file)) {
 		if (show_tips != TIPS_NONE) {
 			print_totd();
 			exit(exit_code);
@@ -2917,6 +3221,16 @@ init(int argc, char *argv[])
 			  " (-c/--summary-only or -C/--summary)");
 	}
 
+	if (summary_interval_set && !cflag) {
+		error_msg_and_help("--summary-interval must be given with"
+				   " (-c/--summary-only or -C/--summary)");
+	}
+
+	if (summary_format_set && !cflag) {
+		error_msg("--summary-format has no effect without"
+			  " (-c/--summary-only or -C/--summary)");
+	}
+
 	if (cflag == CFLAG_ONLY_STATS) {
 		if (iflag)
 			error_msg("-i/--instruction-pointer has no effect "
@@ -2958,14 +3272,94 @@ init(int argc, char *argv[])
 #ifndef HAVE_OPEN_MEMSTREAM
 	if (!is_complete_set(status_set, NUMBER_OF_STATUSES))
 		error_msg_and_help("open_memstream is required to use -z, -Z, or -e status");
+	if (flight_recorder_size)
+		error_msg_and_help("open_memstream is required to use --flight-recorder");
 #endif
 
+	if (has_flight_recorder_triggers() && !flight_recorder_size)
+		error_msg("-e trigger has no effect without --flight-recorder");
+
+	const char *const untraced_trigger =
+		get_untraced_flight_recorder_trigger();
+	if (untraced_trigger)
+		error_msg_and_help("-e trigger: system call %s is not traced",
+				   untraced_trigger);
+
+	stage_syscall_output = flight_recorder_size ||
+			       !is_complete_set(status_set, NUMBER_OF_STATUSES);
+
+	/*
+	 * When the output is filtered by the return status only
+	 * to be successful or failed, decoding of syscall entries
+	 * can be deferred until it is known whether they are printed.
+	 * The output that depends on the time of decoding other than
+	 * the timestamp taken on syscall entry and the output that
+	 * is printed without a syscall exit rule this out.
+	 */
+	defer_entry_decoding = stage_syscall_output && !flight_recorder_size
+		&& !is_number_in_set(STATUS_UNFINISHED, status_set)
+		&& !is_number_in_set(STATUS_UNAVAILABLE, status_set)
+		&& !is_number_in_set(STATUS_DETACHED, status_set)
+		&& !rflag && !iflag && !stack_trace_mode
+		&& number_set_array_is_empty(decode_fd_set, 0)
+#ifdef ENABLE_SECONTEXT
+		&& number_set_array_is_empty(secontext_set, 0)
+#endif
+		&& !record_file && !replay_file;
+
 	if (zflags > 1)
 		error_msg("Only the last of "
 			  "-z/--successful-only/-Z/--failed-only options will "
 			  "take effect. "
 			  "See status qualifier for more complex filters.");
 
+	if (record_file && replay_file)
+		error_msg_and_help("--record and --replay are mutually exclusive");
+
+	if (replay_file) {
+		/*
+		 * Reject the options that need the tracees themselves
+		 * or the information that is not recorded.
+		 */
+		const char *opt = NULL;
+
+		if (argc || nprocs)
+			opt = "PROG [ARGS] or -p PID";
+		else if (username)
+			opt = "-u/--user";
+		else if (detach_on_execve)
+			opt = "-b/--detach-on";
+		else if (seccomp_filtering)
+			opt = "--seccomp-bpf";
+		else if (opt_kill_on_exit)
+			opt = "--kill-on-exit";
+		else if (is_sampling_enabled())
+			opt = "--sample-window";
+		else if (cflag)
+			opt = "-c/--summary-only or -C/--summary";
+		else if (stack_trace_mode)
+			opt = "-k/--stack-trace";
+		else if (pathtrace.count)
+			opt = "-P/--trace-path";
+		else if (!number_set_array_is_empty(decode_fd_set, 0))
+			opt = "-y/--decode-fds";
+		else if (!number_set_array_is_empty(decode_pid_set, 0))
+			opt = "-Y/--decode-pids";
+#ifdef ENABLE_SECONTEXT
+		else if (!number_set_array_is_empty(secontext_set, 0))
+			opt = "--secontext";
+#endif
+
+		for (unsigned int p = 0; !opt && p < SUPPORTED_PERSONALITIES;
+		     ++p) {
+			if (inject_vec[p])
+				opt = "-e inject/-e fault";
+		}
+
+		if (opt)
+			error_msg_and_help("%s cannot be used with --replay", opt);
+	}
+
 	for (size_t cnt = 0; cnt < pathtrace.count; ++cnt)
 		pathtrace_select(pathtrace.paths[cnt].path);
 	free(pathtrace.paths);
@@ -2982,10 +3376,18 @@ init(int argc, char *argv[])
 			stack_trace_frame_limit =
 				DEFAULT_STACK_TRACE_FRAME_LIMIT;
 		unwind_init(stack_trace_mode == STACK_TRACE_WITH_SRCINFO,
-			    stack_trace_frame_limit);
-	} else if (stack_trace_frame_limit != 0) {
-		error_msg("--stack-trace-frame-limit has no effect "
-			  "without -k/--stack-trace");
+			    stack_trace_frame_limit, stack_trace_deferred,
+			    stack_trace_symbol_cache);
+	} else {
+		if (stack_trace_frame_limit != 0)
+			error_msg("--stack-trace-frame-limit has no effect "
+				  "without -k/--stack-trace");
+		if (stack_trace_deferred)
+			error_msg("--stack-trace-deferred has no effect "
+				  "without -k/--stack-trace");
+		if (stack_trace_symbol_cache)
+			error_msg("--stack-trace-symbol-cache has no effect "
+				  "without -k/--stack-trace");
 	}
 #endif
 
@@ -3041,8 +3443,21 @@ init(int argc, char *argv[])
 	}
 
 	debug_msg("ptrace_setoptions = %#x", ptrace_setoptions);
-	test_ptrace_seize();
-	test_ptrace_get_syscall_info();
+	if (replay_file) {
+		replay_open(replay_file);
+	} else {
+		test_ptrace_seize();
+		test_ptrace_get_syscall_info();
+		/*
+		 * The tracees are interrupted when the sample window
+		 * opens.
+		 */
+		if (is_sampling_enabled() && !use_seize)
+			error_msg_and_die("--sample-window requires"
+					  " PTRACE_SEIZE support");
+		if (record_file)
+			record_open(record_file);
+	}
 
 	/*
 	 * Is something weird with our stdin and/or stdout -
@@ -3095,7 +3510,7 @@ init(int argc, char *argv[])
 
 	if (daemonized_tracer && !opt_intr)
 		opt_intr = INTR_BLOCK_TSTP_TOO;
-	if (outfname && argc) {
+	if (outfname && (argc || replay_file)) {
 		if (!opt_intr)
 			opt_intr = INTR_NEVER;
 		if (!qflag_short && !quiet_set_updated)
@@ -3154,11 +3569,18 @@ init(int argc, char *argv[])
 		set_sighandler(SIGTERM, interactive ? interrupt : SIG_IGN, NULL);
 	}
 
+	if (flight_recorder_size)
+		set_sighandler(SIGUSR1, request_flight_recorder_flush, NULL);
+
 	sigemptyset(&timer_set);
 	sigaddset(&timer_set, SIGALRM);
 	sigprocmask(SIG_BLOCK, &timer_set, NULL);
 	set_sighandler(SIGALRM, timer_sighandler, NULL);
 
+	if (cflag)
+		start_summary_timer();
+	start_sample_timer();
+
 	if (nprocs != 0 || daemonized_tracer)
 		startup_attach();
 
@@ -3173,26 +3595,16 @@ init(int argc, char *argv[])
 			always_show_pid;
 }
 
-static struct tcb *
+struct tcb *
 pid2tcb(const int pid)
 {
-	if (pid <= 0)
+	if (pid <= 0 || !pid2tcb_tab_size)
 		return NULL;
 
-#define PID2TCB_CACHE_SIZE 1024U
-#define PID2TCB_CACHE_MASK (PID2TCB_CACHE_SIZE - 1)
-
-	static struct tcb *pid2tcb_cache[PID2TCB_CACHE_SIZE];
-	struct tcb **const ptcp = &pid2tcb_cache[pid & PID2TCB_CACHE_MASK];
-	struct tcb *tcp = *ptcp;
-
-	if (tcp && tcp->pid == pid)
-		return tcp;
-
-	for (size_t i = 0; i < tcbtabsize; ++i) {
-		tcp = tcbtab[i];
-		if (tcp->pid == pid)
-			return *ptcp = tcp;
+	for (size_t i = pid2tcb_hash(pid); pid2tcb_tab[i];
+	     i = (i + 1) & (pid2tcb_tab_size - 1)) {
+		if (pid2tcb_tab[i]->pid == pid)
+			return pid2tcb_tab[i];
 	}
 
 	return NULL;
@@ -3265,7 +3677,7 @@ cleanup(int fatal_sig)
 		if (!tcp->pid)
 			continue;
 		debug_func_msg("looking at pid %u", tcp->pid);
-		if (tcp->pid == strace_child) {
+		if (tcp->pid == strace_child && !replaying) {
 			kill(tcp->pid, SIGCONT);
 			kill(tcp->pid, fatal_sig);
 		}
@@ -3321,6 +3733,12 @@ interrupt(int sig)
 	interrupted = sig;
 }
 
+static void
+request_flight_recorder_flush(int sig)
+{
+	flight_recorder_flush_requested = 1;
+}
+
 static struct tcb *
 maybe_allocate_tcb(const int pid, int status)
 {
@@ -3415,6 +3833,13 @@ maybe_switch_tcbs(struct tcb *tcp, const int pid)
 		execve_thread->staged_output_data = tcp->staged_output_data;
 		tcp->staged_output_data = staged_output_data;
 	}
+	if (flight_recorder_size) {
+		struct flight_recorder_data *flight_recorder_data;
+
+		flight_recorder_data = execve_thread->flight_recorder_data;
+		execve_thread->flight_recorder_data = tcp->flight_recorder_data;
+		tcp->flight_recorder_data = flight_recorder_data;
+	}
 
 	/* And their column positions */
 	execve_thread->curcol = tcp->curcol;
@@ -3423,7 +3848,9 @@ maybe_switch_tcbs(struct tcb *tcp, const int pid)
 	droptcb(tcp);
 	/* Switch to the thread, reusing leader's outfile and pid */
 	tcp = execve_thread;
+	pid2tcb_remove(tcp);
 	tcp->pid = pid;
+	pid2tcb_insert(tcp);
 	if (cflag != CFLAG_ONLY_STATS) {
 		if (!is_number_in_set(QUIET_THREAD_EXECVE, quiet_set)) {
 			printleader(tcp);
@@ -3436,7 +3863,7 @@ maybe_switch_tcbs(struct tcb *tcp, const int pid)
 		 * Need to reopen memstream for thread
 		 * as we closed it in droptcb.
 		 */
-		if (!is_complete_set(status_set, NUMBER_OF_STATUSES))
+		if (stage_syscall_output)
 			strace_open_memstream(tcp);
 		tcp->flags |= TCB_REPRINT;
 	}
@@ -3472,6 +3899,8 @@ print_signalled(struct tcb *tcp, const int pid, int status)
 		tprint_newline();
 		line_ended();
 	}
+
+	flight_recorder_flush(tcp);
 }
 
 static void
@@ -3489,6 +3918,8 @@ print_exited(struct tcb *tcp, const int pid, int status)
 		tprint_newline();
 		line_ended();
 	}
+
+	flight_recorder_flush(tcp);
 }
 
 static void
@@ -3511,6 +3942,9 @@ print_stopped(struct tcb *tcp, const siginfo_t *si, const unsigned int sig)
 		if (stack_trace_mode)
 			unwind_tcb_print(tcp);
 #endif
+
+		if (si)
+			flight_recorder_flush(tcp);
 	}
 }
 
@@ -3521,7 +3955,7 @@ startup_tcb(struct tcb *tcp)
 
 	tcp->flags &= ~TCB_STARTUP;
 
-	if (!use_seize) {
+	if (!use_seize && !replaying) {
 		debug_msg("setting opts 0x%x on pid %d",
 			  ptrace_setoptions, tcp->pid);
 		if (ptrace(PTRACE_SETOPTIONS, tcp->pid, NULL, ptrace_setoptions) < 0) {
@@ -3585,7 +4019,7 @@ print_event_exit(struct tcb *tcp)
 	tprint_sysret_pseudo_rval();
 	tprint_sysret_end();
 	tprint_newline();
-	if (!is_complete_set(status_set, NUMBER_OF_STATUSES)) {
+	if (stage_syscall_output) {
 		bool publish = is_number_in_set(STATUS_UNFINISHED, status_set);
 		strace_close_memstream(tcp, publish);
 	}
@@ -3630,12 +4064,104 @@ tcb_wait_tab_check_size(const size_t size)
 	}
 }
 
+/*
+ * Check whether handling of the event neither decodes nor prints anything,
+ * that is, the tracee is going to be just restarted.
+ */
+static bool
+is_quick_event(const struct tcb *tcp, const enum trace_event te)
+{
+	switch (te) {
+	case TE_RESTART:
+		return true;
+	case TE_SYSCALL_STOP:
+		/* Exiting a syscall that has been filtered out on entering. */
+		return exiting(tcp) && filtered(tcp);
+	default:
+		return false;
+	}
+}
+
+static void
+record_tcb_event(const struct tcb *tcp, const struct tcb_wait_data *wd)
+{
+	const struct record_event ev = {
+		.pid = tcp->pid,
+		.status = wd->status,
+		.te = wd->te,
+		.tcb_flags = tcp->flags & TCB_STARTUP ? tcp->flags : 0,
+		.strace_child = tcp->pid == strace_child,
+		.msg = wd->msg,
+		.ts_real = wd->ts_real,
+		.ts_mono = wd->ts_mono,
+		.si = wd->si,
+	};
+
+	record_event(&ev);
+}
+
+/*
+ * The --replay counterpart of next_event: the events are dispatched
+ * in the order they were dispatched in when recorded.
+ */
+static const struct tcb_wait_data *
+next_replayed_event(void)
+{
+	struct record_event ev;
+
+	if (!replay_next_event(&ev))
+		return NULL;
+
+	if (debug_flag)
+		print_debug_info(ev.pid, ev.status);
+
+	struct tcb *tcp = pid2tcb(ev.pid);
+
+	if (!tcp) {
+		tcp = alloctcb(ev.pid);
+		after_successful_attach(tcp, 0);
+		/* There is nothing to detach from.  */
+		tcp->flags = ev.tcb_flags & ~TCB_ATTACHED;
+		if (ev.strace_child)
+			strace_child = ev.pid;
+		else if (!is_number_in_set(QUIET_ATTACH, quiet_set))
+			error_msg("Process %d attached", ev.pid);
+	}
+
+	tcb_wait_tab_check_size(0);
+	struct tcb_wait_data *wd = init_trace_wait_data(tcb_wait_tab);
+	wd->te = ev.te;
+	wd->status = ev.status;
+	wd->msg = ev.msg;
+	wd->si = ev.si;
+	wd->ts_real = ev.ts_real;
+	wd->ts_mono = ev.ts_mono;
+	tcp->wait_data_idx = 0;
+
+	clear_regs(tcp);
+
+	if (tcp->flags & TCB_STARTUP)
+		startup_tcb(tcp);
+
+	set_current_tcp(tcp);
+
+	current_wait_data = wd;
+	return wd;
+}
+
 static const struct tcb_wait_data *
 next_event(void)
 {
+	current_wait_data = NULL;
+
 	if (interrupted)
 		return NULL;
 
+	if (flight_recorder_flush_requested) {
+		flight_recorder_flush_requested = 0;
+		flight_recorder_flush_all();
+	}
+
 	if (syscall_limit == 0) {
 		if (!is_number_in_set(QUIET_ATTACH, quiet_set))
 			error_msg("System call limit has been reached, detaching tracees");
@@ -3643,27 +4169,42 @@ next_event(void)
 		return NULL;
 	}
 
-	invalidate_umove_cache();
+	if (replaying)
+		return next_replayed_event();
 
 	struct tcb *tcp = NULL;
 	struct list_item *elem;
 
+	/*
+	 * Events that need no decoding and no output are queued
+	 * in quick_tcps and handled before the other events of the same
+	 * sweep, so that their tracees are restarted as soon as possible.
+	 */
+	static EMPTY_LIST(quick_tcps);
 	static EMPTY_LIST(pending_tcps);
-	/* Handle the queued tcbs before waiting for new events.  */
-	if (!list_is_empty(&pending_tcps))
-		goto next_event_get_tcp;
-
-	static struct tcb *extra_tcp;
-	static size_t wait_extra_data_idx;
-	/* Handle the extra tcb event.  */
-	if (extra_tcp) {
-		tcp = extra_tcp;
-		extra_tcp = NULL;
-		tcp->wait_data_idx = wait_extra_data_idx;
 
-		debug_msg("dequeued extra event for pid %u", tcp->pid);
-		goto next_event_exit;
-	}
+	/*
+	 * Events that arrive for a tcb already queued (which may happen
+	 * if a tracee was SIGKILL'ed, for example) are handled
+	 * in the order of arrival after all the queued tcbs.
+	 */
+	static struct {
+		struct tcb *tcp;
+		/*
+		 * The tcb might be dropped by an earlier event
+		 * and reused for another tracee.
+		 */
+		pid_t pid;
+		size_t wait_data_idx;
+	} *extra_events;
+	static size_t extra_events_size;
+	static size_t extra_events_cnt;
+	static size_t extra_events_pos;
+
+	/* Handle the queued events before waiting for new events.  */
+	if (!list_is_empty(&quick_tcps) || !list_is_empty(&pending_tcps) ||
+	    extra_events_pos < extra_events_cnt)
+		goto next_event_get_tcp;
 
 	/*
 	 * Used to exit simply when nprocs hits zero, but in this testcase:
@@ -3686,23 +4227,25 @@ next_event(void)
 			return NULL;
 	}
 
-	const bool unblock_delay_timer = is_delay_timer_armed();
+	const bool unblock_timers = is_delay_timer_armed() ||
+				    is_summary_timer_armed() ||
+				    is_sample_timer_armed();
 
 	/*
 	 * The window of opportunity to handle expirations
-	 * of the delay timer opens here.
+	 * of the delay, summary, and sample timers opens here.
 	 *
-	 * Unblock the signal handler for the delay timer
-	 * iff the delay timer is already created.
+	 * Unblock the signal handler for these timers
+	 * iff any of them is already armed.
 	 */
-	if (unblock_delay_timer)
+	if (unblock_timers)
 		sigprocmask(SIG_UNBLOCK, &timer_set, NULL);
 
 	/*
-	 * If the delay timer has expired, then its expiration
+	 * If a timer has expired, then its expiration
 	 * has been handled already by the signal handler.
 	 *
-	 * If the delay timer expires during wait4(),
+	 * If a timer expires during wait4(),
 	 * then the system call will be interrupted and
 	 * the expiration will be handled by the signal handler.
 	 */
@@ -3713,12 +4256,12 @@ next_event(void)
 
 	/*
 	 * The window of opportunity to handle expirations
-	 * of the delay timer closes here.
+	 * of the delay, summary, and sample timers closes here.
 	 *
-	 * Block the signal handler for the delay timer
+	 * Block the signal handler for these timers
 	 * iff it was unblocked earlier.
 	 */
-	if (unblock_delay_timer) {
+	if (unblock_timers) {
 		sigprocmask(SIG_BLOCK, &timer_set, NULL);
 
 		if (restart_failed)
@@ -3730,8 +4273,7 @@ next_event(void)
 
 	/*
 	 * Wait for new events until wait4() returns 0 (meaning that there's
-	 * nothing more to wait for for now), or a second event for some tcb
-	 * appears (which may happen if a tracee was SIGKILL'ed, for example).
+	 * nothing more to wait for for now).
 	 */
 	for (;;) {
 		struct tcb_wait_data *wd;
@@ -3784,6 +4326,12 @@ next_event(void)
 		init_trace_wait_data(wd);
 		wd->status = status;
 
+		/* Timestamps printed by printleader for this event.  */
+		if (tflag_format || recording)
+			clock_gettime(CLOCK_REALTIME, &wd->ts_real);
+		if (rflag || recording)
+			clock_gettime(CLOCK_MONOTONIC, &wd->ts_mono);
+
 		if (WIFSIGNALED(status)) {
 			wd->te = TE_SIGNALLED;
 		} else if (WIFEXITED(status)) {
@@ -3875,20 +4423,29 @@ next_event(void)
 				       "for pid %d, status %0#x", pid, status);
 
 		if (!list_is_empty(&tcp->wait_list)) {
-			wait_extra_data_idx = wait_tab_pos;
-			extra_tcp = tcp;
+			if (extra_events_cnt >= extra_events_size)
+				extra_events = xgrowarray(extra_events,
+							  &extra_events_size,
+							  sizeof(*extra_events));
+			extra_events[extra_events_cnt].tcp = tcp;
+			extra_events[extra_events_cnt].pid = pid;
+			extra_events[extra_events_cnt].wait_data_idx =
+				wait_tab_pos;
+			extra_events_cnt++;
 			debug_func_msg("queued extra pid %d", tcp->pid);
 		} else {
 			tcp->wait_data_idx = wait_tab_pos;
-			list_append(&pending_tcps, &tcp->wait_list);
-			debug_func_msg("queued pid %d", tcp->pid);
+			if (is_quick_event(tcp, wd->te)) {
+				list_append(&quick_tcps, &tcp->wait_list);
+				debug_func_msg("queued quick pid %d", tcp->pid);
+			} else {
+				list_append(&pending_tcps, &tcp->wait_list);
+				debug_func_msg("queued pid %d", tcp->pid);
+			}
 		}
 
 		wait_tab_pos++;
 
-		if (extra_tcp)
-			break;
-
 next_event_wait_next:
 		pid = wait4(-1, &status, __WALL | WNOHANG, (cflag ? &ru : NULL));
 		wait_errno = errno;
@@ -3896,22 +4453,50 @@ next_event_wait_next:
 	}
 
 next_event_get_tcp:
-	elem = list_remove_head(&pending_tcps);
+	elem = list_remove_head(&quick_tcps);
+	if (!elem)
+		elem = list_remove_head(&pending_tcps);
 
-	if (!elem) {
+	if (elem) {
+		tcp = list_elem(elem, struct tcb, wait_list);
+		debug_func_msg("dequeued pid %d", tcp->pid);
+	} else if (extra_events_pos < extra_events_cnt) {
+		const size_t pos = extra_events_pos;
+
+		if (++extra_events_pos == extra_events_cnt)
+			extra_events_pos = extra_events_cnt = 0;
+
+		tcp = extra_events[pos].tcp;
+		if (tcp->pid != extra_events[pos].pid) {
+			debug_msg("dropped extra event for pid %d",
+				  extra_events[pos].pid);
+			goto next_event_get_tcp;
+		}
+		tcp->wait_data_idx = extra_events[pos].wait_data_idx;
+
+		debug_msg("dequeued extra event for pid %u", tcp->pid);
+	} else {
 		tcb_wait_tab_check_size(0);
 		memset(tcb_wait_tab, 0, sizeof(*tcb_wait_tab));
 		tcb_wait_tab->te = TE_NEXT;
 
 		return tcb_wait_tab;
-	} else {
-		tcp = list_elem(elem, struct tcb, wait_list);
-		debug_func_msg("dequeued pid %d", tcp->pid);
 	}
 
-next_event_exit:
 	clear_regs(tcp);
 
+	/*
+	 * The tracee memory might have been changed since the previous stop
+	 * unless the tracee has just completed a syscall that does not write
+	 * to the tracee memory.
+	 */
+	if (tcb_wait_tab[tcp->wait_data_idx].te != TE_SYSCALL_STOP ||
+	    !exiting(tcp) || !syscall_keeps_umove_cache(tcp))
+		invalidate_umove_cache(tcp);
+
+	if (recording)
+		record_tcb_event(tcp, tcb_wait_tab + tcp->wait_data_idx);
+
 	/* Is this the very first time we see this tracee stopped? */
 	if (tcp->flags & TCB_STARTUP)
 		startup_tcb(tcp);
@@ -3919,6 +4504,7 @@ next_event_exit:
 	/* Set current output file */
 	set_current_tcp(tcp);
 
+	current_wait_data = tcb_wait_tab + tcp->wait_data_idx;
 	return tcb_wait_tab + tcp->wait_data_idx;
 }
 
@@ -3939,13 +4525,81 @@ trace_syscall(struct tcb *tcp, unsigned int *sig)
 		struct timespec ts = {};
 		int res = syscall_exiting_decode(tcp, &ts);
 		if (res != 0) {
+			const bool decoded = res == 1;
+
 			res = syscall_exiting_trace(tcp, &ts, res);
+			if (decoded && tcp->flight_recorder_data &&
+			    is_flight_recorder_trigger(tcp))
+				flight_recorder_flush(tcp);
 		}
 		syscall_exiting_finish(tcp);
 		return res;
 	}
 }
 
+/*
+ * Interrupt the tracee that runs without stopping on syscalls,
+ * so that it is restarted with PTRACE_SYSCALL.  The tracees
+ * with a seccomp filter are going to stop on syscalls anyway.
+ */
+static void
+interrupt_unsampled_tcb(struct tcb *tcp)
+{
+	if (has_seccomp_filter(tcp))
+		return;
+
+	if (ptrace(PTRACE_INTERRUPT, tcp->pid, 0L, 0L) < 0 && errno != ESRCH)
+		perror_func_msg("ptrace(PTRACE_INTERRUPT,%u)", tcp->pid);
+}
+
+static void
+interrupt_unsampled_tcbs(void)
+{
+	for (size_t i = 0; i < tcbtabsize; ++i) {
+		struct tcb *tcp = tcbtab[i];
+
+		if (tcp->pid && (tcp->flags & TCB_UNSAMPLED))
+			interrupt_unsampled_tcb(tcp);
+	}
+}
+
+/*
+ * With --sample-window, the tracees that are not inside a syscall
+ * are restarted with PTRACE_CONT while the window is closed,
+ * and are marked with TCB_UNSAMPLED until they are restarted
+ * with PTRACE_SYSCALL again.
+ */
+static unsigned int
+get_sample_restart_op(struct tcb *tcp, enum trace_event te, int status,
+		      unsigned int restart_op)
+{
+	if (restart_op != PTRACE_SYSCALL && restart_op != PTRACE_CONT)
+		return restart_op;
+
+	if (entering(tcp)) {
+		/*
+		 * The next syscall stop after a ptrace event stop
+		 * inside a syscall that has not been traced would be
+		 * the exit of that syscall.
+		 */
+		const unsigned int event = (unsigned int) status >> 16;
+		const bool in_syscall = te == TE_STOP_BEFORE_EXECVE ||
+			(te == TE_RESTART && event &&
+			 event != PTRACE_EVENT_STOP);
+
+		if (!is_sample_window_open() ||
+		    (in_syscall && (tcp->flags & TCB_UNSAMPLED)))
+			restart_op = PTRACE_CONT;
+	}
+
+	if (restart_op == PTRACE_CONT && entering(tcp))
+		tcp->flags |= TCB_UNSAMPLED;
+	else
+		tcp->flags &= ~TCB_UNSAMPLED;
+
+	return restart_op;
+}
+
 /* Returns true iff the main trace loop has to continue. */
 static bool
 dispatch_event(const struct tcb_wait_data *wd)
@@ -3975,6 +4629,15 @@ dispatch_event(const struct tcb_wait_data *wd)
 		break;
 
 	case TE_SECCOMP:
+		if (current_tcp->flags & TCB_UNSAMPLED) {
+			/*
+			 * The tracee has been restarted with PTRACE_CONT
+			 * outside of syscalls, it stops here
+			 * because of its seccomp filter.
+			 */
+			current_tcp->flags |= TCB_SECCOMP_FILTER;
+		}
+
 		if (!has_seccomp_filter(current_tcp)) {
 			/*
 			 * We don't know if forks/clones have a seccomp filter
@@ -3989,6 +4652,12 @@ dispatch_event(const struct tcb_wait_data *wd)
 			break;
 		}
 
+		if (!is_sample_window_open()) {
+			/* Let the syscall run without stopping on it.  */
+			restart_op = PTRACE_CONT;
+			break;
+		}
+
 		if (seccomp_before_sysentry) {
 			restart_op = PTRACE_SYSCALL;
 			break;
@@ -4089,7 +4758,8 @@ dispatch_event(const struct tcb_wait_data *wd)
 		 * and all the following syscall state tracking is screwed up
 		 * otherwise.
 		 */
-		if (!maybe_switch_current_tcp() && entering(current_tcp)) {
+		if (!maybe_switch_current_tcp() && entering(current_tcp)
+		    && !(current_tcp->flags & TCB_UNSAMPLED)) {
 			int ret;
 
 			error_msg("Stray PTRACE_EVENT_EXEC from pid %d"
@@ -4133,14 +4803,36 @@ dispatch_event(const struct tcb_wait_data *wd)
 
 		current_tcp->delayed_wait_data = copy_trace_wait_data(wd);
 
+#ifdef ENABLE_STACKTRACE
+		if (stack_trace_mode)
+			unwind_tcb_print_deferred(current_tcp);
+#endif
 		return true;
 	}
 
+	if (is_sampling_enabled())
+		restart_op = get_sample_restart_op(current_tcp, te, status,
+						   restart_op);
+
 	if (ptrace_restart(restart_op, current_tcp, restart_sig) < 0) {
 		/* Note: ptrace_restart emitted error message */
 		exit_code = 1;
 		return false;
 	}
+
+	/*
+	 * The tracee has been restarted with PTRACE_CONT inside a syscall
+	 * that has not been traced, stop it after that syscall
+	 * if the window is open.
+	 */
+	if ((current_tcp->flags & TCB_UNSAMPLED) && is_sample_window_open())
+		interrupt_unsampled_tcb(current_tcp);
+
+#ifdef ENABLE_STACKTRACE
+	/* The tracee is running, resolve the stack trace captured.  */
+	if (stack_trace_mode)
+		unwind_tcb_print_deferred(current_tcp);
+#endif
 	return true;
 }
 
@@ -4159,7 +4851,7 @@ restart_delayed_tcb(struct tcb *const tcp)
 
 	debug_func_msg("pid %d", tcp->pid);
 
-	tcp->flags &= ~TCB_DELAYED;
+	undelay_tcb(tcp);
 
 	struct tcb *const prev_tcp = current_tcp;
 	current_tcp = tcp;
@@ -4175,31 +4867,21 @@ restart_delayed_tcb(struct tcb *const tcp)
 static bool
 restart_delayed_tcbs(void)
 {
-	struct tcb *tcp_next = NULL;
+	struct tcb *tcp;
 	struct timespec ts_now;
 
 	clock_gettime(CLOCK_MONOTONIC, &ts_now);
 
-	for (size_t i = 0; i < tcbtabsize; i++) {
-		struct tcb *tcp = tcbtab[i];
-
-		if (tcp->pid && syscall_delayed(tcp)) {
-			if (ts_cmp(&ts_now, &tcp->delay_expiration_time) > 0) {
-				if (!restart_delayed_tcb(tcp))
-					return false;
-			} else {
-				/* Check whether this tcb is the next.  */
-				if (!tcp_next ||
-				    ts_cmp(&tcp_next->delay_expiration_time,
-					   &tcp->delay_expiration_time) > 0) {
-					tcp_next = tcp;
-				}
-			}
+	while ((tcp = next_delayed_tcb())) {
+		if (ts_cmp(&ts_now, &tcp->delay_expiration_time) <= 0) {
+			/* This tcb is the next to expire.  */
+			arm_delay_timer(tcp);
+			break;
 		}
-	}
 
-	if (tcp_next)
-		arm_delay_timer(tcp_next);
+		if (!restart_delayed_tcb(tcp))
+			return false;
+	}
 
 	return true;
 }
@@ -4210,17 +4892,53 @@ restart_delayed_tcbs(void)
  * it is enabled only in those places where it's safe.
  */
 static void
-timer_sighandler(int sig)
+print_interval_summary(void)
 {
-	delay_timer_expired();
+	/*
+	 * With -C, the summary is printed to the same log as the trace,
+	 * make sure it does not start in the middle of a line.
+	 */
+	if (cflag == CFLAG_BOTH && printing_tcp && printing_tcp->curcol != 0
+	    && !printing_tcp->staged_output_data) {
+		struct tcb *const prev_tcp = current_tcp;
 
-	if (restart_failed)
-		return;
+		set_current_tcp(printing_tcp);
+		tprint_space();
+		tprints_string("<unfinished ...>");
+		tprint_newline();
+		flush_tcp_output(printing_tcp);
+		printing_tcp->curcol = 0;
+		/* The syscall exit is to be printed as resumed.  */
+		printing_tcp = NULL;
+		set_current_tcp(prev_tcp);
+	}
 
+	interval_summary(shared_log);
+}
+
+/*
+ * The delay, summary, and sample timers share the signal,
+ * so the handler checks all of them.
+ */
+static void
+timer_sighandler(int sig)
+{
 	int saved_errno = errno;
 
-	if (!restart_delayed_tcbs())
-		restart_failed = 1;
+	if (summary_timer_expired())
+		print_interval_summary();
+
+	if (sample_timer_expired()) {
+		mmap_cache_invalidate_all();
+		interrupt_unsampled_tcbs();
+	}
+
+	if (is_delay_timer_armed()) {
+		delay_timer_expired();
+
+		if (!restart_failed && !restart_delayed_tcbs())
+			restart_failed = 1;
+	}
 
 	errno = saved_errno;
 }
@@ -4231,6 +4949,9 @@ terminate(void)
 	int sig = interrupted;
 
 	cleanup(sig);
+	flight_recorder_close_shared();
+	if (debug_flag)
+		print_umove_cache_stats();
 	if (cflag)
 		call_summary(shared_log);
 	fflush(NULL);
@@ -4277,7 +4998,7 @@ main(int argc, char *argv[])
 	setlocale(LC_ALL, "");
 	init(argc, argv);
 
-	exit_code = !nprocs;
+	exit_code = !nprocs && !replaying;
 
 	while (dispatch_event(next_event()))
 		;
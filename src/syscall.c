@@ -21,7 +21,9 @@
 #include "nsig.h"
 #include "number_set.h"
 #include "delay.h"
+#include "fd_path_cache.h"
 #include "poke.h"
+#include "record.h"
 #include "retval.h"
 #include <limits.h>
 #include <fcntl.h>
@@ -616,6 +618,49 @@ syscall_entering_decode(struct tcb *tcp)
 	return 1;
 }
 
+static int
+print_syscall_entering(struct tcb *tcp)
+{
+	printleader(tcp);
+	tprints_arg_begin(tcp_sysent(tcp)->sys_name);
+	int res = raw(tcp) ? printargs(tcp) : tcp_sysent(tcp)->sys_func(tcp);
+	fflush(tcp->outf);
+	return res;
+}
+
+/*
+ * Whether the syscall entry can be decoded on syscall exit
+ * with the same result: the syscall does not change the memory
+ * of the tracee and is not tampered with.
+ */
+static bool
+can_defer_entry_decoding(struct tcb *tcp)
+{
+	return syscall_keeps_umove_cache(tcp) && !inject(tcp);
+}
+
+/*
+ * Decode the syscall entry on syscall exit, as if the tracee
+ * was still stopped on syscall entry.
+ */
+static void
+print_deferred_syscall_entering(struct tcb *tcp)
+{
+	tcp->flags &= ~TCB_INSYSCALL;
+	tcp->sys_func_rval = print_syscall_entering(tcp);
+	tcp->flags |= TCB_INSYSCALL;
+	tcp->flags &= ~TCB_DEFERRED_ENTRY;
+}
+
+/* Whether the syscall is printed according to its return status.  */
+static bool
+is_syscall_status_printed(struct tcb *tcp)
+{
+	return is_number_in_set(syserror(tcp) ? STATUS_FAILED
+					      : STATUS_SUCCESSFUL,
+				status_set);
+}
+
 int
 syscall_entering_trace(struct tcb *tcp, unsigned int *sig)
 {
@@ -665,14 +710,16 @@ syscall_entering_trace(struct tcb *tcp, unsigned int *sig)
 	}
 #endif
 
-	if (!is_complete_set(status_set, NUMBER_OF_STATUSES))
+	if (stage_syscall_output)
 		strace_open_memstream(tcp);
 
-	printleader(tcp);
-	tprints_arg_begin(tcp_sysent(tcp)->sys_name);
-	int res = raw(tcp) ? printargs(tcp) : tcp_sysent(tcp)->sys_func(tcp);
-	fflush(tcp->outf);
-	return res;
+	if (defer_entry_decoding && can_defer_entry_decoding(tcp)) {
+		tcp->flags |= TCB_DEFERRED_ENTRY;
+		get_event_real_time(&tcp->deferred_entry_ts);
+		return 0;
+	}
+
+	return print_syscall_entering(tcp);
 }
 
 void
@@ -681,9 +728,13 @@ syscall_entering_finish(struct tcb *tcp, int res)
 	tcp->flags |= TCB_INSYSCALL;
 	tcp->sys_func_rval = res;
 
+	/* The path of the descriptor being closed is still cached.  */
+	socket_cache_syscall_enter(tcp);
+	fd_path_cache_syscall_enter(tcp);
+
 	/* Measure the entrance time as late as possible to avoid errors. */
 	if ((Tflag || cflag) && !filtered(tcp))
-		clock_gettime(CLOCK_MONOTONIC, &tcp->etime);
+		get_event_time(&tcp->etime);
 
 	/* Start tracking system time */
 	if (cflag) {
@@ -716,10 +767,21 @@ syscall_exiting_decode(struct tcb *tcp, struct timespec *pts)
 {
 	/* Measure the exit time as early as possible to avoid errors. */
 	if ((Tflag || cflag) && !filtered(tcp))
-		clock_gettime(CLOCK_MONOTONIC, pts);
+		get_event_time(pts);
 
-	if (tcp_sysent(tcp)->sys_flags & MEMORY_MAPPING_CHANGE)
+	if (tcp_sysent(tcp)->sys_flags & MEMORY_MAPPING_CHANGE) {
+		/*
+		 * The mmap cache is updated using the return value,
+		 * fetch it early.  If the outcome is unknown,
+		 * report the syscall as failed.
+		 */
+		if (get_syscall_result(tcp) < 0)
+			tcp->u_error = ENOSYS;
 		mmap_notify_report(tcp);
+	}
+
+	fd_path_cache_syscall_exit(tcp);
+	socket_cache_syscall_exit(tcp);
 
 	if ((tcp_sysent(tcp)->sys_flags & COMM_CHANGE) && !syserror(tcp) &&
 	    (tcp_sysent(tcp)->sen != SEN_prctl || tcp->u_arg[0] == PR_SET_NAME))
@@ -737,7 +799,11 @@ syscall_exiting_decode(struct tcb *tcp, struct timespec *pts)
 	update_personality(tcp, tcp->currpers);
 #endif
 
-	return get_syscall_result(tcp);
+	int res = get_syscall_result(tcp);
+	if (res > 0)
+		fd_path_cache_syscall_result(tcp);
+
+	return res;
 }
 
 void
@@ -801,9 +867,7 @@ syscall_exiting_trace(struct tcb *tcp, struct timespec *ts, int res)
 	tcp->s_prev_ent = NULL;
 	if (res != 1) {
 		/* There was an error in one of prior ptrace ops.  */
-		bool status_filtering =
-			!is_complete_set(status_set, NUMBER_OF_STATUSES);
-		bool publish = status_filtering
+		bool publish = stage_syscall_output
 			       ? is_number_in_set(STATUS_UNAVAILABLE, status_set)
 			       : true;
 		if (cflag && publish)
@@ -819,7 +883,7 @@ syscall_exiting_trace(struct tcb *tcp, struct timespec *ts, int res)
 			tprints_string("<unavailable>");
 			tprint_sysret_end();
 			tprint_newline();
-			if (status_filtering)
+			if (stage_syscall_output)
 				strace_close_memstream(tcp, publish);
 			line_ended();
 		}
@@ -827,6 +891,16 @@ syscall_exiting_trace(struct tcb *tcp, struct timespec *ts, int res)
 	}
 	tcp->s_prev_ent = prev_ent;
 
+	if (tcp->flags & TCB_DEFERRED_ENTRY) {
+		/* The output is dropped, there is no need to decode it.  */
+		if (!is_syscall_status_printed(tcp)) {
+			strace_close_memstream(tcp, false);
+			line_ended();
+			return 0;
+		}
+		print_deferred_syscall_entering(tcp);
+	}
+
 	int sys_res = 0;
 	if (cflag != CFLAG_ONLY_STATS) {
 		if (raw(tcp)) {
@@ -839,11 +913,8 @@ syscall_exiting_trace(struct tcb *tcp, struct timespec *ts, int res)
 		}
 	}
 
-	if (!is_complete_set(status_set, NUMBER_OF_STATUSES)) {
-		bool publish = syserror(tcp)
-			       && is_number_in_set(STATUS_FAILED, status_set);
-		publish |= !syserror(tcp)
-			   && is_number_in_set(STATUS_SUCCESSFUL, status_set);
+	if (stage_syscall_output) {
+		bool publish = is_syscall_status_printed(tcp);
 		if (cflag != CFLAG_ONLY_STATS)
 			strace_close_memstream(tcp, publish);
 		if (!publish) {
@@ -1032,7 +1103,8 @@ void
 syscall_exiting_finish(struct tcb *tcp)
 {
 	tcp->flags &= ~(TCB_INSYSCALL | TCB_TAMPERED | TCB_INJECT_DELAY_EXIT |
-			TCB_INJECT_POKE_EXIT | TCB_TAMPERED_DELAYED | TCB_TAMPERED_POKED);
+			TCB_INJECT_POKE_EXIT | TCB_TAMPERED_DELAYED | TCB_TAMPERED_POKED |
+			TCB_DEFERRED_ENTRY);
 	tcp->sys_func_rval = 0;
 	free_tcb_priv_data(tcp);
 
@@ -1190,6 +1262,41 @@ ptrace_setregs(pid_t pid)
 
 #endif /* ARCH_REGS_FOR_GETREGSET || ARCH_REGS_FOR_GETREGS */
 
+#ifdef ptrace_getregset_or_getregs
+# ifdef ARCH_REGS_FOR_GETREGSET
+#  define ARCH_REGS_BUF ARCH_REGS_FOR_GETREGSET
+# else
+#  define ARCH_REGS_BUF ARCH_REGS_FOR_GETREGS
+# endif
+
+/* ptrace_getregset_or_getregs that is subject to --record and --replay.  */
+static long
+fetch_regs(struct tcb *const tcp)
+{
+	size_t len = sizeof(ARCH_REGS_BUF);
+
+	if (replaying) {
+		if (replay_regs(&ARCH_REGS_BUF, &len) < 0)
+			return -1;
+# ifdef ARCH_IOVEC_FOR_GETREGSET
+		ARCH_IOVEC_FOR_GETREGSET.iov_len = len;
+# endif
+		return 0;
+	}
+
+	const long rc = ptrace_getregset_or_getregs(tcp->pid);
+
+	if (recording && rc >= 0) {
+# ifdef ARCH_IOVEC_FOR_GETREGSET
+		len = ARCH_IOVEC_FOR_GETREGSET.iov_len;
+# endif
+		record_regs(&ARCH_REGS_BUF, len);
+	}
+
+	return rc;
+}
+#endif /* ptrace_getregset_or_getregs */
+
 static long get_regs_error = -1;
 
 void
@@ -1214,9 +1321,9 @@ get_regs(struct tcb *const tcp)
 	 */
 	static int use_getregs_old;
 	if (use_getregs_old < 0) {
-		return get_regs_error = ptrace_getregset_or_getregs(tcp->pid);
+		return get_regs_error = fetch_regs(tcp);
 	} else if (use_getregs_old == 0) {
-		get_regs_error = ptrace_getregset_or_getregs(tcp->pid);
+		get_regs_error = fetch_regs(tcp);
 		if (get_regs_error >= 0) {
 			use_getregs_old = -1;
 			return get_regs_error;
@@ -1225,10 +1332,13 @@ get_regs(struct tcb *const tcp)
 			return get_regs_error;
 		use_getregs_old = 1;
 	}
-	return get_regs_error = getregs_old(tcp);
+	get_regs_error = getregs_old(tcp);
+	if (recording && get_regs_error >= 0)
+		record_regs(&ARCH_REGS_BUF, ARCH_IOVEC_FOR_GETREGSET.iov_len);
+	return get_regs_error;
 # else /* !HAVE_GETREGS_OLD */
 	/* Assume that PTRACE_GETREGSET/PTRACE_GETREGS works. */
-	get_regs_error = ptrace_getregset_or_getregs(tcp->pid);
+	get_regs_error = fetch_regs(tcp);
 
 #  if defined ARCH_PERSONALITY_0_IOV_SIZE
 	if (get_regs_error)
@@ -1300,11 +1410,15 @@ strace_get_syscall_info(struct tcb *tcp)
 	 */
 	if (ptrace_sci.op == 0xff) {
 		const size_t size = sizeof(ptrace_sci);
-		if (ptrace(PTRACE_GET_SYSCALL_INFO, tcp->pid,
-			   (void *) size, &ptrace_sci) < 0) {
+		if (replaying
+		    ? replay_syscall_info(&ptrace_sci, size) < 0
+		    : ptrace(PTRACE_GET_SYSCALL_INFO, tcp->pid,
+			     (void *) size, &ptrace_sci) < 0) {
 			get_regs_error = -2;
 			return false;
 		}
+		if (recording)
+			record_syscall_info(&ptrace_sci, size);
 #if SUPPORTED_PERSONALITIES > 1
 		int newpers = get_personality_from_syscall_info(&ptrace_sci);
 		if (newpers >= 0)
@@ -17,6 +17,9 @@
 
 #include "scno.h"
 #include "ptrace.h"
+#include "mmap_notify.h"
+#include "record.h"
+#include "sen.h"
 
 static bool process_vm_readv_not_supported;
 static bool process_vm_writev_not_supported;
@@ -81,47 +84,112 @@ process_read_mem(const pid_t pid, void *const laddr,
 	return rc;
 }
 
-static int cached_idx = -1;
-static unsigned long cached_raddr[4];
+/*
+ * The cache of tracee memory pages used by umove* functions.
+ *
+ * Every tcb has its own generation number, a cached page is valid
+ * only if its generation matches the generation of the tcb it is looked up
+ * for, so invalidating the pages of a tcb is just a matter of assigning
+ * it a new generation number.  Pages are placed into slots using a hash
+ * of the page number and the pid, consecutive pages of the same tcb
+ * are always placed into different slots.
+ */
+struct umove_cache_entry {
+	unsigned long raddr;
+	uint64_t gen;
+	char *buf;
+};
+
+unsigned int umove_cache_size = DEFAULT_UMOVE_CACHE_SIZE;
+static struct umove_cache_entry *umove_cache;
+static struct iovec *umove_cache_iov;
+static uint64_t umove_cache_gen;
+static uint64_t umove_cache_hits;
+static uint64_t umove_cache_misses;
 
 void
-invalidate_umove_cache(void)
+invalidate_umove_cache(struct tcb *const tcp)
 {
-	cached_idx = -1;
+	tcp->umove_cache_gen = ++umove_cache_gen;
 }
 
-static int
-get_next_unused_idx(void)
+static void
+umove_cache_mmap_notify(struct tcb *tcp, void *unused)
 {
-	return (cached_idx + 1) % ARRAY_SIZE(cached_raddr);
+	/*
+	 * Memory mappings might be shared with other tcbs,
+	 * invalidate the cached pages of all of them.
+	 */
+	for (unsigned int i = 0; i < umove_cache_size; ++i)
+		umove_cache[i].gen = 0;
 }
 
-static int
-lookup_cached_raddr_idx(const unsigned long raddr)
+static struct umove_cache_entry *
+get_umove_cache_entry(const struct tcb *const tcp, const unsigned long raddr)
 {
-	if (cached_idx >= 0) {
-		for (int i = cached_idx; i >= 0; --i)
-			if (raddr == cached_raddr[i])
-				return i;
-		for (int i = (int) ARRAY_SIZE(cached_raddr) - 1;
-		     i > cached_idx; --i)
-			if (raddr == cached_raddr[i])
-				return i;
+	const unsigned long page_no = raddr / get_pagesize();
+
+	return &umove_cache[(page_no + (unsigned long) tcp->pid * 2654435761U)
+			    % umove_cache_size];
+}
+
+/*
+ * Whether the memory of the tracee stopped at syscall exit could not have
+ * been changed by the syscall, so the pages cached on syscall entry
+ * are still valid.
+ */
+bool
+syscall_keeps_umove_cache(const struct tcb *const tcp)
+{
+	switch (tcp_sysent(tcp)->sen) {
+	case SEN_access:
+	case SEN_chdir:
+	case SEN_chmod:
+	case SEN_close:
+	case SEN_creat:
+	case SEN_faccessat:
+	case SEN_faccessat2:
+	case SEN_fchmodat:
+	case SEN_link:
+	case SEN_linkat:
+	case SEN_mkdir:
+	case SEN_mkdirat:
+	case SEN_open:
+	case SEN_openat:
+	case SEN_openat2:
+	case SEN_pwrite:
+	case SEN_pwritev:
+	case SEN_pwritev2:
+	case SEN_rename:
+	case SEN_renameat:
+	case SEN_renameat2:
+	case SEN_rmdir:
+	case SEN_send:
+	case SEN_sendmsg:
+	case SEN_sendto:
+	case SEN_symlink:
+	case SEN_symlinkat:
+	case SEN_truncate:
+	case SEN_unlink:
+	case SEN_unlinkat:
+	case SEN_write:
+	case SEN_writev:
+		return true;
+	default:
+		return false;
 	}
-	return -1;
 }
 
-static void
-set_cached_raddr_idx(const unsigned long raddr, const int idx)
+void
+print_umove_cache_stats(void)
 {
-	if (cached_idx < 0)
-		memset(cached_raddr, 0, sizeof(cached_raddr));
-	cached_raddr[idx] = raddr;
-	cached_idx = idx;
+	if (umove_cache_hits || umove_cache_misses)
+		debug_msg("tracee memory cache: %" PRIu64 " hits, %" PRIu64
+			  " misses", umove_cache_hits, umove_cache_misses);
 }
 
 static ssize_t
-vm_read_mem(const pid_t pid, void *laddr,
+vm_read_mem(struct tcb *const tcp, void *laddr,
 	    const kernel_ulong_t kraddr, size_t len)
 {
 	if (!len)
@@ -138,57 +206,99 @@ vm_read_mem(const pid_t pid, void *laddr,
 
 	const size_t page_size = get_pagesize();
 	const size_t page_mask = page_size - 1;
-	unsigned long page_start = taddr & ~page_mask;
+	const unsigned long page_start = taddr & ~page_mask;
 	const unsigned long page_after_last =
 		(taddr + len + page_mask) & ~page_mask;
 
 	if (!page_start ||
 	    page_after_last < page_start ||
-	    page_after_last - page_start > ARRAY_SIZE(cached_raddr) * page_size)
-		return process_read_mem(pid, laddr, (void *) taddr, len);
-
-	size_t total_read = 0;
+	    page_after_last - page_start > umove_cache_size * page_size)
+		return process_read_mem(tcp->pid, laddr, (void *) taddr, len);
+
+	if (!umove_cache) {
+		umove_cache = xcalloc(umove_cache_size, sizeof(*umove_cache));
+		umove_cache_iov = xcalloc(umove_cache_size,
+					  2 * sizeof(*umove_cache_iov));
+		mmap_notify_register_client(umove_cache_mmap_notify, NULL);
+	}
 
-	for (;;) {
-		static char *buf[ARRAY_SIZE(cached_raddr)];
-		int idx = lookup_cached_raddr_idx(page_start);
+	if (!tcp->umove_cache_gen)
+		invalidate_umove_cache(tcp);
+
+	const unsigned int npages = (page_after_last - page_start) / page_size;
+	struct iovec *const local = umove_cache_iov;
+	struct iovec *const remote = umove_cache_iov + umove_cache_size;
+	unsigned int nmiss = 0;
+
+	/*
+	 * All the pages that are not in the cache yet are fetched
+	 * with a single process_vm_readv call.
+	 */
+	for (unsigned int i = 0; i < npages; ++i) {
+		const unsigned long raddr = page_start + i * page_size;
+		struct umove_cache_entry *const e =
+			get_umove_cache_entry(tcp, raddr);
+
+		if (e->gen == tcp->umove_cache_gen && e->raddr == raddr) {
+			++umove_cache_hits;
+			continue;
+		}
 
-		if (idx == -1) {
-			idx = get_next_unused_idx();
+		++umove_cache_misses;
+		e->gen = 0;
+		e->raddr = raddr;
+		if (!e->buf)
+			e->buf = xmalloc(page_size);
+
+		local[nmiss].iov_base = e->buf;
+		local[nmiss].iov_len = page_size;
+		remote[nmiss].iov_base = (void *) raddr;
+		remote[nmiss].iov_len = page_size;
+		++nmiss;
+	}
 
-			if (!buf[idx])
-				buf[idx] = xmalloc(page_size);
+	unsigned int nfetched = 0;
+	ssize_t rc = 0;
 
-			const ssize_t rc =
-				process_read_mem(pid, buf[idx],
-						 (void *) page_start, page_size);
-			if (rc < 0)
-				return total_read ? (ssize_t) total_read : rc;
+	if (nmiss) {
+		rc = process_vm_readv(tcp->pid, local, nmiss, remote, nmiss, 0);
+		if (rc < 0) {
+			if (errno == ENOSYS)
+				process_vm_readv_not_supported = true;
+		} else {
+			nfetched = rc / page_size;
+		}
+	}
 
-			set_cached_raddr_idx(page_start, idx);
+	size_t total_read = 0;
+	unsigned int miss = 0;
+
+	for (unsigned int i = 0; i < npages; ++i) {
+		const unsigned long raddr = page_start + i * page_size;
+		struct umove_cache_entry *const e =
+			get_umove_cache_entry(tcp, raddr);
+
+		if (e->gen != tcp->umove_cache_gen) {
+			if (miss++ >= nfetched) {
+				if (total_read)
+					break;
+				if (rc >= 0)
+					errno = EFAULT;
+				return -1;
+			}
+			e->gen = tcp->umove_cache_gen;
 		}
 
-		const unsigned long offset = taddr - page_start;
-		size_t copy_len, next_len;
+		const unsigned long offset = taddr - raddr;
+		const size_t copy_len = MIN(len, page_size - offset);
 
-		if (len <= page_size - offset) {
-			copy_len = len;
-			next_len = 0;
-		} else {
-			copy_len = page_size - offset;
-			next_len = len - copy_len;
+		if (laddr) {
+			memcpy(laddr, e->buf + offset, copy_len);
+			laddr += copy_len;
 		}
-
-		memcpy(laddr, buf[idx] + offset, copy_len);
 		total_read += copy_len;
-
-		if (!next_len)
-			break;
-
-		len = next_len;
-		laddr += copy_len;
-		page_start += page_size;
-		taddr = page_start;
+		taddr += copy_len;
+		len -= copy_len;
 	}
 
 	return total_read;
@@ -290,13 +400,9 @@ umoven_peekdata(const int pid, kernel_ulong_t addr, unsigned int len,
 	return 0;
 }
 
-/*
- * Copy `len' bytes of data from process `pid'
- * at address `addr' to our space at `our_addr'.
- */
-int
-umoven(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
-       void *const our_addr)
+static int
+umoven_tracee(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
+	      void *const our_addr)
 {
 	if (tracee_addr_is_invalid(addr))
 		return -1;
@@ -306,7 +412,7 @@ umoven(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
 	if (process_vm_readv_not_supported)
 		return umoven_peekdata(pid, addr, len, our_addr);
 
-	int r = vm_read_mem(pid, our_addr, addr, len);
+	int r = vm_read_mem(tcp, our_addr, addr, len);
 	if ((unsigned int) r == len)
 		return 0;
 	if (r >= 0) {
@@ -332,6 +438,127 @@ umoven(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
 	}
 }
 
+/*
+ * Copy `len' bytes of data from process `pid'
+ * at address `addr' to our space at `our_addr'.
+ */
+int
+umoven(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
+       void *const our_addr)
+{
+	if (replaying)
+		return replay_umoven(addr, len, our_addr);
+
+	const int rc = umoven_tracee(tcp, addr, len, our_addr);
+
+	if (recording && !rc)
+		record_mem(addr, our_addr, len);
+
+	return rc;
+}
+
+static unsigned int
+umovev_tracee(struct tcb *const tcp, const struct umove_iov *const vec,
+	      const unsigned int cnt)
+{
+	if (process_vm_readv_not_supported)
+		return 0;
+
+	unsigned int done = 0;
+
+	while (done < cnt) {
+		struct iovec local[64];
+		struct iovec remote[ARRAY_SIZE(local)];
+		unsigned int n;
+
+		for (n = 0; n < ARRAY_SIZE(local) && done + n < cnt; ++n) {
+			const struct umove_iov *const v = &vec[done + n];
+			const unsigned long raddr = v->addr;
+
+			if (tracee_addr_is_invalid(v->addr))
+				break;
+#if SIZEOF_LONG < SIZEOF_KERNEL_LONG_T
+			if (v->addr != (kernel_ulong_t) raddr)
+				break;
+#endif
+			local[n].iov_base = v->laddr;
+			local[n].iov_len = v->len;
+			remote[n].iov_base = (void *) raddr;
+			remote[n].iov_len = v->len;
+		}
+
+		if (!n)
+			break;
+
+		const ssize_t rc =
+			process_vm_readv(tcp->pid, local, n, remote, n, 0);
+		if (rc < 0) {
+			if (errno == ENOSYS)
+				process_vm_readv_not_supported = true;
+			break;
+		}
+
+		size_t left = rc;
+		unsigned int i;
+
+		for (i = 0; i < n && vec[done + i].len <= left; ++i)
+			left -= vec[done + i].len;
+		done += i;
+
+		if (i < n)
+			break;
+	}
+
+	return done;
+}
+
+/*
+ * Fetch the memory described by `vec' using as few process_vm_readv calls
+ * as possible.  Entries are processed in order, the first entry that
+ * cannot be fetched in full stops the processing.
+ */
+unsigned int
+umovev(struct tcb *const tcp, const struct umove_iov *const vec,
+       const unsigned int cnt)
+{
+	unsigned int done = 0;
+
+	if (replaying) {
+		while (done < cnt && !replay_umoven(vec[done].addr,
+						    vec[done].len,
+						    vec[done].laddr))
+			++done;
+		return done;
+	}
+
+	done = umovev_tracee(tcp, vec, cnt);
+
+	if (recording) {
+		for (unsigned int i = 0; i < done; ++i)
+			record_mem(vec[i].addr, vec[i].laddr, vec[i].len);
+	}
+
+	return done;
+}
+
+void
+umove_prefetch(struct tcb *const tcp, const kernel_ulong_t addr,
+	       const unsigned int len)
+{
+	const size_t page_size = get_pagesize();
+
+	if (tracee_addr_is_invalid(addr) || addr < page_size ||
+	    process_vm_readv_not_supported || replaying)
+		return;
+
+	/* Do not fetch more than the cache can hold.  */
+	const size_t max_len = umove_cache_size * page_size -
+			       (addr & (page_size - 1));
+
+	if (umove_cache_size)
+		vm_read_mem(tcp, NULL, addr, MIN(len, max_len));
+}
+
 /*
  * Like umoven_peekdata but make the additional effort of looking
  * for a terminating zero byte.
@@ -389,20 +616,9 @@ umovestr_peekdata(const int pid, kernel_ulong_t addr, unsigned int len,
 	return 0;
 }
 
-/*
- * Like `umove' but make the additional effort of looking
- * for a terminating zero byte.
- *
- * Returns < 0 on error, strlen + 1  if NUL was seen,
- * else 0 if len bytes were read but no NUL byte seen.
- *
- * Note: there is no guarantee we won't overwrite some bytes
- * in laddr[] _after_ terminating NUL (but, of course,
- * we never write past laddr[len-1]).
- */
-int
-umovestr(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
-	 char *laddr)
+static int
+umovestr_tracee(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
+		char *laddr)
 {
 	if (tracee_addr_is_invalid(addr))
 		return -1;
@@ -427,7 +643,7 @@ umovestr(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
 		if (chunk_len > end_in_page) /* crosses to the next page */
 			chunk_len -= end_in_page;
 
-		int r = vm_read_mem(pid, laddr, addr, chunk_len);
+		int r = vm_read_mem(tcp, laddr, addr, chunk_len);
 		if (r > 0) {
 			char *nul_addr = memchr(laddr, '\0', r);
 
@@ -468,6 +684,32 @@ umovestr(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
 	return 0;
 }
 
+/*
+ * Like `umove' but make the additional effort of looking
+ * for a terminating zero byte.
+ *
+ * Returns < 0 on error, strlen + 1  if NUL was seen,
+ * else 0 if len bytes were read but no NUL byte seen.
+ *
+ * Note: there is no guarantee we won't overwrite some bytes
+ * in laddr[] _after_ terminating NUL (but, of course,
+ * we never write past laddr[len-1]).
+ */
+int
+umovestr(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
+	 char *laddr)
+{
+	if (replaying)
+		return replay_umovestr(addr, len, laddr);
+
+	const int rc = umovestr_tracee(tcp, addr, len, laddr);
+
+	if (recording && rc >= 0)
+		record_mem(addr, laddr, rc ? (unsigned int) rc : len);
+
+	return rc;
+}
+
 static bool
 upoken_peekpoke(const int pid, const kernel_ulong_t addr,
 		const unsigned int len, void *const our_addr,
@@ -563,6 +805,8 @@ upoken(struct tcb *const tcp, kernel_ulong_t addr, unsigned int len,
 
 	const int pid = tcp->pid;
 
+	invalidate_umove_cache(tcp);
+
 	if (process_vm_writev_not_supported)
 		return upoken_pokedata(pid, addr, len, our_addr);
 
@@ -17,7 +17,9 @@
 #include "defs.h"
 #include "unwind.h"
 #include "mmap_notify.h"
+#include "sen.h"
 #include "static_assert.h"
+#include "unwind-symcache.h"
 #include <elfutils/libdwfl.h>
 
 #define STRACE_UW_CACHE_SIZE 2048
@@ -43,21 +45,50 @@ struct cache_entry {
 	unsigned long long last_use;
 };
 
+/*
+ * The context is shared by the tracees that have the same address space:
+ * threads of a process and children created with CLONE_VM.
+ */
 struct ctx {
+	struct ctx *next;
+	unsigned int refcount;
+	int tgid;
 	Dwfl *dwfl;
+	unsigned long long mapping_generation;
 	unsigned long long last_proc_updating;
 	struct cache_entry cache[STRACE_UW_CACHE_SIZE];
 };
 
-static unsigned long long mapping_generation = 1;
+static struct ctx *ctxs;
 static unsigned long long uwcache_clock;
 static bool with_srcinfo;
 static int stack_trace_limit;
 
+static void *tcb_init(struct tcb *tcp);
+static void tcb_fin(struct tcb *tcp);
+
 static void
 update_mapping_generation(struct tcb *tcp, void *unused)
 {
-	mapping_generation++;
+	struct ctx *ctx = tcp->unwind_ctx;
+	if (!ctx)
+		return;
+
+	ctx->mapping_generation++;
+
+	switch (tcp_sysent(tcp)->sen) {
+	case SEN_execv:
+	case SEN_execve:
+	case SEN_execveat:
+		/* The tracee gets a new address space.  */
+		if (!syserror(tcp)) {
+			if (ctx->tgid == tcp->pid)
+				ctx->tgid = 0;
+			tcb_fin(tcp);
+			tcp->unwind_ctx = tcb_init(tcp);
+		}
+		break;
+	}
 }
 
 static void
@@ -68,9 +99,27 @@ init(bool with_srcinfo_, int stack_trace_limit_)
 	mmap_notify_register_client(update_mapping_generation, NULL);
 }
 
+static void *
+find_ctx(int tgid)
+{
+	for (struct ctx *ctx = ctxs; ctx; ctx = ctx->next) {
+		if (ctx->tgid == tgid)
+			return ctx;
+	}
+
+	return NULL;
+}
+
 static void *
 tcb_init(struct tcb *tcp)
 {
+	int tgid;
+	struct ctx *ctx = find_by_address_space(tcp, tcp->pid, find_ctx, &tgid);
+	if (ctx) {
+		ctx->refcount++;
+		return ctx;
+	}
+
 	static const Dwfl_Callbacks proc_callbacks = {
 		.find_elf = dwfl_linux_proc_find_elf,
 		.find_debuginfo = dwfl_standard_find_debuginfo
@@ -97,10 +146,13 @@ tcb_init(struct tcb *tcp)
 		return NULL;
 	}
 
-	struct ctx *ctx = xmalloc(sizeof(*ctx));
+	ctx = xzalloc(sizeof(*ctx));
+	ctx->refcount = 1;
+	ctx->tgid = tgid;
 	ctx->dwfl = dwfl;
-	ctx->last_proc_updating = mapping_generation - 1;
-	memset(ctx->cache, 0, sizeof(ctx->cache));
+	ctx->mapping_generation = 1;
+	ctx->next = ctxs;
+	ctxs = ctx;
 	return ctx;
 }
 
@@ -108,10 +160,18 @@ static void
 tcb_fin(struct tcb *tcp)
 {
 	struct ctx *ctx = tcp->unwind_ctx;
-	if (ctx) {
-		dwfl_end(ctx->dwfl);
-		free(ctx);
+	if (!ctx || --ctx->refcount)
+		return;
+
+	for (struct ctx **p = &ctxs; *p; p = &(*p)->next) {
+		if (*p == ctx) {
+			*p = ctx->next;
+			break;
+		}
 	}
+
+	dwfl_end(ctx->dwfl);
+	free(ctx);
 }
 
 static void
@@ -121,7 +181,7 @@ flush_cache_maybe(struct tcb *tcp)
 	if (!ctx)
 		return;
 
-	if (ctx->last_proc_updating == mapping_generation)
+	if (ctx->last_proc_updating == ctx->mapping_generation)
 		return;
 
 	int r = dwfl_linux_proc_report(ctx->dwfl, tcp->pid);
@@ -136,31 +196,33 @@ flush_cache_maybe(struct tcb *tcp)
 		error_msg("dwfl_report_end returned an error"
 			  " for pid %d: %s", tcp->pid, dwfl_errmsg(-1));
 
-	ctx->last_proc_updating = mapping_generation;
+	ctx->last_proc_updating = ctx->mapping_generation;
 }
 
 struct frame_user_data {
 	unwind_call_action_fn call_action;
 	unwind_error_action_fn error_action;
+	unwind_pc_action_fn pc_action;
 	void *data;
 	int stack_depth;
 	struct ctx *ctx;
 };
 
 static bool
-find_bucket(struct ctx *ctx, Dwarf_Addr pc, struct cache_entry **res) {
+find_bucket(struct ctx *ctx, Dwarf_Addr pc, unsigned long long generation,
+	    struct cache_entry **res) {
 	unsigned int idx = pc & ((STRACE_UW_CACHE_SIZE-1) &
 				 ~(STRACE_UW_CACHE_ASSOC-1));
 	struct cache_entry *unused = NULL;
 	struct cache_entry *lru = ctx->cache + idx;
 	for (unsigned int i = 0; i < STRACE_UW_CACHE_ASSOC; ++i) {
 		struct cache_entry *ce = ctx->cache + (idx + i);
-		if (ce->generation == mapping_generation && ce->pc == pc) {
+		if (ce->generation == generation && ce->pc == pc) {
 			ce->last_use = uwcache_clock++;
 			*res = ce;
 			return true;
 		}
-		if (ce->generation != mapping_generation) {
+		if (ce->generation != generation) {
 			unused = ce;
 			continue;
 		}
@@ -172,6 +234,114 @@ find_bucket(struct ctx *ctx, Dwarf_Addr pc, struct cache_entry **res) {
 	return false;
 }
 
+/*
+ * Returns the length of the build id of the module, reading it
+ * from the ELF file of the module if it is not known yet.
+ */
+static int
+module_build_id(Dwfl_Module *mod, const unsigned char **build_id)
+{
+	GElf_Addr vaddr;
+	int len = dwfl_module_build_id(mod, build_id, &vaddr);
+
+	if (len == 0) {
+		GElf_Addr bias;
+
+		if (dwfl_module_getelf(mod, &bias))
+			len = dwfl_module_build_id(mod, build_id, &vaddr);
+	}
+
+	return len;
+}
+
+static void
+resolve_pc(struct ctx *ctx, Dwarf_Addr pc, unsigned long long generation,
+	   unwind_call_action_fn call_action, void *data)
+{
+	struct cache_entry *ce;
+	if (find_bucket(ctx, pc, generation, &ce)) {
+		call_action(data,
+			    ce->modname, ce->symname,
+			    ce->off, ce->true_offset,
+			    ce->source_filename, ce->source_line);
+		return;
+	}
+
+	Dwfl_Module *mod = dwfl_addrmodule(ctx->dwfl, pc);
+	GElf_Off off = 0;
+
+	if (mod == NULL)
+		return;
+
+	const char *modname = NULL;
+	const char *symname = NULL;
+	GElf_Sym sym;
+	Dwarf_Addr start = 0;
+	Dwarf_Addr true_offset = pc;
+	const char *source_filename = NULL;
+	int source_line = 0;
+	const unsigned char *build_id = NULL;
+	int build_id_len = 0;
+	struct symcache_entry se;
+
+	modname = dwfl_module_info(mod, NULL, &start, NULL, NULL,
+				   NULL, NULL, NULL);
+	if (symcache_enabled())
+		build_id_len = module_build_id(mod, &build_id);
+
+	if (build_id_len > 0 &&
+	    symcache_lookup(build_id, build_id_len, pc - start,
+			    with_srcinfo, &se)) {
+		symname = se.symbol_name;
+		off = se.function_offset;
+		true_offset = se.true_offset;
+		source_filename = se.source_filename;
+		source_line = se.source_line;
+	} else {
+		symname = dwfl_module_addrinfo(mod, pc, &off, &sym,
+					       NULL, NULL, NULL);
+		dwfl_module_relocate_address(mod, &true_offset);
+		if (with_srcinfo) {
+			Dwfl_Line *dwfl_line;
+
+			dwfl_line = dwfl_module_getsrc(mod, pc);
+			if (dwfl_line)
+				source_filename =
+					dwfl_lineinfo(dwfl_line, NULL,
+						      &source_line, NULL,
+						      NULL, NULL);
+		}
+
+		if (build_id_len > 0) {
+			se = (struct symcache_entry) {
+				.symbol_name = symname,
+				.function_offset = off,
+				.true_offset = true_offset,
+				.source_filename = source_filename,
+				.source_line = source_line,
+				.with_srcinfo = with_srcinfo,
+			};
+			symcache_store(build_id, build_id_len, pc - start,
+				       &se);
+			symname = se.symbol_name;
+			source_filename = se.source_filename;
+		}
+	}
+
+	call_action(data, modname, symname, off, true_offset,
+		    source_filename, source_line);
+
+	ce->generation = generation;
+	ce->pc = pc;
+	ce->modname = modname;
+	ce->symname = symname;
+	ce->off = off;
+	ce->true_offset = true_offset;
+	ce->source_filename = source_filename;
+	ce->source_line = source_line;
+	ce->last_use = uwcache_clock++;
+}
+
 static int
 frame_callback(Dwfl_Frame *state, void *arg)
 {
@@ -187,54 +357,12 @@ frame_callback(Dwfl_Frame *state, void *arg)
 	if (!isactivation)
 		pc--;
 
-	struct cache_entry *ce;
-	if (find_bucket(user_data->ctx, pc, &ce)) {
-		user_data->call_action(user_data->data,
-				       ce->modname, ce->symname,
-			               ce->off, ce->true_offset,
-				       ce->source_filename, ce->source_line);
-	} else {
-		Dwfl *dwfl = dwfl_thread_dwfl(dwfl_frame_thread(state));
-		Dwfl_Module *mod = dwfl_addrmodule(dwfl, pc);
-		GElf_Off off = 0;
-
-		if (mod != NULL) {
-			const char *modname = NULL;
-			const char *symname = NULL;
-			GElf_Sym sym;
-			Dwarf_Addr true_offset = pc;
-			const char *source_filename = NULL;
-			int source_line = 0;
-
-			modname = dwfl_module_info(mod, NULL, NULL, NULL, NULL,
-						   NULL, NULL, NULL);
-			symname = dwfl_module_addrinfo(mod, pc, &off, &sym,
-						       NULL, NULL, NULL);
-			dwfl_module_relocate_address(mod, &true_offset);
-			if (with_srcinfo) {
-				Dwfl_Line *dwfl_line;
-
-				dwfl_line = dwfl_module_getsrc(mod, pc);
-				if (dwfl_line)
-					source_filename = dwfl_lineinfo(dwfl_line, NULL,
-									&source_line, NULL,
-									NULL, NULL);
-			}
-			user_data->call_action(user_data->data, modname, symname,
-					       off, true_offset,
-					       source_filename, source_line);
-
-			ce->generation = mapping_generation;
-			ce->pc = pc;
-			ce->modname = modname;
-			ce->symname = symname;
-			ce->off = off;
-			ce->true_offset = true_offset;
-			ce->source_filename = source_filename;
-			ce->source_line = source_line;
-			ce->last_use = uwcache_clock++;
-		}
-	}
+	if (user_data->pc_action)
+		user_data->pc_action(user_data->data, pc);
+	else
+		resolve_pc(user_data->ctx, pc,
+			   user_data->ctx->last_proc_updating,
+			   user_data->call_action, user_data->data);
 
 	/* Max number of frames to print reached? */
 	if (--user_data->stack_depth == 0)
@@ -243,6 +371,20 @@ frame_callback(Dwfl_Frame *state, void *arg)
 	return DWARF_CB_OK;
 }
 
+static void
+walk(struct tcb *tcp, struct frame_user_data *user_data)
+{
+	flush_cache_maybe(tcp);
+
+	int r = dwfl_getthread_frames(user_data->ctx->dwfl, tcp->pid,
+				      frame_callback, user_data);
+	if (r)
+		user_data->error_action(user_data->data,
+					r < 0 ? dwfl_errmsg(-1)
+					      : "too many stack frames",
+					0);
+}
+
 static void
 tcb_walk(struct tcb *tcp,
 	 unwind_call_action_fn call_action,
@@ -261,14 +403,53 @@ tcb_walk(struct tcb *tcp,
 		.ctx = ctx,
 	};
 
-	flush_cache_maybe(tcp);
+	walk(tcp, &user_data);
+}
 
-	int r = dwfl_getthread_frames(ctx->dwfl, tcp->pid, frame_callback,
-				      &user_data);
-	if (r)
-		error_action(data,
-			     r < 0 ? dwfl_errmsg(-1) : "too many stack frames",
-			     0);
+static unsigned long long
+tcb_capture(struct tcb *tcp,
+	    unwind_pc_action_fn pc_action,
+	    unwind_error_action_fn error_action,
+	    void *data)
+{
+	struct ctx *ctx = tcp->unwind_ctx;
+	if (!ctx)
+		return 0;
+
+	struct frame_user_data user_data = {
+		.error_action = error_action,
+		.pc_action = pc_action,
+		.data = data,
+		.stack_depth = stack_trace_limit,
+		.ctx = ctx,
+	};
+
+	walk(tcp, &user_data);
+
+	return ctx->last_proc_updating;
+}
+
+static void
+tcb_symbolize(struct tcb *tcp, unsigned long pc,
+	      unsigned long long generation,
+	      unwind_call_action_fn call_action,
+	      unwind_error_action_fn error_action,
+	      void *data)
+{
+	struct ctx *ctx = tcp->unwind_ctx;
+	if (!ctx)
+		return;
+
+	/*
+	 * The modules of the context have been reported again
+	 * since the program counter was obtained.
+	 */
+	if (generation != ctx->last_proc_updating) {
+		error_action(data, "memory mappings changed", pc);
+		return;
+	}
+
+	resolve_pc(ctx, pc, generation, call_action, data);
 }
 
 const struct unwind_unwinder_t unwinder = {
@@ -277,4 +458,6 @@ const struct unwind_unwinder_t unwinder = {
 	.tcb_init = tcb_init,
 	.tcb_fin = tcb_fin,
 	.tcb_walk = tcb_walk,
+	.tcb_capture = tcb_capture,
+	.tcb_symbolize = tcb_symbolize,
 };
@@ -0,0 +1,426 @@
+/*
+ * Persistent cache of symbols resolved by the stack trace unwinder.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "defs.h"
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "largefile_wrappers.h"
+#include "unwind-symcache.h"
+
+/*
+ * The cache file consists of a header followed by records.  The file
+ * is only appended to, under an exclusive lock, so several instances
+ * of strace can share the file.  Every record starts with a magic
+ * number and is protected by a checksum, malformed records are skipped.
+ * A record that has not been written completely, e.g. because strace
+ * has been killed or the disk is full, is truncated off the file.
+ * The file is started anew when it grows beyond SYMCACHE_MAX_SIZE.
+ */
+#define SYMCACHE_MAGIC		"STRACESC"
+#define SYMCACHE_VERSION	2
+#define SYMCACHE_BYTE_ORDER	0x01020304
+#define SYMCACHE_RECORD_MAGIC	0x53594d52
+#define SYMCACHE_MAX_SIZE	(32 << 20)
+
+struct symcache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+};
+
+enum {
+	SYMCACHE_HAS_SYMBOL	= 1 << 0,
+	SYMCACHE_HAS_SRCINFO	= 1 << 1,
+	SYMCACHE_HAS_SRCFILE	= 1 << 2,
+};
+
+struct symcache_record {
+	uint32_t magic;
+	/* FNV-1a hash of the record starting with the size field */
+	uint32_t checksum;
+	/* Size of the record including the data, a multiple of 8 */
+	uint32_t size;
+	uint16_t build_id_len;
+	uint16_t flags;
+	uint64_t offset;
+	uint64_t function_offset;
+	uint64_t true_offset;
+	int32_t source_line;
+	uint16_t symbol_name_len;
+	uint16_t source_filename_len;
+	/*
+	 * The build id followed by the symbol name and the source file name,
+	 * each of the names is terminated by '\0'.
+	 */
+	unsigned char data[];
+};
+
+static int symcache_fd = -1;
+static const char *symcache_path;
+/* The size of the file when it was read by this process last time */
+static off_t symcache_end;
+
+/* Open addressing hash table of records */
+static const struct symcache_record **table;
+static size_t table_size;
+static size_t table_count;
+
+bool
+symcache_enabled(void)
+{
+	return symcache_fd >= 0;
+}
+
+static size_t
+record_hash(const unsigned char *build_id, unsigned int build_id_len,
+	    uint64_t offset)
+{
+	/* FNV-1a */
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	for (unsigned int i = 0; i < build_id_len; ++i)
+		h = (h ^ build_id[i]) * 0x100000001b3ULL;
+	for (unsigned int i = 0; i < sizeof(offset); ++i)
+		h = (h ^ ((offset >> (i * 8)) & 0xff)) * 0x100000001b3ULL;
+
+	return h;
+}
+
+static bool
+record_matches(const struct symcache_record *rec,
+	       const unsigned char *build_id, unsigned int build_id_len,
+	       uint64_t offset)
+{
+	return rec->offset == offset && rec->build_id_len == build_id_len &&
+	       !memcmp(rec->data, build_id, build_id_len);
+}
+
+static const struct symcache_record **
+find_slot(const unsigned char *build_id, unsigned int build_id_len,
+	  uint64_t offset)
+{
+	size_t mask = table_size - 1;
+
+	for (size_t i = record_hash(build_id, build_id_len, offset) & mask;;
+	     i = (i + 1) & mask) {
+		if (!table[i] ||
+		    record_matches(table[i], build_id, build_id_len, offset))
+			return &table[i];
+	}
+}
+
+static void
+insert_record(const struct symcache_record *rec)
+{
+	if ((table_count + 1) * 2 > table_size) {
+		const struct symcache_record **old_table = table;
+		size_t old_size = table_size;
+
+		table_size = table_size ? table_size * 2 : 1024;
+		table = xcalloc(table_size, sizeof(*table));
+		for (size_t i = 0; i < old_size; ++i) {
+			if (old_table[i])
+				*find_slot(old_table[i]->data,
+					   old_table[i]->build_id_len,
+					   old_table[i]->offset) = old_table[i];
+		}
+		free(old_table);
+	}
+
+	const struct symcache_record **slot =
+		find_slot(rec->data, rec->build_id_len, rec->offset);
+
+	/* A newer record replaces the older one, e.g. one without srcinfo.  */
+	if (!*slot)
+		++table_count;
+	*slot = rec;
+}
+
+static uint32_t
+record_checksum(const struct symcache_record *rec)
+{
+	const unsigned char *p = (const unsigned char *) &rec->size;
+	const unsigned char *end = (const unsigned char *) rec + rec->size;
+	/* FNV-1a */
+	uint32_t h = 0x811c9dc5U;
+
+	for (; p < end; ++p)
+		h = (h ^ *p) * 0x01000193U;
+
+	return h;
+}
+
+static bool
+is_valid_record(const struct symcache_record *rec, size_t avail)
+{
+	if (avail < sizeof(*rec) || rec->magic != SYMCACHE_RECORD_MAGIC ||
+	    rec->size < sizeof(*rec) || rec->size > avail || rec->size % 8 ||
+	    rec->checksum != record_checksum(rec))
+		return false;
+
+	size_t len = sizeof(*rec) + rec->build_id_len +
+		     rec->symbol_name_len + 1 +
+		     rec->source_filename_len + 1;
+	if (len > rec->size)
+		return false;
+
+	const char *name = (const char *) rec->data + rec->build_id_len;
+	return name[rec->symbol_name_len] == '\0' &&
+	       name[rec->symbol_name_len + 1 + rec->source_filename_len] == '\0';
+}
+
+/*
+ * Read the records stored in the file starting at offset BEGIN,
+ * returns the offset of the end of the last valid one.
+ */
+static off_t
+load_records(off_t begin, off_t file_size)
+{
+	if (file_size <= begin)
+		return file_size;
+
+	/* The records are used until the program exits.  */
+	size_t size = file_size - begin;
+	char *buf = xmalloc(size);
+	ssize_t len = pread(symcache_fd, buf, size, begin);
+
+	if (len < 0) {
+		perror_msg("pread: %s", symcache_path);
+		free(buf);
+		return file_size;
+	}
+
+	const char *p = buf;
+	const char *end = buf + len;
+	const char *valid_end = buf;
+	size_t count = 0;
+
+	/*
+	 * The records are aligned on 8 bytes, look for the next valid one
+	 * if a malformed record is found.
+	 */
+	while (end - p >= (ptrdiff_t) sizeof(struct symcache_record)) {
+		const struct symcache_record *rec = (const void *) p;
+
+		if (!is_valid_record(rec, end - p)) {
+			if (p == valid_end)
+				debug_msg("%s: malformed record at offset %llu",
+					  symcache_path,
+					  (unsigned long long) (begin + (p - buf)));
+			p += 8;
+			continue;
+		}
+
+		insert_record(rec);
+		++count;
+		p += rec->size;
+		valid_end = p;
+	}
+
+	debug_msg("%s: %zu records loaded", symcache_path, count);
+	if (!count)
+		free(buf);
+
+	return begin + (valid_end - buf);
+}
+
+static void
+lock_file(int op)
+{
+	if (flock(symcache_fd, op))
+		debug_perror_msg("flock: %s", symcache_path);
+}
+
+/* Truncate the file to SIZE, e.g. to drop an incomplete record.  */
+static void
+truncate_file(off_t size)
+{
+	if (ftruncate(symcache_fd, size))
+		perror_msg("ftruncate: %s", symcache_path);
+}
+
+void
+symcache_open(const char *path)
+{
+	static const struct symcache_header header = {
+		.magic = SYMCACHE_MAGIC,
+		.version = SYMCACHE_VERSION,
+		.byte_order = SYMCACHE_BYTE_ORDER,
+	};
+
+	int fd = open_file(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC,
+			   0644);
+	if (fd < 0) {
+		perror_msg("%s", path);
+		return;
+	}
+
+	symcache_fd = fd;
+	symcache_path = path;
+	lock_file(LOCK_EX);
+
+	strace_stat_t st;
+	if (fstat_fd(fd, &st)) {
+		perror_msg("fstat: %s", path);
+		goto fail;
+	}
+
+	if (st.st_size == 0) {
+		if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+			perror_msg("write: %s", path);
+			truncate_file(0);
+			goto fail;
+		}
+		st.st_size = sizeof(header);
+	} else {
+		struct symcache_header h;
+
+		if (pread(fd, &h, sizeof(h), 0) != sizeof(h) ||
+		    memcmp(&h, &header, sizeof(h))) {
+			error_msg("%s: not a symbol cache file of this version"
+				  " of strace", path);
+			goto fail;
+		}
+	}
+
+	if (st.st_size >= SYMCACHE_MAX_SIZE) {
+		debug_msg("%s: the file is too large, starting anew", path);
+		truncate_file(sizeof(header));
+		st.st_size = sizeof(header);
+	}
+
+	symcache_end = load_records(sizeof(header), st.st_size);
+	if (symcache_end < st.st_size) {
+		debug_msg("%s: truncating an incomplete record at offset %llu",
+			  path, (unsigned long long) symcache_end);
+		truncate_file(symcache_end);
+	}
+
+	lock_file(LOCK_UN);
+	return;
+
+fail:
+	close(fd);
+	symcache_fd = -1;
+}
+
+bool
+symcache_lookup(const unsigned char *build_id, unsigned int build_id_len,
+		uint64_t offset, bool with_srcinfo,
+		struct symcache_entry *entry)
+{
+	if (!table_count)
+		return false;
+
+	const struct symcache_record *rec =
+		*find_slot(build_id, build_id_len, offset);
+
+	if (!rec || (with_srcinfo && !(rec->flags & SYMCACHE_HAS_SRCINFO)))
+		return false;
+
+	const char *name = (const char *) rec->data + rec->build_id_len;
+
+	entry->symbol_name = rec->flags & SYMCACHE_HAS_SYMBOL ? name : NULL;
+	entry->function_offset = rec->function_offset;
+	entry->true_offset = rec->true_offset;
+	entry->source_filename = rec->flags & SYMCACHE_HAS_SRCFILE
+				 ? name + rec->symbol_name_len + 1 : NULL;
+	entry->source_line = rec->source_line;
+	entry->with_srcinfo = rec->flags & SYMCACHE_HAS_SRCINFO;
+
+	return true;
+}
+
+void
+symcache_store(const unsigned char *build_id, unsigned int build_id_len,
+	       uint64_t offset, struct symcache_entry *entry)
+{
+	const char *symbol_name = entry->symbol_name ?: "";
+	const char *source_filename = entry->source_filename ?: "";
+	size_t symbol_name_len = strlen(symbol_name);
+	size_t source_filename_len = strlen(source_filename);
+
+	if (build_id_len > UINT16_MAX || symbol_name_len > UINT16_MAX ||
+	    source_filename_len > UINT16_MAX)
+		return;
+
+	size_t size = ROUNDUP(sizeof(struct symcache_record) + build_id_len +
+			      symbol_name_len + 1 + source_filename_len + 1,
+			      8);
+	struct symcache_record *rec = xzalloc(size);
+
+	rec->size = size;
+	rec->build_id_len = build_id_len;
+	rec->flags = (entry->symbol_name ? SYMCACHE_HAS_SYMBOL : 0) |
+		     (entry->with_srcinfo ? SYMCACHE_HAS_SRCINFO : 0) |
+		     (entry->source_filename ? SYMCACHE_HAS_SRCFILE : 0);
+	rec->offset = offset;
+	rec->function_offset = entry->function_offset;
+	rec->true_offset = entry->true_offset;
+	rec->source_line = entry->source_line;
+	rec->symbol_name_len = symbol_name_len;
+	rec->source_filename_len = source_filename_len;
+
+	char *name = (char *) rec->data + build_id_len;
+	memcpy(rec->data, build_id, build_id_len);
+	memcpy(name, symbol_name, symbol_name_len + 1);
+	memcpy(name + symbol_name_len + 1, source_filename,
+	       source_filename_len + 1);
+
+	rec->magic = SYMCACHE_RECORD_MAGIC;
+	rec->checksum = record_checksum(rec);
+
+	lock_file(LOCK_EX);
+
+	strace_stat_t st;
+	if (fstat_fd(symcache_fd, &st)) {
+		debug_perror_msg("fstat: %s", symcache_path);
+		goto unlock;
+	}
+
+	/*
+	 * Load the records stored by other instances of strace
+	 * since the file was read last time, unless the file has been
+	 * started anew, and do not store the record if one of them
+	 * is as good.
+	 */
+	if (st.st_size > symcache_end)
+		load_records(symcache_end, st.st_size);
+	symcache_end = st.st_size;
+
+	struct symcache_entry stored;
+	if (symcache_lookup(build_id, build_id_len, offset,
+			    entry->with_srcinfo, &stored)) {
+		free(rec);
+		*entry = stored;
+		goto unlock;
+	}
+
+	if (st.st_size + size > SYMCACHE_MAX_SIZE) {
+		debug_msg("%s: the file is too large", symcache_path);
+	} else if (write(symcache_fd, rec, size) == (ssize_t) size) {
+		symcache_end = st.st_size + size;
+	} else {
+		debug_perror_msg("write: %s", symcache_path);
+		truncate_file(st.st_size);
+	}
+
+	/* The record is used until the program exits.  */
+	insert_record(rec);
+
+	if (entry->symbol_name)
+		entry->symbol_name = name;
+	if (entry->source_filename)
+		entry->source_filename = name + symbol_name_len + 1;
+
+unlock:
+	lock_file(LOCK_UN);
+}
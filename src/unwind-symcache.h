@@ -0,0 +1,54 @@
+/*
+ * Persistent cache of symbols resolved by the stack trace unwinder.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef STRACE_UNWIND_SYMCACHE_H
+# define STRACE_UNWIND_SYMCACHE_H
+
+# include "defs.h"
+
+struct symcache_entry {
+	/* NULL if the address is not covered by a symbol */
+	const char *symbol_name;
+	unsigned long function_offset;
+	unsigned long true_offset;
+	/* NULL if the source line information is not available */
+	const char *source_filename;
+	int source_line;
+	/* Whether the source line information has been looked up */
+	bool with_srcinfo;
+};
+
+/*
+ * Open the cache file, creating it if it does not exist,
+ * and load the entries stored in it.
+ */
+extern void symcache_open(const char *path);
+
+extern bool symcache_enabled(void);
+
+/*
+ * Look up the entry for the address at the offset from the start
+ * of the module with the build id.  If with_srcinfo is set,
+ * only the entries with source line information are considered.
+ * The strings of the entry are valid until the program exits.
+ */
+extern bool symcache_lookup(const unsigned char *build_id,
+			    unsigned int build_id_len, uint64_t offset,
+			    bool with_srcinfo, struct symcache_entry *entry);
+
+/*
+ * Store the entry in the cache and append it to the cache file.
+ * The strings of the entry are copied, and the entry is updated
+ * to point to the copies.
+ */
+extern void symcache_store(const unsigned char *build_id,
+			   unsigned int build_id_len, uint64_t offset,
+			   struct symcache_entry *entry);
+
+#endif /* !STRACE_UNWIND_SYMCACHE_H */
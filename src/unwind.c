@@ -7,6 +7,9 @@
 
 #include "defs.h"
 #include "unwind.h"
+#ifdef USE_LIBDW
+# include "unwind-symcache.h"
+#endif
 
 #ifdef USE_DEMANGLE
 /* Avoids including libiberty.h that has several undesirable definitions */
@@ -30,17 +33,38 @@ struct call_t {
 struct unwind_queue_t {
 	struct call_t *tail;
 	struct call_t *head;
+
+	/*
+	 * Program counters captured by unwind_tcb_print
+	 * in the deferred mode, resolved by unwind_tcb_print_deferred.
+	 */
+	unsigned long *pcs;
+	size_t pcs_size;
+	unsigned int pcs_count;
+	unsigned long long generation;
+	char *error;
+	unsigned long error_offset;
+	bool deferred;
 };
 
 static void queue_print(struct unwind_queue_t *queue);
+static void deferred_print(struct tcb *tcp);
 
 static const char asprintf_error_str[] = "???";
 
+static bool deferred_symbolization;
+
 void
-unwind_init(bool with_srcinfo, int stack_trace_limit)
+unwind_init(bool with_srcinfo, int stack_trace_limit, bool deferred,
+	    const char *symbol_cache)
 {
 	if (unwinder.init)
 		unwinder.init(with_srcinfo, stack_trace_limit);
+	deferred_symbolization = deferred && unwinder.tcb_capture;
+#ifdef USE_LIBDW
+	if (symbol_cache)
+		symcache_open(symbol_cache);
+#endif
 }
 
 void
@@ -49,9 +73,7 @@ unwind_tcb_init(struct tcb *tcp)
 	if (tcp->unwind_queue)
 		return;
 
-	tcp->unwind_queue = xmalloc(sizeof(*tcp->unwind_queue));
-	tcp->unwind_queue->head = NULL;
-	tcp->unwind_queue->tail = NULL;
+	tcp->unwind_queue = xzalloc(sizeof(*tcp->unwind_queue));
 
 	tcp->unwind_ctx = unwinder.tcb_init(tcp);
 }
@@ -63,6 +85,8 @@ unwind_tcb_fin(struct tcb *tcp)
 		return;
 
 	queue_print(tcp->unwind_queue);
+	deferred_print(tcp);
+	free(tcp->unwind_queue->pcs);
 	free(tcp->unwind_queue);
 	tcp->unwind_queue = NULL;
 
@@ -294,6 +318,63 @@ queue_print(struct unwind_queue_t *queue)
 	}
 }
 
+/*
+ * deferred symbolization
+ */
+static void
+deferred_put_pc(void *data, unsigned long pc)
+{
+	struct unwind_queue_t *queue = data;
+
+	if (queue->pcs_count >= queue->pcs_size)
+		queue->pcs = xgrowarray(queue->pcs, &queue->pcs_size,
+					sizeof(*queue->pcs));
+	queue->pcs[queue->pcs_count++] = pc;
+}
+
+static void
+deferred_put_error(void *data, const char *error, unsigned long true_offset)
+{
+	struct unwind_queue_t *queue = data;
+
+	free(queue->error);
+	queue->error = xstrdup(error);
+	queue->error_offset = true_offset;
+}
+
+static void
+deferred_capture(struct tcb *tcp)
+{
+	struct unwind_queue_t *queue = tcp->unwind_queue;
+
+	deferred_print(tcp);
+
+	queue->pcs_count = 0;
+	queue->generation = unwinder.tcb_capture(tcp, deferred_put_pc,
+						 deferred_put_error, queue);
+	queue->deferred = true;
+}
+
+static void
+deferred_print(struct tcb *tcp)
+{
+	struct unwind_queue_t *queue = tcp->unwind_queue;
+
+	if (!queue->deferred)
+		return;
+	queue->deferred = false;
+
+	for (unsigned int i = 0; i < queue->pcs_count; ++i)
+		unwinder.tcb_symbolize(tcp, queue->pcs[i], queue->generation,
+				       print_call_cb, print_error_cb, NULL);
+
+	if (queue->error) {
+		print_error_cb(NULL, queue->error, queue->error_offset);
+		free(queue->error);
+		queue->error = NULL;
+	}
+}
+
 /*
  * printing stack
  */
@@ -310,10 +391,22 @@ unwind_tcb_print(struct tcb *tcp)
 		debug_func_msg("head: tcp=%p, queue=%p",
 			       tcp, tcp->unwind_queue->head);
 		queue_print(tcp->unwind_queue);
-	} else
+	} else if (deferred_symbolization && !tcp->staged_output_data)
+		deferred_capture(tcp);
+	else
 		unwinder.tcb_walk(tcp, print_call_cb, print_error_cb, NULL);
 }
 
+/*
+ * printing the stack captured by unwind_tcb_print in the deferred mode
+ */
+void
+unwind_tcb_print_deferred(struct tcb *tcp)
+{
+	if (tcp->unwind_queue)
+		deferred_print(tcp);
+}
+
 /*
  * capturing stack
  */
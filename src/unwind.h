@@ -33,6 +33,7 @@ typedef void (*unwind_call_action_fn)(void *data,
 typedef void (*unwind_error_action_fn)(void *data,
 				       const char *error,
 				       unsigned long true_offset);
+typedef void (*unwind_pc_action_fn)(void *data, unsigned long pc);
 
 struct unwind_unwinder_t {
 	const char *name;
@@ -48,6 +49,24 @@ struct unwind_unwinder_t {
 			   unwind_call_action_fn,
 			   unwind_error_action_fn,
 			   void *);
+
+	/*
+	 * Walk the stack without resolving the program counters,
+	 * returns the generation of the memory mappings they refer to.
+	 * Optional, used by --stack-trace-deferred.
+	 */
+	unsigned long long (*tcb_capture)(struct tcb *,
+					  unwind_pc_action_fn,
+					  unwind_error_action_fn,
+					  void *);
+
+	/* Resolve a program counter obtained from tcb_capture. */
+	void   (*tcb_symbolize)(struct tcb *,
+				unsigned long pc,
+				unsigned long long generation,
+				unwind_call_action_fn,
+				unwind_error_action_fn,
+				void *);
 };
 
 extern const struct unwind_unwinder_t unwinder;
@@ -14,12 +14,16 @@
 
 #include "defs.h"
 #include "ptrace.h"
+#include "record.h"
 
 int
 upeek(struct tcb *tcp, unsigned long off, kernel_ulong_t *res)
 {
 	long val;
 
+	if (replaying)
+		return replay_peekuser(off, res);
+
 	errno = 0;
 	val = ptrace(PTRACE_PEEKUSER, (pid_t) tcp->pid, (void *) off, 0);
 	if (val == -1 && errno) {
@@ -29,5 +33,7 @@ upeek(struct tcb *tcp, unsigned long off, kernel_ulong_t *res)
 		return -1;
 	}
 	*res = (unsigned long) val;
+	if (recording)
+		record_peekuser(off, *res);
 	return 0;
 }
@@ -22,6 +22,11 @@
 # include <sys/xattr.h>
 #endif
 #include <sys/uio.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+#include <asm/unistd.h>
+#include <linux/kcmp.h>
 
 #include "largefile_wrappers.h"
 #include "number_set.h"
@@ -595,7 +600,7 @@ getfdproto(struct tcb *tcp, int fd)
 #endif
 }
 
-static unsigned long
+unsigned long
 get_inode_of_socket_path(const char *path)
 {
 	const char *str = STR_STRIP_PREFIX(path, "socket:[");
@@ -1105,6 +1110,152 @@ proc_status_get_id_list(int proc_pid, int *id_buf, size_t id_buf_size,
 	return n;
 }
 
+static bool
+is_same_kcmp_resource(int pid1, int pid2, int type)
+{
+#ifdef __NR_kcmp
+	return syscall(__NR_kcmp, pid1, pid2, type, 0, 0) == 0;
+#else
+	return false;
+#endif
+}
+
+static void *
+find_by_kcmp_resource(struct tcb *tcp, int proc_pid, int type,
+		      bool check_tgid, void *(*find_fn)(int id), int *tgid)
+{
+	static const char tgid_str[] = "Tgid:\t";
+	static const char ppid_str[] = "PPid:\t";
+	int ppid = 0;
+	void *res = NULL;
+
+	*tgid = 0;
+	if (proc_status_get_id_list(proc_pid, tgid, 1, tgid_str,
+				    sizeof(tgid_str) - 1) != 1 || *tgid <= 0) {
+		*tgid = 0;
+		return NULL;
+	}
+
+	/*
+	 * Ids read from /proc can be passed to kcmp only
+	 * if /proc belongs to the PID namespace of strace.
+	 */
+	if (check_tgid && *tgid != tcp->pid &&
+	    (proc_pid != tcp->pid ||
+	     !is_same_kcmp_resource(tcp->pid, *tgid, type))) {
+		*tgid = 0;
+		return NULL;
+	}
+
+	res = find_fn(*tgid);
+	if (res)
+		return res;
+
+	if (proc_pid != tcp->pid ||
+	    proc_status_get_id_list(proc_pid, &ppid, 1, ppid_str,
+				    sizeof(ppid_str) - 1) != 1 || ppid <= 0)
+		return NULL;
+
+	res = find_fn(ppid);
+	if (res && !is_same_kcmp_resource(tcp->pid, ppid, type))
+		res = NULL;
+
+	return res;
+}
+
+void *
+find_by_address_space(struct tcb *tcp, int proc_pid,
+		      void *(*find_fn)(int id), int *tgid)
+{
+	/* Threads of a process always share its address space.  */
+	return find_by_kcmp_resource(tcp, proc_pid, KCMP_VM, false,
+				     find_fn, tgid);
+}
+
+void *
+find_by_descriptor_table(struct tcb *tcp, int proc_pid,
+			 void *(*find_fn)(int id), int *tgid)
+{
+	/*
+	 * A thread can be created without CLONE_FILES
+	 * or unshare its descriptor table.
+	 */
+	return find_by_kcmp_resource(tcp, proc_pid, KCMP_FILES, true,
+				     find_fn, tgid);
+}
+
+/*
+ * Returns the length of the longest prefix of `str' of length `size'
+ * that consists of printable ASCII characters only; if `plain' is set,
+ * '"' and '\\' characters end the prefix, too.
+ *
+ * This is the classifier used by string_quote to skip or copy in bulk
+ * the characters that need no escaping, it checks 16 (with SSE2)
+ * or 8 bytes at a time.
+ */
+static unsigned int
+printable_prefix_len(const unsigned char *str, unsigned int size, bool plain)
+{
+	unsigned int i = 0;
+
+#ifdef __SSE2__
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i del = _mm_set1_epi8(0x7f);
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+
+	for (; i + 16 <= size; i += 16) {
+		const __m128i v = _mm_loadu_si128((const void *) (str + i));
+		/*
+		 * Bytes above 0x7f are negative in signed comparisons,
+		 * so they are less than ' ', too.
+		 */
+		__m128i bad = _mm_or_si128(_mm_cmplt_epi8(v, space),
+					   _mm_cmpeq_epi8(v, del));
+		if (plain)
+			bad = _mm_or_si128(bad,
+					   _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+							_mm_cmpeq_epi8(v, backslash)));
+
+		const unsigned int mask = _mm_movemask_epi8(bad);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#else
+# define ONES		0x0101010101010101ULL
+# define HIGHS		0x8080808080808080ULL
+/* Whether the word has a byte less than n, n <= 128.  */
+# define HAS_LESS(x_, n_)	(((x_) - ONES * (n_)) & ~(x_) & HIGHS)
+/* Whether the word has a byte greater than n, n <= 127.  */
+# define HAS_MORE(x_, n_)	((((x_) + ONES * (127 - (n_))) | (x_)) & HIGHS)
+/* Whether the word has a byte equal to c.  */
+# define HAS_BYTE(x_, c_)	HAS_LESS((x_) ^ (ONES * (c_)), 1)
+
+	for (; i + 8 <= size; i += 8) {
+		uint64_t v;
+
+		memcpy(&v, str + i, sizeof(v));
+		if (HAS_LESS(v, ' ') || HAS_MORE(v, 0x7e) ||
+		    (plain && (HAS_BYTE(v, '"') || HAS_BYTE(v, '\\'))))
+			break;
+	}
+
+# undef HAS_BYTE
+# undef HAS_MORE
+# undef HAS_LESS
+# undef HIGHS
+# undef ONES
+#endif /* __SSE2__ */
+
+	for (; i < size; ++i) {
+		if (!is_print(str[i]) ||
+		    (plain && (str[i] == '"' || str[i] == '\\')))
+			break;
+	}
+
+	return i;
+}
+
 /*
  * Quote string `instr' of length `size'
  * Write up to (3 + `size' * 4) bytes to `outstr' buffer.
@@ -1148,6 +1299,10 @@ string_quote(const char *instr, char *outstr, const unsigned int size,
 		/* Check for presence of symbol which require
 		   to hex-quote the whole string. */
 		for (i = 0; i < size; ++i) {
+			i += printable_prefix_len(ustr + i, size - i, false);
+			if (i >= size)
+				break;
+
 			c = ustr[i];
 			/* Check for NUL-terminated string. */
 			if (c == eol)
@@ -1227,7 +1382,15 @@ string_quote(const char *instr, char *outstr, const unsigned int size,
 			if (printable && escape_chars)
 				printable = !strchr(escape_chars, c);
 
-			if (printable) {
+			if (printable && !escape_chars) {
+				/* Copy the run of characters as is.  */
+				unsigned int n =
+					printable_prefix_len(ustr + i,
+							     size - i, true);
+				memcpy(s, ustr + i, n);
+				s += n;
+				i += n - 1;
+			} else if (printable) {
 				*s++ = c;
 			} else {
 				if (xstyle == HEXSTR_NON_ASCII_CHARS) {
@@ -1537,10 +1700,19 @@ print_nonzero_bytes(struct tcb *const tcp,
 	return ret;
 }
 
+static void
+dumpstr_ex(struct tcb *, kernel_ulong_t addr, kernel_ulong_t len,
+	   const unsigned char *prefetched);
+
 void
 dumpiov_upto(struct tcb *const tcp, const int len, const kernel_ulong_t addr,
 	     kernel_ulong_t data_size)
 {
+	enum {
+		/** Maximum size of the buffers fetched by a single umovev.  */
+		DUMPIOV_BATCH_MAXSZ = 1 << 16,
+	};
+
 #if ANY_WORDSIZE_LESS_THAN_KERNEL_LONG
 	union {
 		struct { uint32_t base; uint32_t len; } *iov32;
@@ -1573,7 +1745,49 @@ dumpiov_upto(struct tcb *const tcp, const int len, const kernel_ulong_t addr,
 			       " %u bytes", size);
 		return;
 	}
+
+	struct umove_iov *vec = NULL;
+	unsigned char *buf = NULL;
+	unsigned int nfetched = 0;
+
 	if (umoven(tcp, addr, size, iov) >= 0) {
+		/*
+		 * If the buffers are small enough, fetch all of them
+		 * at once instead of issuing a separate read for each one.
+		 */
+		kernel_ulong_t left = data_size;
+		kernel_ulong_t total = 0;
+		int cnt;
+
+		for (cnt = 0; cnt < len && left; ++cnt) {
+			const kernel_ulong_t iov_len =
+				MIN(iov_iov_len(cnt), left);
+			if (!iov_len)
+				break;
+			left -= iov_len;
+			total += iov_len;
+		}
+
+		if (cnt > 1 && total <= DUMPIOV_BATCH_MAXSZ) {
+			vec = malloc(cnt * sizeof(*vec));
+			buf = malloc(total);
+		}
+
+		if (vec && buf) {
+			unsigned char *p = buf;
+
+			left = data_size;
+			for (int i = 0; i < cnt; ++i) {
+				vec[i].addr = iov_iov_base(i);
+				vec[i].len = MIN(iov_iov_len(i), left);
+				vec[i].laddr = p;
+				p += vec[i].len;
+				left -= vec[i].len;
+			}
+
+			nfetched = umovev(tcp, vec, cnt);
+		}
+
 		for (int i = 0; i < len; ++i) {
 			kernel_ulong_t iov_len = iov_iov_len(i);
 			if (iov_len > data_size)
@@ -1585,9 +1799,13 @@ dumpiov_upto(struct tcb *const tcp, const int len, const kernel_ulong_t addr,
 			 * match up the trace with the source */
 			tprintf_string(" * %" PRI_klu " bytes in buffer %d\n",
 				       iov_len, i);
-			dumpstr(tcp, iov_iov_base(i), iov_len);
+			dumpstr_ex(tcp, iov_iov_base(i), iov_len,
+				   (unsigned int) i < nfetched
+				   ? vec[i].laddr : NULL);
 		}
 	}
+	free(buf);
+	free(vec);
 	free(iov);
 #undef sizeof_iov
 #undef iov_iov_base
@@ -1595,40 +1813,176 @@ dumpiov_upto(struct tcb *const tcp, const int len, const kernel_ulong_t addr,
 #undef iov
 }
 
-void
-dumpstr(struct tcb *const tcp, const kernel_ulong_t addr,
-	const kernel_ulong_t len)
+/* xx xx xx xx xx xx xx xx  xx xx xx xx xx xx xx xx  1234567890123456 */
+enum {
+	HEX_BIT = 4,
+
+	DUMPSTR_GROUP_BYTES = 8,
+	DUMPSTR_GROUPS = 2,
+	DUMPSTR_WIDTH_BYTES = DUMPSTR_GROUP_BYTES * DUMPSTR_GROUPS,
+
+	/** Width of the hex part of the formatted dump in characters.  */
+	DUMPSTR_HEX_CHARS = sizeof("xx") * DUMPSTR_WIDTH_BYTES + DUMPSTR_GROUPS,
+
+	/** Width of formatted dump in characters.  */
+	DUMPSTR_WIDTH_CHARS = DUMPSTR_HEX_CHARS + DUMPSTR_WIDTH_BYTES,
+
+	DUMPSTR_BYTES_MASK = DUMPSTR_WIDTH_BYTES - 1,
+
+	/** Minimal width of the offset field in the output.  */
+	DUMPSTR_OFFS_MIN_CHARS = 5,
+
+	/** Maximal width of the offset field in the output.  */
+	DUMPSTR_OFFS_MAX_CHARS = sizeof(kernel_ulong_t) * 8 / HEX_BIT,
+
+	/** Maximal length of a formatted line, " | offset  dump |\n".  */
+	DUMPSTR_LINE_MAX_CHARS = sizeof(" | ") - 1 + DUMPSTR_OFFS_MAX_CHARS +
+		sizeof("  ") - 1 + DUMPSTR_WIDTH_CHARS + sizeof(" |\n") - 1,
+
+	/** Number of lines formatted before they are written out.  */
+	DUMPSTR_OUTBUF_LINES = 128,
+
+	/** Arbitrarily chosen internal dumpstr buffer limit.  */
+	DUMPSTR_BUF_MAXSZ = 1 << 16,
+};
+
+static_assert(!(DUMPSTR_BUF_MAXSZ % DUMPSTR_WIDTH_BYTES),
+	      "Maximum internal buffer size should be divisible "
+	      "by amount of bytes dumped per line");
+static_assert(!(DUMPSTR_WIDTH_BYTES & DUMPSTR_BYTES_MASK),
+	      "DUMPSTR_WIDTH_BYTES is not power of 2");
+
+/** Position of the hex representation of the byte in the dump line.  */
+#define DUMPSTR_HEX_POS(i_)	\
+	(sizeof("xx") * (i_) + (i_) / DUMPSTR_GROUP_BYTES)
+
+#define NIBBLE_HEX_CHAR(n_)	((n_) < 10 ? '0' + (n_) : 'a' - 10 + (n_))
+#define HEX_PAIR(b_)	{ NIBBLE_HEX_CHAR((b_) >> 4), NIBBLE_HEX_CHAR((b_) & 0xf) }
+#define HEX_PAIRS4(b_)	\
+	HEX_PAIR(b_), HEX_PAIR((b_) + 1), HEX_PAIR((b_) + 2), HEX_PAIR((b_) + 3)
+#define HEX_PAIRS16(b_)	\
+	HEX_PAIRS4(b_), HEX_PAIRS4((b_) + 4),	\
+	HEX_PAIRS4((b_) + 8), HEX_PAIRS4((b_) + 12)
+#define HEX_PAIRS64(b_)	\
+	HEX_PAIRS16(b_), HEX_PAIRS16((b_) + 16),	\
+	HEX_PAIRS16((b_) + 32), HEX_PAIRS16((b_) + 48)
+
+/** Hexadecimal representation of every byte value.  */
+static const char dumpstr_hex_pairs[256][2] = {
+	HEX_PAIRS64(0), HEX_PAIRS64(64), HEX_PAIRS64(128), HEX_PAIRS64(192)
+};
+
+#undef HEX_PAIRS64
+#undef HEX_PAIRS16
+#undef HEX_PAIRS4
+#undef HEX_PAIR
+#undef NIBBLE_HEX_CHAR
+
+#ifdef __SSE2__
+/** Convert every byte in the 0..15 range to a lowercase hex digit.  */
+static inline __m128i
+nibbles_to_hex(const __m128i n)
 {
-	/* xx xx xx xx xx xx xx xx  xx xx xx xx xx xx xx xx  1234567890123456 */
-	enum {
-		HEX_BIT = 4,
+	const __m128i above_9 = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
 
-		DUMPSTR_GROUP_BYTES = 8,
-		DUMPSTR_GROUPS = 2,
-		DUMPSTR_WIDTH_BYTES = DUMPSTR_GROUP_BYTES * DUMPSTR_GROUPS,
+	return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')),
+			    _mm_and_si128(above_9,
+					  _mm_set1_epi8('a' - '0' - 10)));
+}
+#endif /* __SSE2__ */
 
-		/** Width of formatted dump in characters.  */
-		DUMPSTR_WIDTH_CHARS = DUMPSTR_WIDTH_BYTES +
-			sizeof("xx") * DUMPSTR_WIDTH_BYTES + DUMPSTR_GROUPS,
+/*
+ * Format the hex and ASCII parts of the dump line of `n' bytes at `src',
+ * n <= DUMPSTR_WIDTH_BYTES, into DUMPSTR_WIDTH_CHARS characters at `dst'.
+ */
+static void
+sprint_dump_line(char *const dst, const unsigned char *const src,
+		 const unsigned int n)
+{
+	char *const ascii = dst + DUMPSTR_HEX_CHARS;
 
-		DUMPSTR_GROUP_MASK = DUMPSTR_GROUP_BYTES - 1,
-		DUMPSTR_BYTES_MASK = DUMPSTR_WIDTH_BYTES - 1,
+	memset(dst, ' ', DUMPSTR_WIDTH_CHARS);
 
-		/** Minimal width of the offset field in the output.  */
-		DUMPSTR_OFFS_MIN_CHARS = 5,
+#ifdef __SSE2__
+	if (n == DUMPSTR_WIDTH_BYTES) {
+		const __m128i v = _mm_loadu_si128((const void *) src);
+		const __m128i nibble = _mm_set1_epi8(0xf);
+		const __m128i hi =
+			nibbles_to_hex(_mm_and_si128(_mm_srli_epi16(v, 4),
+						     nibble));
+		const __m128i lo = nibbles_to_hex(_mm_and_si128(v, nibble));
+		char pairs[DUMPSTR_WIDTH_BYTES][2];
 
-		/** Arbitrarily chosen internal dumpstr buffer limit.  */
-		DUMPSTR_BUF_MAXSZ = 1 << 16,
-	};
+		_mm_storeu_si128((void *) pairs[0], _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((void *) pairs[8], _mm_unpackhi_epi8(hi, lo));
+		for (unsigned int i = 0; i < DUMPSTR_WIDTH_BYTES; ++i)
+			memcpy(dst + DUMPSTR_HEX_POS(i), pairs[i], 2);
 
-	static_assert(!(DUMPSTR_BUF_MAXSZ % DUMPSTR_WIDTH_BYTES),
-		      "Maximum internal buffer size should be divisible "
-		      "by amount of bytes dumped per line");
-	static_assert(!(DUMPSTR_GROUP_BYTES & DUMPSTR_GROUP_MASK),
-		      "DUMPSTR_GROUP_BYTES is not power of 2");
-	static_assert(!(DUMPSTR_WIDTH_BYTES & DUMPSTR_BYTES_MASK),
-		      "DUMPSTR_WIDTH_BYTES is not power of 2");
+		/*
+		 * Bytes above 0x7f are negative in signed comparisons,
+		 * so they are less than ' ', too.
+		 */
+		const __m128i dot =
+			_mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8(' ')),
+				     _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)));
+		_mm_storeu_si128((void *) ascii,
+				 _mm_or_si128(_mm_andnot_si128(dot, v),
+					      _mm_and_si128(dot,
+							    _mm_set1_epi8('.'))));
+		return;
+	}
+#endif /* __SSE2__ */
 
+	for (unsigned int i = 0; i < n; ++i) {
+		memcpy(dst + DUMPSTR_HEX_POS(i), dumpstr_hex_pairs[src[i]], 2);
+		ascii[i] = is_print(src[i]) ? src[i] : '.';
+	}
+}
+
+/*
+ * Format the dump lines of `n' bytes at `src' located at offset `offs'
+ * of the dumped memory into `dst', returns the end of the output.
+ */
+static char *
+sprint_dump_lines(char *dst, const unsigned char *src, unsigned int n,
+		  kernel_ulong_t offs, const unsigned int offs_chars)
+{
+	for (; n; offs += DUMPSTR_WIDTH_BYTES) {
+		const unsigned int line_len = MIN(n, DUMPSTR_WIDTH_BYTES);
+
+		memcpy(dst, " | ", 3);
+		dst += 3;
+		kernel_ulong_t o = offs;
+		for (unsigned int i = offs_chars; i > 0; --i, o >>= HEX_BIT)
+			dst[i - 1] = hex_chars[o & 0xf];
+		dst += offs_chars;
+		memcpy(dst, "  ", 2);
+		dst += 2;
+
+		sprint_dump_line(dst, src, line_len);
+		dst += DUMPSTR_WIDTH_CHARS;
+
+		memcpy(dst, " |\n", 3);
+		dst += 3;
+
+		src += line_len;
+		n -= line_len;
+	}
+
+	return dst;
+}
+
+/*
+ * Dump `len' bytes of tracee memory at `addr'.  If `prefetched' is not NULL,
+ * it points to the copy of that memory that has already been fetched.
+ *
+ * The dump is formatted a line at a time, and the lines are written out
+ * in batches of DUMPSTR_OUTBUF_LINES.
+ */
+static void
+dumpstr_ex(struct tcb *const tcp, const kernel_ulong_t addr,
+	   const kernel_ulong_t len, const unsigned char *const prefetched)
+{
 	if (len > len + DUMPSTR_WIDTH_BYTES || addr + len < addr) {
 		debug_func_msg("len %" PRI_klu " at addr %#" PRI_klx
 			       " is too big, skipped", len, addr);
@@ -1641,7 +1995,7 @@ dumpstr(struct tcb *const tcp, const kernel_ulong_t addr,
 	const kernel_ulong_t alloc_size =
 		MIN(ROUNDUP(len, DUMPSTR_WIDTH_BYTES), DUMPSTR_BUF_MAXSZ);
 
-	if (strsize < alloc_size) {
+	if (!prefetched && strsize < alloc_size) {
 		free(str);
 		str = malloc(alloc_size);
 		if (!str) {
@@ -1657,25 +2011,24 @@ dumpstr(struct tcb *const tcp, const kernel_ulong_t addr,
 	 * Characters needed in order to print the offset field. We calculate
 	 * it this way in order to avoid ilog2_64 call most of the time.
 	 */
-	const int offs_chars = len > (1 << (DUMPSTR_OFFS_MIN_CHARS * HEX_BIT))
+	const unsigned int offs_chars =
+		len > (1 << (DUMPSTR_OFFS_MIN_CHARS * HEX_BIT))
 		? 1 + ilog2_klong(len - 1) / HEX_BIT : DUMPSTR_OFFS_MIN_CHARS;
-	kernel_ulong_t i = 0;
-	const unsigned char *src;
 
-	while (i < len) {
-		/*
-		 * It is important to overwrite all the byte values, as we
-		 * re-use the buffer in order to avoid its re-initialisation.
-		 */
-		static char outbuf[] = {
-			[0 ... DUMPSTR_WIDTH_CHARS - 1] = ' ',
-			'\0'
-		};
-		char *dst = outbuf;
+	static char outbuf[DUMPSTR_LINE_MAX_CHARS * DUMPSTR_OUTBUF_LINES + 1];
+	const unsigned int batch_size =
+		DUMPSTR_WIDTH_BYTES * DUMPSTR_OUTBUF_LINES;
+
+	for (kernel_ulong_t i = 0; i < len; ) {
+		const unsigned char *src;
+		kernel_ulong_t fetch_size;
 
 		/* Fetching data from tracee.  */
-		if (!i || (i % DUMPSTR_BUF_MAXSZ) == 0) {
-			kernel_ulong_t fetch_size = MIN(len - i, alloc_size);
+		if (prefetched) {
+			src = prefetched + i;
+			fetch_size = len - i;
+		} else {
+			fetch_size = MIN(len - i, alloc_size);
 
 			if (umoven(tcp, addr + i, fetch_size, str) < 0) {
 				/*
@@ -1694,41 +2047,31 @@ dumpstr(struct tcb *const tcp, const kernel_ulong_t addr,
 			src = str;
 		}
 
-		/* hex dump */
-		do {
-			if (i < len) {
-				dst = sprint_byte_hex(dst, *src);
-			} else {
-				*dst++ = ' ';
-				*dst++ = ' ';
-			}
-			dst++; /* space is there */
-			i++;
-			if ((i & DUMPSTR_GROUP_MASK) == 0)
-				dst++; /* space is there */
-			src++;
-		} while (i & DUMPSTR_BYTES_MASK);
-
-		/* ASCII dump */
-		i -= DUMPSTR_WIDTH_BYTES;
-		src -= DUMPSTR_WIDTH_BYTES;
-		do {
-			if (i < len) {
-				if (is_print(*src))
-					*dst++ = *src;
-				else
-					*dst++ = '.';
-			} else {
-				*dst++ = ' ';
-			}
-			src++;
-		} while (++i & DUMPSTR_BYTES_MASK);
+		for (kernel_ulong_t done = 0; done < fetch_size; ) {
+			const unsigned int n = MIN(fetch_size - done,
+						   batch_size);
+			char *const end = sprint_dump_lines(outbuf, src + done,
+							    n, i + done,
+							    offs_chars);
+
+			*end = '\0';
+			tprints_string(outbuf);
+			done += n;
+		}
 
-		tprintf_string(" | %0*" PRI_klx "  %s |\n",
-			       offs_chars, i - DUMPSTR_WIDTH_BYTES, outbuf);
+		i += fetch_size;
 	}
 }
 
+#undef DUMPSTR_HEX_POS
+
+void
+dumpstr(struct tcb *const tcp, const kernel_ulong_t addr,
+	const kernel_ulong_t len)
+{
+	dumpstr_ex(tcp, addr, len, NULL);
+}
+
 bool
 tfetch_mem64(struct tcb *const tcp, const uint64_t addr,
 	     const unsigned int len, void *const our_addr)
@@ -1922,6 +2265,22 @@ print_array_ex(struct tcb *const tcp,
 	enum xlat_style xlat_style = flags & XLAT_STYLE_MASK;
 	bool truncated = false;
 
+	if (tfetch_mem_func && verbose(tcp) &&
+	    (entering(tcp) || !syserror(tcp))) {
+		/*
+		 * The elements after abbrev_end are not fetched, except
+		 * the first one, which tells that the array is truncated.
+		 * umove_prefetch does not fetch more than the umove cache
+		 * can hold.
+		 */
+		const kernel_ulong_t fetch_end = abbrev_end < end_addr
+						 ? abbrev_end + elem_size
+						 : end_addr;
+
+		umove_prefetch(tcp, start_addr,
+			       MIN(fetch_end - start_addr, -1U));
+	}
+
 	for (cur = start_addr; cur < end_addr; cur += elem_size, idx++) {
 		if (cur != start_addr)
 			tprint_array_next();
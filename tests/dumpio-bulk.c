@@ -0,0 +1,37 @@
+/*
+ * Write the requested amount of data to stdout in large chunks.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+int
+main(int ac, const char *av[])
+{
+	assert(ac == 2);
+
+	const unsigned long long total = strtoull(av[1], NULL, 0);
+	static unsigned char buf[1 << 16];
+
+	for (unsigned int i = 0; i < sizeof(buf); ++i)
+		buf[i] = i * 0x9d;
+
+	for (unsigned long long done = 0; done < total; ) {
+		const size_t len = total - done < sizeof(buf)
+				   ? total - done : sizeof(buf);
+		const ssize_t rc = write(1, buf, len);
+
+		if (rc <= 0)
+			perror_msg_and_fail("write");
+		done += rc;
+	}
+
+	return 0;
+}
@@ -0,0 +1,2 @@
+/* This file is part of dup-trace-fds-0-9--seccomp-bpf strace test. */
+#include "dup-trace-fds-0-9.c"
@@ -0,0 +1,2 @@
+/* This file is part of dup2-e-fd-0-9--seccomp-bpf strace test. */
+#include "dup2-e-fd-0-9.c"
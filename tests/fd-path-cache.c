@@ -0,0 +1,159 @@
+/*
+ * Check that paths of descriptors printed with -f -y are up to date
+ * after the descriptors are closed and reused, and that they are not
+ * shared between processes with different descriptor tables.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include "scno.h"
+
+#if defined __NR_dup2 && defined __NR_fcntl
+
+# include <errno.h>
+# include <fcntl.h>
+# include <pthread.h>
+# include <stdio.h>
+# include <unistd.h>
+# include <sys/socket.h>
+# include <sys/stat.h>
+# include <sys/wait.h>
+
+static const int fd = 10;
+static int pid;
+static unsigned long ino[2];
+
+static void
+k_dup2(const int i, const int oldfd)
+{
+	if (syscall(__NR_dup2, oldfd, fd) != fd)
+		perror_msg_and_fail("dup2");
+	printf("%-5d dup2(%d<socket:[%lu]>, %d) = %d<socket:[%lu]>\n",
+	       pid, oldfd, ino[i], fd, fd, ino[i]);
+}
+
+static void
+k_dup2_replace(const int i, const int oldfd, const int j)
+{
+	if (syscall(__NR_dup2, oldfd, fd) != fd)
+		perror_msg_and_fail("dup2");
+	printf("%-5d dup2(%d<socket:[%lu]>, %d<socket:[%lu]>)"
+	       " = %d<socket:[%lu]>\n",
+	       pid, oldfd, ino[i], fd, ino[j], fd, ino[i]);
+}
+
+static void
+k_dupfd(const int i, const int oldfd)
+{
+	if (syscall(__NR_fcntl, oldfd, F_DUPFD, fd) != fd)
+		perror_msg_and_fail("fcntl");
+	printf("%-5d fcntl(%d<socket:[%lu]>, F_DUPFD, %d) = %d<socket:[%lu]>\n",
+	       pid, oldfd, ino[i], fd, fd, ino[i]);
+}
+
+static unsigned long
+get_ino(const int fildes)
+{
+	struct stat st;
+	if (fstat(fildes, &st))
+		perror_msg_and_fail("fstat");
+	return st.st_ino;
+}
+
+static void
+k_getfd(const int fildes, const char *const type)
+{
+	if (syscall(__NR_fcntl, fildes, F_GETFD) != 0)
+		perror_msg_and_fail("fcntl");
+	printf("%-5d fcntl(%d<%s:[%lu]>, F_GETFD) = 0\n",
+	       getpid(), fildes, type, get_ino(fildes));
+}
+
+static void *
+thread(void *arg)
+{
+	if (close(fd))
+		perror_msg_and_fail("close");
+	return arg;
+}
+
+int
+main(void)
+{
+	skip_if_unavailable("/proc/self/fd/");
+
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv))
+		perror_msg_and_skip("socketpair");
+
+	for (int i = 0; i < 2; ++i)
+		ino[i] = get_ino(sv[i]);
+	pid = getpid();
+	(void) close(fd);
+
+	/* The descriptor is replaced by dup2.  */
+	k_dup2(0, sv[0]);
+	k_dup2_replace(1, sv[1], 0);
+
+	/* The descriptor is closed and reused.  */
+	if (close(fd))
+		perror_msg_and_fail("close");
+	k_dupfd(0, sv[0]);
+
+	/* The descriptor is closed by close_range, if available.  */
+	if (
+# ifdef __NR_close_range
+	    syscall(__NR_close_range, fd, fd, 0) &&
+# endif
+	    close(fd))
+		perror_msg_and_fail("close");
+	k_dupfd(1, sv[1]);
+
+	/* The descriptor is closed by another thread.  */
+	pthread_t t;
+	errno = pthread_create(&t, NULL, thread, NULL);
+	if (errno)
+		perror_msg_and_fail("pthread_create");
+	errno = pthread_join(t, NULL);
+	if (errno)
+		perror_msg_and_fail("pthread_join");
+	k_dupfd(0, sv[0]);
+
+	/*
+	 * The descriptor number is allocated in the descriptor tables
+	 * of the parent and the child without closing it.
+	 */
+	fflush(stdout);
+	pid_t child = fork();
+	if (child < 0)
+		perror_msg_and_fail("fork");
+	if (!child) {
+		int s = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (s < 0)
+			perror_msg_and_fail("socket");
+		k_getfd(s, "socket");
+		fflush(stdout);
+		_exit(0);
+	}
+	int status;
+	if (waitpid(child, &status, 0) != child ||
+	    !WIFEXITED(status) || WEXITSTATUS(status))
+		error_msg_and_fail("child failed");
+
+	int pfd[2];
+	if (pipe(pfd))
+		perror_msg_and_fail("pipe");
+	k_getfd(pfd[0], "pipe");
+
+	return 0;
+}
+
+#else
+
+SKIP_MAIN_UNDEFINED("__NR_dup2 && __NR_fcntl")
+
+#endif
@@ -407,6 +407,13 @@ require_min_nproc()
 		framework_skip_ "nproc = $nproc is less than $min_nproc"
 }
 
+# Benchmarks are run only if STRACE_BENCHMARKS environment variable is set.
+require_benchmarks_or_skip()
+{
+	[ -n "${STRACE_BENCHMARKS-}" ] ||
+		skip_ 'benchmarks are not enabled by STRACE_BENCHMARKS'
+}
+
 # Usage: grep_pid_status $pid GREP-OPTIONS...
 grep_pid_status()
 {
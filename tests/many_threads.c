@@ -0,0 +1,80 @@
+/*
+ * Create many threads that stay alive at the same time and make syscalls.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static pthread_barrier_t barrier;
+static unsigned int num_iterations;
+
+static void *
+thread(void *arg)
+{
+	pthread_barrier_wait(&barrier);
+
+	for (unsigned int i = 0; i < num_iterations; ++i)
+		getppid();
+
+	return arg;
+}
+
+int
+main(int ac, const char *av[])
+{
+	assert(ac == 3);
+
+	int num_threads = atoi(av[1]);
+	assert(num_threads > 0);
+
+	num_iterations = atoi(av[2]);
+	assert(num_iterations > 0);
+
+	pthread_t *const threads = tail_alloc(sizeof(*threads) * num_threads);
+
+	pthread_attr_t attr;
+	if ((errno = pthread_attr_init(&attr)))
+		perror_msg_and_fail("pthread_attr_init");
+	if ((errno = pthread_attr_setstacksize(&attr, 65536)))
+		perror_msg_and_fail("pthread_attr_setstacksize");
+
+	/*
+	 * The threads wait on the barrier until all of them are created,
+	 * so that all of them are alive and make syscalls at once.
+	 * Skip the test if not all of them can be created.
+	 */
+	int created = 0;
+	if ((errno = pthread_barrier_init(&barrier, NULL, num_threads + 1)))
+		perror_msg_and_fail("pthread_barrier_init");
+	for (; created < num_threads; ++created) {
+		if ((errno = pthread_create(&threads[created], &attr,
+					    thread, NULL))) {
+			if (EAGAIN == errno)
+				break;
+			perror_msg_and_fail("pthread_create #%d", created);
+		}
+	}
+	if (created < num_threads)
+		error_msg_and_skip("only %d of %d threads created",
+				   created, num_threads);
+
+	pthread_barrier_wait(&barrier);
+
+	for (int i = 0; i < created; ++i) {
+		if ((errno = pthread_join(threads[i], NULL)))
+			perror_msg_and_fail("pthread_join #%d", i);
+	}
+
+	printf("%d\n", created);
+	return 0;
+}
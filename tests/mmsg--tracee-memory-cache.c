@@ -0,0 +1,2 @@
+/* This file is part of mmsg--tracee-memory-cache strace test. */
+#include "mmsg.c"
@@ -0,0 +1,92 @@
+/*
+ * Check that the cached ip:port pairs associated with socket descriptors
+ * are updated when the sockets are connected.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static unsigned int
+bind_loopback(const int fd, const unsigned long inode)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+	};
+	socklen_t len = sizeof(addr);
+
+	if (bind(fd, (struct sockaddr *) &addr, len))
+		perror_msg_and_skip("bind");
+	printf("bind(%d<UDP:[%lu]>, {sa_family=AF_INET, sin_port=htons(0)"
+	       ", sin_addr=inet_addr(\"127.0.0.1\")}, %u) = 0\n",
+	       fd, inode, (unsigned) len);
+
+	if (getsockname(fd, (struct sockaddr *) &addr, &len))
+		perror_msg_and_fail("getsockname");
+	const unsigned int port = ntohs(addr.sin_port);
+	printf("getsockname(%d<UDP:[127.0.0.1:%u]>, {sa_family=AF_INET"
+	       ", sin_port=htons(%u), sin_addr=inet_addr(\"127.0.0.1\")}"
+	       ", [%u]) = 0\n",
+	       fd, port, port, (unsigned) len);
+
+	return port;
+}
+
+static void
+connect_loopback(const int fd, const unsigned int port,
+		 const unsigned int peer_port)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(peer_port),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+	};
+	socklen_t len = sizeof(addr);
+
+	if (connect(fd, (struct sockaddr *) &addr, len))
+		perror_msg_and_fail("connect");
+	printf("connect(%d<UDP:[127.0.0.1:%u]>, {sa_family=AF_INET"
+	       ", sin_port=htons(%u), sin_addr=inet_addr(\"127.0.0.1\")}"
+	       ", %u) = 0\n",
+	       fd, port, peer_port, (unsigned) len);
+
+	if (getpeername(fd, (struct sockaddr *) &addr, &len))
+		perror_msg_and_fail("getpeername");
+	printf("getpeername(%d<UDP:[127.0.0.1:%u->127.0.0.1:%u]>"
+	       ", {sa_family=AF_INET, sin_port=htons(%u)"
+	       ", sin_addr=inet_addr(\"127.0.0.1\")}, [%u]) = 0\n",
+	       fd, port, peer_port, peer_port, (unsigned) len);
+}
+
+int
+main(void)
+{
+	skip_if_unavailable("/proc/self/fd/");
+
+	const int fd1 = socket(AF_INET, SOCK_DGRAM, 0);
+	const int fd2 = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd1 < 0 || fd2 < 0)
+		perror_msg_and_skip("socket");
+
+	const unsigned int port1 = bind_loopback(fd1, inode_of_sockfd(fd1));
+	const unsigned int port2 = bind_loopback(fd2, inode_of_sockfd(fd2));
+
+	/*
+	 * Both sockets are already known from the lookup of the second one,
+	 * so the first one is printed unconnected until it is connected.
+	 */
+	connect_loopback(fd1, port1, port2);
+	connect_loopback(fd2, port2, port1);
+
+	puts("+++ exited with 0 +++");
+	return 0;
+}
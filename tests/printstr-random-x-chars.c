@@ -0,0 +1,2 @@
+#define STRACE_X 3
+#include "printstr-random.c"
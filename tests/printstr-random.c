@@ -0,0 +1,169 @@
+/*
+ * Check quoting of strings made of random runs of printable and
+ * non-printable characters against the reference implementation
+ * in print_quoted_string.c.
+ *
+ * Copyright (c) 2026 The strace developers.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "tests.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef STRACE_X
+# define STRACE_X 0
+#endif
+
+#define MAX_LEN 2048
+
+static unsigned long long rnd_state = 0x9e3779b97f4a7c15ULL;
+
+static unsigned int
+rnd(void)
+{
+	/* xorshift64 */
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state >> 32;
+}
+
+static void
+fill_random(unsigned char *buf, unsigned int len, bool no_nul)
+{
+	static const char specials[] = "\"\\\t\n\v\f\r\001\037\1770\1777\200\377";
+	const unsigned int kind = rnd() % 4;
+
+	for (unsigned int i = 0; i < len; ++i) {
+		const unsigned int r = rnd();
+
+		switch (kind) {
+		case 0:
+			/* Arbitrary bytes.  */
+			buf[i] = r;
+			break;
+		case 1:
+			/* Printable characters only.  */
+			buf[i] = ' ' + r % 95;
+			break;
+		case 2:
+			/* Long printable runs with rare special characters.  */
+			buf[i] = r % 64 ? (char) ('a' + (r >> 8) % 26)
+				 : specials[(r >> 16) % (sizeof(specials) - 1)];
+			break;
+		default:
+			/* Whitespace, digits, and the printable range edges.  */
+			buf[i] = "\t\n\v\f\r 07~\177\037"[r % 11];
+			break;
+		}
+
+		if (no_nul && !buf[i])
+			buf[i] = '0';
+	}
+}
+
+#if STRACE_X == 1
+static bool
+needs_hex(const unsigned char *str, unsigned int len)
+{
+	for (unsigned int i = 0; i < len; ++i) {
+		if (str[i] > 0x7e || (str[i] < ' ' && (str[i] < 9 || str[i] > 13)))
+			return true;
+	}
+
+	return false;
+}
+#endif
+
+#if STRACE_X == 3
+static void
+print_quoted_memory_x_chars(const unsigned char *str, unsigned int len)
+{
+	putchar('"');
+	for (unsigned int i = 0; i < len; ++i) {
+		const unsigned char c = str[i];
+
+		switch (c) {
+		case '"':
+			printf("\\\"");
+			break;
+		case '\\':
+			printf("\\\\");
+			break;
+		case '\f':
+			printf("\\f");
+			break;
+		case '\n':
+			printf("\\n");
+			break;
+		case '\r':
+			printf("\\r");
+			break;
+		case '\t':
+			printf("\\t");
+			break;
+		case '\v':
+			printf("\\v");
+			break;
+		default:
+			if (c >= ' ' && c <= 0x7e)
+				putchar(c);
+			else
+				printf("\\x%02x", c);
+		}
+	}
+	putchar('"');
+}
+#endif
+
+static void
+print_str(const unsigned char *str, unsigned int len)
+{
+#if STRACE_X == 0
+	print_quoted_memory(str, len);
+#elif STRACE_X == 1
+	if (needs_hex(str, len))
+		print_quoted_hex(str, len);
+	else
+		print_quoted_memory(str, len);
+#elif STRACE_X == 3
+	print_quoted_memory_x_chars(str, len);
+#endif
+}
+
+int
+main(void)
+{
+	unsigned char *const buf = tail_alloc(MAX_LEN + 16);
+
+	for (unsigned int i = 0; i < 1000; ++i) {
+		const unsigned int len = rnd() % (i % 8 ? 64 : MAX_LEN);
+		unsigned char *const str = buf + rnd() % 16;
+
+		fill_random(str, len, false);
+		long rc = pwrite(-1, str, len, 0);
+		printf("pwrite64(-1, ");
+		print_str(str, len);
+		printf(", %u, 0) = %s\n", len, sprintrc(rc));
+	}
+
+	for (unsigned int i = 0; i < 200; ++i) {
+		const unsigned int len = 1 + rnd() % (i % 8 ? 64 : 1024);
+		unsigned char *const str = buf + rnd() % 16;
+
+		fill_random(str, len, true);
+		str[len] = '\0';
+		long rc = chdir((char *) str);
+		printf("chdir(");
+		print_str(str, len);
+		printf(") = %s\n", sprintrc(rc));
+	}
+
+	puts("+++ exited with 0 +++");
+	return 0;
+}